@@ -0,0 +1,66 @@
+/*
+Copyright (c) 2016 Gaetan Guidet
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef __pyproc_h__
+#define __pyproc_h__
+
+#include <Python.h>
+
+// Native procedural protocol
+//
+// A procedural module (usually a compiled extension) may export a PyCapsule
+// named PYPROC_NATIVE_CAPSULE as the module attribute PYPROC_NATIVE_ATTR.
+// The capsule pointer must be a PyProcNativeFuncs table that stays valid for
+// the lifetime of the module.
+//
+// The python "Init" function is still called first. Its user data is then
+// handed to 'bind' (GIL held), and pyproc calls 'numNodes', 'getNode' and
+// 'release' directly, without acquiring the GIL. The python "Cleanup"
+// function is called after 'release'.
+
+#define PYPROC_NATIVE_VERSION 1
+#define PYPROC_NATIVE_ATTR "__pyproc_native__"
+#define PYPROC_NATIVE_CAPSULE "pyproc.native"
+
+struct AtNode;
+
+typedef struct
+{
+  // Must be set to PYPROC_NATIVE_VERSION
+  int version;
+  
+  // GIL held. Returns the native data passed to the other functions.
+  // Returning NULL with a python exception set fails the procedural.
+  void* (*bind)(PyObject *userData);
+  
+  // GIL not held
+  int (*numNodes)(void *data);
+  
+  // GIL not held
+  struct AtNode* (*getNode)(void *data, int i);
+  
+  // GIL not held, may be NULL
+  void (*release)(void *data);
+  
+} PyProcNativeFuncs;
+
+#endif
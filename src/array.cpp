@@ -0,0 +1,623 @@
+/*
+Copyright (c) 2016 Gaetan Guidet
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "array.h"
+#include "buffer.h"
+#include "nodes.h"
+
+// ---
+
+typedef struct
+{
+  PyObject_HEAD
+  AtArray *array;
+  Py_ssize_t exports;
+  Py_ssize_t shape;
+  Py_ssize_t stride;
+} Array;
+
+static PyTypeObject ArrayType =
+{
+  PyObject_HEAD_INIT(NULL)
+  0,
+  "pyproc.Array",
+  sizeof(Array),
+};
+
+static PyObject* NewArray(AtArray *ary)
+{
+  Array *self = PyObject_New(Array, &ArrayType);
+  
+  if (!self)
+  {
+    AiArrayDestroy(ary);
+    return NULL;
+  }
+  
+  self->array = ary;
+  self->exports = 0;
+  
+  return (PyObject*) self;
+}
+
+static bool CheckType(int type)
+{
+  if (type == AI_TYPE_STRING || type == AI_TYPE_NODE || type == AI_TYPE_POINTER ||
+      type == AI_TYPE_ARRAY || type == AI_TYPE_UNDEFINED || PyProcNumComponents(type) == 0)
+  {
+    PyErr_Format(PyExc_ValueError, "Unsupported array type %d", type);
+    return false;
+  }
+  
+  return true;
+}
+
+static PyObject* Array_New(PyTypeObject *type, PyObject *args, PyObject *kwargs)
+{
+  static char *kwlist[] = {(char*)"type", (char*)"count", (char*)"keys", NULL};
+  
+  int atype = AI_TYPE_UNDEFINED;
+  int count = 0;
+  int keys = 1;
+  
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "ii|i", kwlist, &atype, &count, &keys))
+  {
+    return NULL;
+  }
+  
+  if (!CheckType(atype))
+  {
+    return NULL;
+  }
+  
+  if (count < 0 || keys <= 0 || keys > 255)
+  {
+    PyErr_SetString(PyExc_ValueError, "Invalid array count or motion key count");
+    return NULL;
+  }
+  
+  AtArray *ary = AiArrayAllocate(AtUInt32(count), AtByte(keys), AtByte(atype));
+  
+  if (!ary)
+  {
+    return PyErr_NoMemory();
+  }
+  
+  Array *self = (Array*) type->tp_alloc(type, 0);
+  
+  if (!self)
+  {
+    AiArrayDestroy(ary);
+    return NULL;
+  }
+  
+  self->array = ary;
+  self->exports = 0;
+  
+  return (PyObject*) self;
+}
+
+static void Array_Dealloc(Array *self)
+{
+  if (self->array)
+  {
+    AiArrayDestroy(self->array);
+    self->array = 0;
+  }
+  
+  Py_TYPE(self)->tp_free((PyObject*) self);
+}
+
+static Py_ssize_t Array_Len(Array *self)
+{
+  return (self->array ? Py_ssize_t(self->array->nelements) : 0);
+}
+
+static PyObject* Array_GetType(Array *self, void *)
+{
+  return PyInt_FromLong(self->array ? self->array->type : AI_TYPE_UNDEFINED);
+}
+
+static PyObject* Array_GetKeys(Array *self, void *)
+{
+  return PyInt_FromLong(self->array ? self->array->nkeys : 0);
+}
+
+static PyObject* Array_GetAddress(Array *self, void *)
+{
+  return PyLong_FromVoidPtr(self->array);
+}
+
+// ---
+
+static const char* ItemFormat(int type)
+{
+  switch (type)
+  {
+  case AI_TYPE_BYTE:
+    return "B";
+  case AI_TYPE_INT:
+  case AI_TYPE_ENUM:
+    return "i";
+  case AI_TYPE_UINT:
+    return "I";
+  case AI_TYPE_BOOLEAN:
+    return "?";
+  default:
+    return "f";
+  }
+}
+
+static size_t ItemSize(int type)
+{
+  switch (type)
+  {
+  case AI_TYPE_BYTE:
+    return sizeof(AtByte);
+  case AI_TYPE_INT:
+  case AI_TYPE_ENUM:
+    return sizeof(int);
+  case AI_TYPE_UINT:
+    return sizeof(unsigned int);
+  case AI_TYPE_BOOLEAN:
+    return sizeof(bool);
+  default:
+    return sizeof(float);
+  }
+}
+
+static Py_ssize_t ArrayBytes(AtArray *ary)
+{
+  return Py_ssize_t(size_t(ary->nelements) * ary->nkeys * PyProcNumComponents(ary->type) * ItemSize(ary->type));
+}
+
+static Py_ssize_t Array_GetSegCount(Array *self, Py_ssize_t *lenp)
+{
+  if (lenp)
+  {
+    *lenp = (self->array ? ArrayBytes(self->array) : 0);
+  }
+  return 1;
+}
+
+static Py_ssize_t Array_GetReadBuffer(Array *self, Py_ssize_t segment, void **ptrptr)
+{
+  if (!self->array)
+  {
+    PyErr_SetString(PyExc_RuntimeError, "Array already assigned to a node");
+    return -1;
+  }
+  
+  if (segment != 0)
+  {
+    PyErr_SetString(PyExc_SystemError, "Accessing non-existent array segment");
+    return -1;
+  }
+  
+  *ptrptr = self->array->data;
+  
+  return ArrayBytes(self->array);
+}
+
+static int Array_GetBuffer(Array *self, Py_buffer *view, int flags)
+{
+  if (!self->array)
+  {
+    PyErr_SetString(PyExc_BufferError, "Array already assigned to a node");
+    return -1;
+  }
+  
+  AtArray *ary = self->array;
+  
+  if (PyBuffer_FillInfo(view, (PyObject*) self, ary->data, ArrayBytes(ary), 0, flags) != 0)
+  {
+    return -1;
+  }
+  
+  view->itemsize = Py_ssize_t(ItemSize(ary->type));
+  
+  if (flags & PyBUF_FORMAT)
+  {
+    view->format = (char*) ItemFormat(ary->type);
+  }
+  
+  if (flags & PyBUF_ND)
+  {
+    // flat scalars, python 2 memoryviews can't index or slice multi-dimensional views
+    self->shape = view->len / view->itemsize;
+    self->stride = view->itemsize;
+    
+    view->shape = &(self->shape);
+    view->strides = ((flags & PyBUF_STRIDES) == PyBUF_STRIDES ? &(self->stride) : NULL);
+  }
+  
+  ++(self->exports);
+  
+  return 0;
+}
+
+static void Array_ReleaseBuffer(Array *self, Py_buffer *)
+{
+  --(self->exports);
+}
+
+static PyBufferProcs Array_BufferProcs =
+{
+  (readbufferproc)Array_GetReadBuffer,
+  (writebufferproc)Array_GetReadBuffer,
+  (segcountproc)Array_GetSegCount,
+  0,
+  (getbufferproc)Array_GetBuffer,
+  (releasebufferproc)Array_ReleaseBuffer
+};
+
+static PySequenceMethods Array_SeqMethods =
+{
+  (lenfunc)Array_Len,
+  0, 0, 0, 0, 0, 0, 0, 0, 0
+};
+
+static PyGetSetDef Array_GetSet[] =
+{
+  {(char*)"type", (getter)Array_GetType, NULL, (char*)"Arnold element type", NULL},
+  {(char*)"keys", (getter)Array_GetKeys, NULL, (char*)"Number of motion keys", NULL},
+  {(char*)"address", (getter)Array_GetAddress, NULL, (char*)"AtArray address, 0 once assigned to a node", NULL},
+  {NULL, NULL, NULL, NULL, NULL}
+};
+
+// ---
+
+bool PyProcArrayFill(AtArray *ary, const PyProcBuffer &buffer)
+{
+  size_t n = size_t(ary->nelements) * ary->nkeys * PyProcNumComponents(ary->type);
+  
+  switch (ary->type)
+  {
+  case AI_TYPE_BYTE:
+    return buffer.read((unsigned char*) ary->data, 0, n);
+  case AI_TYPE_INT:
+  case AI_TYPE_ENUM:
+    return buffer.read((int*) ary->data, 0, n);
+  case AI_TYPE_UINT:
+    return buffer.read((unsigned int*) ary->data, 0, n);
+  case AI_TYPE_BOOLEAN:
+    return buffer.read((bool*) ary->data, 0, n);
+  case AI_TYPE_FLOAT:
+  case AI_TYPE_RGB:
+  case AI_TYPE_RGBA:
+  case AI_TYPE_VECTOR:
+  case AI_TYPE_POINT:
+  case AI_TYPE_POINT2:
+  case AI_TYPE_MATRIX:
+    return buffer.read((float*) ary->data, 0, n);
+  default:
+    return false;
+  }
+}
+
+// Motion keys from a (keys, n, dims) or (keys, n * dims) shaped buffer
+// Matrices may also be given as (keys, n, 4, 4) or (keys, 4, 4) for a single one
+static bool InferKeys(const PyProcBuffer &buffer, int type, unsigned int &keys)
+{
+  if (buffer.ndim() < 2)
+  {
+    PyErr_SetString(PyExc_ValueError, "Can't get motion keys from a 1d buffer, pass 'keys'");
+    return false;
+  }
+  
+  size_t ncomps = PyProcNumComponents(type);
+  
+  if (buffer.shape(0) <= 0 || buffer.shape(0) > 255)
+  {
+    PyErr_Format(PyExc_ValueError, "Invalid motion key count %ld", (long) buffer.shape(0));
+    return false;
+  }
+  
+  if (type != AI_TYPE_MATRIX && buffer.ndim() == 3 && size_t(buffer.shape(2)) != ncomps)
+  {
+    PyErr_Format(PyExc_ValueError, "Expected %lu components per value, got %ld",
+                 (unsigned long) ncomps, (long) buffer.shape(2));
+    return false;
+  }
+  
+  if (type != AI_TYPE_MATRIX && buffer.ndim() > 3)
+  {
+    PyErr_SetString(PyExc_ValueError, "Expected a (keys, count, components) shaped buffer");
+    return false;
+  }
+  
+  keys = (unsigned int) buffer.shape(0);
+  
+  return true;
+}
+
+AtArray* PyProcArrayFromBuffer(PyObject *obj, int type, unsigned int keys)
+{
+  if (!CheckType(type))
+  {
+    return NULL;
+  }
+  
+  if (keys > 255)
+  {
+    PyErr_SetString(PyExc_ValueError, "Invalid motion key count");
+    return NULL;
+  }
+  
+  PyProcBuffer buffer;
+  
+  if (!buffer.acquire(obj))
+  {
+    if (!PyErr_Occurred())
+    {
+      PyErr_SetString(PyExc_TypeError, "Expected an object supporting the buffer protocol");
+    }
+    return NULL;
+  }
+  
+  if (keys == 0 && !InferKeys(buffer, type, keys))
+  {
+    return NULL;
+  }
+  
+  size_t stride = PyProcNumComponents(type) * keys;
+  
+  if (buffer.count() % stride != 0)
+  {
+    PyErr_Format(PyExc_ValueError, "Buffer holds %lu scalar(s), not a multiple of %lu",
+                 (unsigned long) buffer.count(), (unsigned long) stride);
+    return NULL;
+  }
+  
+  AtArray *ary = 0;
+  bool rv = false;
+  
+  Py_BEGIN_ALLOW_THREADS
+  
+  ary = AiArrayAllocate(AtUInt32(buffer.count() / stride), AtByte(keys), AtByte(type));
+  
+  rv = (ary != 0 && PyProcArrayFill(ary, buffer));
+  
+  Py_END_ALLOW_THREADS
+  
+  if (!rv)
+  {
+    if (ary)
+    {
+      AiArrayDestroy(ary);
+    }
+    PyErr_Format(PyExc_ValueError, "Unsupported buffer format '%c' (item size %lu)",
+                 (buffer.format() ? buffer.format() : '?'), (unsigned long) buffer.itemSize());
+    return NULL;
+  }
+  
+  return ary;
+}
+
+PyObject* PyProcArrayWrap(AtArray *ary)
+{
+  return NewArray(ary);
+}
+
+bool PyProcArrayCheck(PyObject *obj)
+{
+  return (PyObject_TypeCheck(obj, &ArrayType) != 0);
+}
+
+AtArray* PyProcArrayPeek(PyObject *obj)
+{
+  return ((Array*) obj)->array;
+}
+
+AtArray* PyProcArrayTake(PyObject *obj)
+{
+  Array *self = (Array*) obj;
+  
+  AtArray *ary = self->array;
+  
+  if (!ary)
+  {
+    PyErr_SetString(PyExc_RuntimeError, "Array already assigned to a node");
+    return NULL;
+  }
+  
+  if (self->exports > 0)
+  {
+    PyErr_SetString(PyExc_BufferError, "Array still has exported buffer views, release them first");
+    return NULL;
+  }
+  
+  self->array = 0;
+  
+  return ary;
+}
+
+AtArray* PyProcArrayTakeAs(PyObject *obj, int type, unsigned int keys)
+{
+  AtArray *ary = PyProcArrayPeek(obj);
+  
+  if (!ary)
+  {
+    PyErr_SetString(PyExc_RuntimeError, "Array already assigned to a node");
+    return NULL;
+  }
+  
+  if (ary->type == type && (keys == 0 || ary->nkeys == keys))
+  {
+    return PyProcArrayTake(obj);
+  }
+  
+  // Scalars are converted through the buffer protocol, the original array is left
+  //   to python
+  return PyProcArrayFromBuffer(obj, type, (keys == 0 ? (unsigned int) ary->nkeys : keys));
+}
+
+// ---
+
+static PyObject* PyProc_Array(PyObject *, PyObject *args, PyObject *kwargs)
+{
+  static char *kwlist[] = {(char*)"buffer", (char*)"type", (char*)"keys", NULL};
+  
+  PyObject *obj = 0;
+  int type = AI_TYPE_UNDEFINED;
+  int keys = 1;
+  
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "Oi|i", kwlist, &obj, &type, &keys))
+  {
+    return NULL;
+  }
+  
+  if (keys < 0)
+  {
+    PyErr_SetString(PyExc_ValueError, "Invalid motion key count");
+    return NULL;
+  }
+  
+  AtArray *ary = PyProcArrayFromBuffer(obj, type, (unsigned int) keys);
+  
+  return (ary ? NewArray(ary) : NULL);
+}
+
+static PyObject* SetArray(PyObject *args, PyObject *kwargs, int keys)
+{
+  static char *kwlist[] = {(char*)"node", (char*)"param", (char*)"value", (char*)"type", (char*)"keys", NULL};
+  
+  PyObject *pynode = 0;
+  const char *param = 0;
+  PyObject *value = 0;
+  int type = AI_TYPE_UNDEFINED;
+  int defaultKeys = keys;
+  
+  keys = -1;
+  
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OsO|ii", kwlist, &pynode, &param, &value, &type, &keys))
+  {
+    return NULL;
+  }
+  
+  // pyproc.Array values keep their own key count unless one is given
+  bool keysGiven = (keys != -1);
+  
+  if (!keysGiven)
+  {
+    keys = defaultKeys;
+  }
+  
+  if (keys < 0)
+  {
+    PyErr_SetString(PyExc_ValueError, "Invalid motion key count");
+    return NULL;
+  }
+  
+  AtNode *node = PyProcGetNode(pynode);
+  
+  if (!node)
+  {
+    return NULL;
+  }
+  
+  if (type == AI_TYPE_UNDEFINED)
+  {
+    int ptype = PyProcParamType(node, param, &type);
+    
+    if (ptype != AI_TYPE_ARRAY)
+    {
+      // Arrays may be set on animatable non array parameters (matrix...)
+      type = ptype;
+    }
+    
+    if (type == AI_TYPE_UNDEFINED)
+    {
+      PyErr_Format(PyExc_ValueError, "Node has no parameter \"%s\"", param);
+      return NULL;
+    }
+  }
+  
+  AtArray *ary = 0;
+  
+  if (PyProcArrayCheck(value))
+  {
+    ary = PyProcArrayTakeAs(value, type, (keysGiven ? (unsigned int) keys : 0));
+  }
+  else
+  {
+    ary = PyProcArrayFromBuffer(value, type, (unsigned int) keys);
+  }
+  
+  if (!ary)
+  {
+    return NULL;
+  }
+  
+  AiNodeSetArray(node, param, ary);
+  
+  Py_RETURN_NONE;
+}
+
+static PyObject* PyProc_SetArray(PyObject *, PyObject *args, PyObject *kwargs)
+{
+  return SetArray(args, kwargs, 1);
+}
+
+static PyObject* PyProc_SetKeys(PyObject *, PyObject *args, PyObject *kwargs)
+{
+  return SetArray(args, kwargs, 0);
+}
+
+static PyMethodDef gsArrayMethods[] =
+{
+  {"array", (PyCFunction)PyProc_Array, METH_VARARGS | METH_KEYWORDS, "array(buffer, type, keys=1)"},
+  {"setarray", (PyCFunction)PyProc_SetArray, METH_VARARGS | METH_KEYWORDS, "setarray(node, param, value, type=None, keys=1)"},
+  {"setkeys", (PyCFunction)PyProc_SetKeys, METH_VARARGS | METH_KEYWORDS, "setkeys(node, param, value, type=None, keys=0)"},
+  {NULL, NULL, 0, NULL}
+};
+
+bool PyProcArrayInit(PyObject *mod)
+{
+  ArrayType.tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_NEWBUFFER;
+  ArrayType.tp_doc = "Array(type, count, keys=1)\n\nArnold array owned by python until assigned to a node";
+  ArrayType.tp_new = Array_New;
+  ArrayType.tp_dealloc = (destructor)Array_Dealloc;
+  ArrayType.tp_as_buffer = &Array_BufferProcs;
+  ArrayType.tp_as_sequence = &Array_SeqMethods;
+  ArrayType.tp_getset = Array_GetSet;
+  
+  if (PyType_Ready(&ArrayType) < 0)
+  {
+    return false;
+  }
+  
+  Py_INCREF(&ArrayType);
+  PyModule_AddObject(mod, "Array", (PyObject*) &ArrayType);
+  
+  for (PyMethodDef *def = gsArrayMethods; def->ml_name; ++def)
+  {
+    PyObject *func = PyCFunction_New(def, NULL);
+    
+    if (!func || PyModule_AddObject(mod, def->ml_name, func) != 0)
+    {
+      return false;
+    }
+  }
+  
+  return true;
+}
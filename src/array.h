@@ -0,0 +1,89 @@
+/*
+Copyright (c) 2016 Gaetan Guidet
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef __pyproc_array_h__
+#define __pyproc_array_h__
+
+#include <Python.h>
+#include <ai.h>
+
+class PyProcBuffer;
+
+// pyproc.Array wraps an AtArray owned by python until it is assigned to a node
+//   parameter, at which point ownership moves to the node without copy
+//
+// pyproc.array(buffer, type, keys=1)
+//   Build an array from any buffer protocol object holding nelements * keys values
+//   of the given arnold type, components interleaved (3 floats per point...)
+//   Data is copied once with the GIL released, converting the scalar type if needed
+//   keys=0 takes the motion key count from the leading dimension of the buffer
+//
+// pyproc.Array(type, count, keys=1)
+//   Allocate an uninitialized array to be filled in place from python through the
+//   buffer protocol (memoryview, numpy.frombuffer...), with no copy at all
+//   New style buffer views are tracked and the array can't be assigned while any
+//   is alive; old style buffers must not be written once the array is assigned
+//
+// pyproc.setarray(node, param, value, type=None, keys=1)
+//   Assign a pyproc.Array (adopted) or a buffer (copied) to a node parameter
+//   The type defaults to the parameter array element type, a pyproc.Array of another
+//   element type or key count is converted
+//
+// pyproc.setkeys(node, param, value, type=None, keys=0)
+//   setarray for motion keys, all keys are set in one call from a (keys, n, dims)
+//   shaped buffer ((keys, 4, 4) for a single matrix), deformation blur on shapes
+//   'points'/'vlist'/'nlist' or transform blur on 'matrix'
+//
+// Nodes are given by name, address or arnold python binding pointer
+
+// All functions must be called with the GIL held
+
+bool PyProcArrayInit(PyObject *mod);
+
+bool PyProcArrayCheck(PyObject *obj);
+
+// Take ownership of the wrapped AtArray, NULL with a python exception set if
+//   the array was already taken or still has exported buffer views
+AtArray* PyProcArrayTake(PyObject *obj);
+
+// Take a pyproc.Array for a parameter of the given element type and key count (0 for
+//   any), adopted as is when they match and converted to a new array otherwise
+// NULL with a python exception set on failure
+AtArray* PyProcArrayTakeAs(PyObject *obj, int type, unsigned int keys);
+
+// Wrapped AtArray without taking ownership, NULL if already taken
+// Hold a buffer view on the object to prevent it from being taken meanwhile
+AtArray* PyProcArrayPeek(PyObject *obj);
+
+// Build an array from a buffer, NULL with a python exception set on failure
+// A zero key count is taken from the buffer shape (keys, n, dims)
+// The GIL is released while copying
+AtArray* PyProcArrayFromBuffer(PyObject *obj, int type, unsigned int keys);
+
+// Copy or convert buffer values into an allocated array, doesn't need the GIL
+bool PyProcArrayFill(AtArray *ary, const PyProcBuffer &buffer);
+
+// Wrap an array in a new pyproc.Array object taking ownership of it
+// The array is destroyed and NULL returned on failure
+PyObject* PyProcArrayWrap(AtArray *ary);
+
+#endif
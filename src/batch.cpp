@@ -0,0 +1,460 @@
+/*
+Copyright (c) 2016 Gaetan Guidet
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "batch.h"
+#include "buffer.h"
+#include "nodes.h"
+#include "names.h"
+#include <string>
+#include <cstdio>
+
+// ---
+
+struct BatchColumn
+{
+  std::string param;
+  int type;
+  size_t components;
+  bool constant;
+  PyProcValue value;
+  std::string str;
+  PyProcBuffer buffer;
+  std::vector<std::string> strings;
+  std::vector<AtNode*> nodes;
+};
+
+typedef struct
+{
+  PyObject_HEAD
+  std::string *nodeType;
+  std::string *prefix;
+  size_t count;
+  std::vector<BatchColumn*> *columns;
+  std::vector<AtNode*> *nodes;
+  bool committed;
+} NodeBatch;
+
+// Read the value of node i from a buffer column, doesn't require the GIL
+static bool ReadColumn(const BatchColumn *col, size_t i, PyProcValue &v)
+{
+  size_t first = i * col->components;
+  
+  switch (col->type)
+  {
+  case AI_TYPE_BYTE:
+    return col->buffer.read(&v.b, first, 1);
+  case AI_TYPE_INT:
+  case AI_TYPE_ENUM:
+    return col->buffer.read(&v.i, first, 1);
+  case AI_TYPE_UINT:
+    return col->buffer.read(&v.u, first, 1);
+  case AI_TYPE_BOOLEAN:
+    return col->buffer.read(&v.bo, first, 1);
+  default:
+    return col->buffer.read(v.f, first, col->components);
+  }
+}
+
+static void ClearColumns(NodeBatch *self)
+{
+  for (size_t i=0; i<self->columns->size(); ++i)
+  {
+    delete (*self->columns)[i];
+  }
+  self->columns->clear();
+}
+
+static void Commit(NodeBatch *self)
+{
+  std::vector<BatchColumn*> &columns = *(self->columns);
+  std::vector<AtNode*> &nodes = *(self->nodes);
+  
+  const char *nodeType = self->nodeType->c_str();
+  const char *prefix = (self->prefix ? self->prefix->c_str() : 0);
+  
+  size_t failed = 0;
+  
+  nodes.reserve(self->count);
+  
+  PyProcNames *names = PyProcNames::Current();
+  unsigned long firstName = (prefix ? 0 : names->reserve(self->count));
+  
+  Py_BEGIN_ALLOW_THREADS
+  
+  std::string name;
+  char index[32];
+  PyProcValue v;
+  
+  for (size_t i=0; i<self->count; ++i)
+  {
+    AtNode *node = AiNode(nodeType);
+    
+    if (!node)
+    {
+      ++failed;
+      continue;
+    }
+    
+    if (prefix)
+    {
+      sprintf(index, "%lu", (unsigned long)i);
+      name = prefix;
+      name += index;
+    }
+    else
+    {
+      names->format(firstName + i, 0, name);
+    }
+    
+    AiNodeSetStr(node, "name", name.c_str());
+    
+    for (size_t j=0; j<columns.size(); ++j)
+    {
+      const BatchColumn *col = columns[j];
+      
+      if (col->constant)
+      {
+        PyProcSetValue(node, col->param.c_str(), col->type, &(col->value));
+      }
+      else if (col->type == AI_TYPE_STRING)
+      {
+        AiNodeSetStr(node, col->param.c_str(), col->strings[i].c_str());
+      }
+      else if (col->type == AI_TYPE_NODE)
+      {
+        AiNodeSetPtr(node, col->param.c_str(), col->nodes[i]);
+      }
+      else if (ReadColumn(col, i, v))
+      {
+        PyProcSetValue(node, col->param.c_str(), col->type, &v);
+      }
+    }
+    
+    nodes.push_back(node);
+  }
+  
+  Py_END_ALLOW_THREADS
+  
+  if (failed > 0)
+  {
+    AiMsgError("[pyproc] NodeBatch: Failed to create %lu \"%s\" node(s)", (unsigned long)failed, nodeType);
+  }
+  
+  // Source buffers are not needed anymore
+  ClearColumns(self);
+  
+  self->committed = true;
+}
+
+// ---
+
+static PyObject* NodeBatch_New(PyTypeObject *type, PyObject *, PyObject *)
+{
+  NodeBatch *self = (NodeBatch*) type->tp_alloc(type, 0);
+  
+  if (self)
+  {
+    self->nodeType = new std::string();
+    self->prefix = 0;
+    self->count = 0;
+    self->columns = new std::vector<BatchColumn*>();
+    self->nodes = new std::vector<AtNode*>();
+    self->committed = false;
+  }
+  
+  return (PyObject*) self;
+}
+
+static int NodeBatch_Init(NodeBatch *self, PyObject *args, PyObject *kwargs)
+{
+  static char *kwlist[] = {(char*)"node_type", (char*)"count", (char*)"prefix", NULL};
+  
+  const char *nodeType = 0;
+  const char *prefix = 0;
+  int count = 0;
+  
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "si|z", kwlist, &nodeType, &count, &prefix))
+  {
+    return -1;
+  }
+  
+  if (count < 0)
+  {
+    PyErr_SetString(PyExc_ValueError, "Invalid node count");
+    return -1;
+  }
+  
+  if (!AiNodeEntryLookUp(nodeType))
+  {
+    PyErr_Format(PyExc_ValueError, "Unknown node type \"%s\"", nodeType);
+    return -1;
+  }
+  
+  *(self->nodeType) = nodeType;
+  self->count = size_t(count);
+  
+  delete self->prefix;
+  self->prefix = (prefix ? new std::string(prefix) : 0);
+  
+  return 0;
+}
+
+static void NodeBatch_Dealloc(NodeBatch *self)
+{
+  ClearColumns(self);
+  
+  delete self->nodeType;
+  delete self->prefix;
+  delete self->columns;
+  delete self->nodes;
+  
+  Py_TYPE(self)->tp_free((PyObject*) self);
+}
+
+static PyObject* NodeBatch_Set(NodeBatch *self, PyObject *args)
+{
+  const char *param = 0;
+  PyObject *value = 0;
+  
+  if (!PyArg_ParseTuple(args, "sO", &param, &value))
+  {
+    return NULL;
+  }
+  
+  if (self->committed)
+  {
+    PyErr_SetString(PyExc_RuntimeError, "NodeBatch already committed");
+    return NULL;
+  }
+  
+  int type = PyProcEntryParamType(AiNodeEntryLookUp(self->nodeType->c_str()), param);
+  
+  if (type == AI_TYPE_UNDEFINED)
+  {
+    PyErr_Format(PyExc_ValueError, "%s node has no parameter \"%s\"", self->nodeType->c_str(), param);
+    return NULL;
+  }
+  
+  if (type == AI_TYPE_ARRAY || type == AI_TYPE_POINTER)
+  {
+    PyErr_Format(PyExc_ValueError, "Unsupported %s parameter \"%s\"", AiParamGetTypeName(type), param);
+    return NULL;
+  }
+  
+  BatchColumn *col = new BatchColumn();
+  
+  col->param = param;
+  col->type = type;
+  col->components = PyProcNumComponents(type);
+  col->constant = false;
+  
+  bool rv = false;
+  
+  if (PyString_Check(value))
+  {
+    // Constant string, enum or node
+    col->constant = true;
+    col->str = PyString_AsString(value);
+    
+    if (type == AI_TYPE_STRING || type == AI_TYPE_ENUM)
+    {
+      col->type = AI_TYPE_STRING;
+      col->value.s = col->str.c_str();
+      rv = true;
+    }
+    else if (type == AI_TYPE_NODE)
+    {
+      col->value.p = AiNodeLookUpByName(col->str.c_str());
+      rv = (col->value.p != 0);
+    }
+  }
+  else if (PyList_Check(value) && (type == AI_TYPE_STRING || type == AI_TYPE_NODE))
+  {
+    // Per node strings or node names
+    rv = (size_t(PyList_GET_SIZE(value)) == self->count);
+    
+    for (size_t i=0; rv && i<self->count; ++i)
+    {
+      PyObject *item = PyList_GET_ITEM(value, i);
+      
+      if (!PyString_Check(item))
+      {
+        rv = false;
+      }
+      else if (type == AI_TYPE_STRING)
+      {
+        col->strings.push_back(PyString_AsString(item));
+      }
+      else
+      {
+        col->nodes.push_back(AiNodeLookUpByName(PyString_AsString(item)));
+        rv = (col->nodes.back() != 0);
+      }
+    }
+  }
+  else if ((PyObject_CheckBuffer(value) || (!PyTuple_Check(value) && !PyList_Check(value) && PyObject_CheckReadBuffer(value))) &&
+           type != AI_TYPE_STRING && type != AI_TYPE_NODE)
+  {
+    // Column
+    if (col->buffer.acquire(value))
+    {
+      rv = (col->buffer.count() >= self->count * col->components);
+      
+      if (!rv)
+      {
+        PyErr_Format(PyExc_ValueError, "Column for parameter \"%s\" has %lu value(s), expected %lu",
+                     param, (unsigned long)col->buffer.count(), (unsigned long)(self->count * col->components));
+        delete col;
+        return NULL;
+      }
+    }
+  }
+  else
+  {
+    // Constant
+    col->constant = true;
+    rv = PyProcConvertValue(type, value, &(col->value));
+  }
+  
+  if (!rv)
+  {
+    delete col;
+    if (!PyErr_Occurred())
+    {
+      PyErr_Format(PyExc_ValueError, "Invalid value for %s parameter \"%s\"", AiParamGetTypeName(type), param);
+    }
+    return NULL;
+  }
+  
+  // Replace any previous setting of the same parameter
+  for (size_t i=0; i<self->columns->size(); ++i)
+  {
+    if ((*self->columns)[i]->param == col->param)
+    {
+      delete (*self->columns)[i];
+      self->columns->erase(self->columns->begin() + i);
+      break;
+    }
+  }
+  
+  self->columns->push_back(col);
+  
+  Py_RETURN_NONE;
+}
+
+static PyObject* NodeBatch_Commit(NodeBatch *self, PyObject *)
+{
+  if (!self->committed)
+  {
+    Commit(self);
+  }
+  
+  Py_RETURN_NONE;
+}
+
+static Py_ssize_t NodeBatch_Len(NodeBatch *self)
+{
+  return Py_ssize_t(self->count);
+}
+
+static PyMethodDef NodeBatch_Methods[] =
+{
+  {"set", (PyCFunction)NodeBatch_Set, METH_VARARGS, "set(param, value_or_column)"},
+  {"commit", (PyCFunction)NodeBatch_Commit, METH_NOARGS, "Create all nodes"},
+  {NULL, NULL, 0, NULL}
+};
+
+static PySequenceMethods NodeBatch_SeqMethods =
+{
+  (lenfunc)NodeBatch_Len,
+  0, 0, 0, 0, 0, 0, 0, 0, 0
+};
+
+static PyTypeObject NodeBatchType =
+{
+  PyObject_HEAD_INIT(NULL)
+  0,
+  "pyproc.NodeBatch",
+  sizeof(NodeBatch),
+};
+
+// ---
+
+bool PyProcBatchInit(PyObject *mod)
+{
+  NodeBatchType.tp_flags = Py_TPFLAGS_DEFAULT;
+  NodeBatchType.tp_doc = "NodeBatch(node_type, count, prefix=None)";
+  NodeBatchType.tp_new = NodeBatch_New;
+  NodeBatchType.tp_init = (initproc)NodeBatch_Init;
+  NodeBatchType.tp_dealloc = (destructor)NodeBatch_Dealloc;
+  NodeBatchType.tp_methods = NodeBatch_Methods;
+  NodeBatchType.tp_as_sequence = &NodeBatch_SeqMethods;
+  
+  if (PyType_Ready(&NodeBatchType) < 0)
+  {
+    return false;
+  }
+  
+  Py_INCREF(&NodeBatchType);
+  PyModule_AddObject(mod, "NodeBatch", (PyObject*) &NodeBatchType);
+  
+  return true;
+}
+
+bool PyProcBatchCheck(PyObject *obj)
+{
+  return (PyObject_TypeCheck(obj, &NodeBatchType) != 0);
+}
+
+bool PyProcBatchNodes(PyObject *obj, std::vector<AtNode*> &nodes)
+{
+  if (!PyProcBatchCheck(obj))
+  {
+    return false;
+  }
+  
+  NodeBatch *self = (NodeBatch*) obj;
+  
+  if (!self->committed)
+  {
+    Commit(self);
+  }
+  
+  nodes.insert(nodes.end(), self->nodes->begin(), self->nodes->end());
+  
+  return true;
+}
+
+PyObject* PyProcBatchWrap(const char *nodeType, std::vector<AtNode*> &nodes)
+{
+  NodeBatch *self = (NodeBatch*) NodeBatch_New(&NodeBatchType, NULL, NULL);
+  
+  if (self)
+  {
+    *(self->nodeType) = nodeType;
+    self->count = nodes.size();
+    self->nodes->swap(nodes);
+    self->committed = true;
+  }
+  
+  return (PyObject*) self;
+}
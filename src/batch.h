@@ -0,0 +1,55 @@
+/*
+Copyright (c) 2016 Gaetan Guidet
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef __pyproc_batch_h__
+#define __pyproc_batch_h__
+
+#include <Python.h>
+#include <ai.h>
+#include <vector>
+
+// pyproc.NodeBatch(node_type, count, prefix=None)
+//
+// Creates 'count' nodes of the same type in a single native call
+// Nodes are named prefix + index, or given unique names without prefix
+// Parameters are set either from a constant value or from a column: a buffer
+//   holding 'count' values in struct-of-arrays layout (a float column for a
+//   'point' parameter holds count*3 floats) or a list of strings for string and
+//   node parameters
+// Nodes are created by commit() with the GIL released, a batch returned by the
+//   Generate/GetNodes entry points is committed if needed and all its nodes
+//   are returned to arnold
+
+// All functions must be called with the GIL held
+
+bool PyProcBatchInit(PyObject *mod);
+
+bool PyProcBatchCheck(PyObject *obj);
+
+// Commit batch if needed and append its nodes
+bool PyProcBatchNodes(PyObject *obj, std::vector<AtNode*> &nodes);
+
+// Committed batch holding already created nodes, 'nodes' is emptied
+// Used by the native builders creating many nodes at once, new reference
+PyObject* PyProcBatchWrap(const char *nodeType, std::vector<AtNode*> &nodes);
+
+#endif
@@ -0,0 +1,287 @@
+/*
+Copyright (c) 2016 Gaetan Guidet
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "buffer.h"
+#include <cstring>
+
+PyProcBuffer::PyProcBuffer()
+  : mObject(0)
+  , mNewStyle(false)
+  , mData(0)
+  , mBytes(0)
+  , mFormat(0)
+  , mItemSize(0)
+  , mNDim(0)
+{
+}
+
+PyProcBuffer::~PyProcBuffer()
+{
+  release();
+}
+
+bool PyProcBuffer::Supported(PyObject *obj)
+{
+  if (PyObject_CheckBuffer(obj))
+  {
+    return true;
+  }
+  
+  PyBufferProcs *procs = Py_TYPE(obj)->tp_as_buffer;
+  
+  return (procs != 0 && procs->bf_getreadbuffer != 0);
+}
+
+bool PyProcBuffer::acquire(PyObject *obj, bool writable)
+{
+  release();
+  
+  if (PyObject_CheckBuffer(obj))
+  {
+    int flags = PyBUF_C_CONTIGUOUS | PyBUF_FORMAT | (writable ? PyBUF_WRITABLE : 0);
+    
+    if (PyObject_GetBuffer(obj, &mView, flags) != 0)
+    {
+      return false;
+    }
+    
+    mNewStyle = true;
+    mData = mView.buf;
+    mBytes = size_t(mView.len);
+    mItemSize = size_t(mView.itemsize);
+    mFormat = 'B';
+    
+    if (mView.format)
+    {
+      // native, little/big endian or network order prefixes, values are read as native
+      //   so that multi-byte items in the other byte order are refused
+      const char *fmt = mView.format;
+      
+      if (*fmt == '<' || *fmt == '>' || *fmt == '!')
+      {
+        const unsigned short one = 1;
+        
+        bool little = (*((const unsigned char*) &one) == 1);
+        
+        if (mItemSize > 1 && little != (*fmt == '<'))
+        {
+          PyErr_Format(PyExc_ValueError, "Unsupported non-native byte order in buffer format '%s'", mView.format);
+          PyBuffer_Release(&mView);
+          mNewStyle = false;
+          mData = 0;
+          mBytes = 0;
+          return false;
+        }
+      }
+      
+      if (*fmt == '@' || *fmt == '=' || *fmt == '<' || *fmt == '>' || *fmt == '!')
+      {
+        ++fmt;
+      }
+      
+      mFormat = (fmt[0] != '\0' && fmt[1] == '\0' ? fmt[0] : 0);
+    }
+    
+    mNDim = (mView.ndim > 4 ? 0 : mView.ndim);
+    
+    for (int i=0; i<mNDim; ++i)
+    {
+      mShape[i] = (mView.shape ? mView.shape[i] : Py_ssize_t(mBytes / mItemSize));
+    }
+  }
+  else
+  {
+    Py_ssize_t len = 0;
+    
+    if (writable)
+    {
+      if (PyObject_AsWriteBuffer(obj, &mData, &len) != 0)
+      {
+        return false;
+      }
+    }
+    else
+    {
+      const void *data = 0;
+      
+      if (PyObject_AsReadBuffer(obj, &data, &len) != 0)
+      {
+        return false;
+      }
+      
+      mData = (void*) data;
+    }
+    
+    mNewStyle = false;
+    mBytes = size_t(len);
+    mItemSize = 4;
+    mFormat = 0;
+    mNDim = 1;
+    mShape[0] = Py_ssize_t(mBytes / mItemSize);
+  }
+  
+  Py_INCREF(obj);
+  mObject = obj;
+  
+  return true;
+}
+
+void PyProcBuffer::release()
+{
+  if (mObject)
+  {
+    if (mNewStyle)
+    {
+      PyBuffer_Release(&mView);
+    }
+    
+    Py_DECREF(mObject);
+    
+    mObject = 0;
+  }
+  
+  mNewStyle = false;
+  mData = 0;
+  mBytes = 0;
+  mFormat = 0;
+  mItemSize = 0;
+  mNDim = 0;
+}
+
+bool PyProcBuffer::isFloat() const
+{
+  return (mFormat == 'f' || mFormat == 'd');
+}
+
+bool PyProcBuffer::isInteger() const
+{
+  return (mFormat != 0 && strchr("bBhHiIlLqQ?", mFormat) != 0);
+}
+
+bool PyProcBuffer::isNumeric() const
+{
+  return (isFloat() || isInteger() || (mFormat == 0 && mItemSize == 4));
+}
+
+template <typename T>
+bool PyProcBuffer::readAs(T *out, char format, size_t first, size_t n) const
+{
+  if (first + n > count())
+  {
+    return false;
+  }
+  
+  // Unknown format: assume the scalar type of the destination if sizes match
+  if (format == 0)
+  {
+    if (mItemSize != sizeof(T))
+    {
+      return false;
+    }
+    memcpy(out, (const char*)mData + first * sizeof(T), n * sizeof(T));
+    return true;
+  }
+  
+#define PYPROC_READ_AS(C, TYPE) \
+  case C: \
+    if (sizeof(TYPE) != mItemSize) return false; \
+    { \
+      const TYPE *in = (const TYPE*)mData + first; \
+      for (size_t i=0; i<n; ++i) out[i] = T(in[i]); \
+    } \
+    return true;
+  
+  switch (format)
+  {
+  PYPROC_READ_AS('f', float)
+  PYPROC_READ_AS('d', double)
+  PYPROC_READ_AS('b', signed char)
+  PYPROC_READ_AS('B', unsigned char)
+  PYPROC_READ_AS('?', unsigned char)
+  PYPROC_READ_AS('h', short)
+  PYPROC_READ_AS('H', unsigned short)
+  PYPROC_READ_AS('i', int)
+  PYPROC_READ_AS('I', unsigned int)
+  PYPROC_READ_AS('l', long)
+  PYPROC_READ_AS('L', unsigned long)
+  PYPROC_READ_AS('q', long long)
+  PYPROC_READ_AS('Q', unsigned long long)
+  default:
+    return false;
+  }
+  
+#undef PYPROC_READ_AS
+}
+
+bool PyProcBuffer::read(float *out, size_t first, size_t n) const
+{
+  if (mFormat == 'f' || mFormat == 0)
+  {
+    return readAs(out, 0, first, n);
+  }
+  return readAs(out, mFormat, first, n);
+}
+
+const float* PyProcBuffer::floats(std::vector<float> &tmp) const
+{
+  if (count() == 0)
+  {
+    return 0;
+  }
+  
+  if (mItemSize == sizeof(float) && (mFormat == 'f' || mFormat == 0))
+  {
+    return (const float*) mData;
+  }
+  
+  tmp.resize(count());
+  
+  return (read(&tmp[0], 0, tmp.size()) ? &tmp[0] : 0);
+}
+
+bool PyProcBuffer::read(int *out, size_t first, size_t n) const
+{
+  if (mFormat == 'i' || mFormat == 0)
+  {
+    return readAs(out, 0, first, n);
+  }
+  return readAs(out, mFormat, first, n);
+}
+
+bool PyProcBuffer::read(unsigned int *out, size_t first, size_t n) const
+{
+  if (mFormat == 'I' || mFormat == 0)
+  {
+    return readAs(out, 0, first, n);
+  }
+  return readAs(out, mFormat, first, n);
+}
+
+bool PyProcBuffer::read(unsigned char *out, size_t first, size_t n) const
+{
+  return readAs(out, (mFormat == 'B' ? 0 : mFormat), first, n);
+}
+
+bool PyProcBuffer::read(bool *out, size_t first, size_t n) const
+{
+  return readAs(out, mFormat, first, n);
+}
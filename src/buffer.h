@@ -0,0 +1,97 @@
+/*
+Copyright (c) 2016 Gaetan Guidet
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef __pyproc_buffer_h__
+#define __pyproc_buffer_h__
+
+#include <Python.h>
+#include <cstddef>
+#include <vector>
+
+// View on a python object exposing the buffer protocol (numpy arrays, memoryview,
+//   array.array, bytearray, str...)
+// The new style protocol is preferred as it provides the item format and shape,
+//   objects only supporting the old style protocol are assumed to hold 32 bits scalars
+// acquire/release must be called with the GIL held, data accessors don't need it
+
+class PyProcBuffer
+{
+public:
+  
+  // Does the object expose either buffer protocol
+  static bool Supported(PyObject *obj);
+  
+  PyProcBuffer();
+  ~PyProcBuffer();
+  
+  bool acquire(PyObject *obj, bool writable=false);
+  void release();
+  
+  inline bool valid() const { return (mObject != 0); }
+  inline void* data() const { return mData; }
+  inline size_t bytes() const { return mBytes; }
+  // struct module format character, 0 if unknown
+  inline char format() const { return mFormat; }
+  inline size_t itemSize() const { return mItemSize; }
+  inline size_t count() const { return (mItemSize > 0 ? mBytes / mItemSize : 0); }
+  inline int ndim() const { return mNDim; }
+  inline Py_ssize_t shape(int i) const { return (i >= 0 && i < mNDim ? mShape[i] : 1); }
+  
+  bool isFloat() const;
+  bool isInteger() const;
+  // Float or integer scalars, old style buffers of 32 bits items included
+  bool isNumeric() const;
+  
+  // Copy n scalars starting at scalar index 'first', converting from the buffer format
+  // Returns false if the buffer is too small or its format is not numeric
+  bool read(float *out, size_t first, size_t n) const;
+  bool read(int *out, size_t first, size_t n) const;
+  bool read(unsigned int *out, size_t first, size_t n) const;
+  bool read(unsigned char *out, size_t first, size_t n) const;
+  bool read(bool *out, size_t first, size_t n) const;
+  
+  // All scalars as floats, in place when the buffer holds 32 bits floats, converted
+  //   into 'tmp' otherwise, NULL if empty or not numeric
+  const float* floats(std::vector<float> &tmp) const;
+  
+private:
+  
+  PyProcBuffer(const PyProcBuffer&);
+  PyProcBuffer& operator=(const PyProcBuffer&);
+  
+  template <typename T>
+  bool readAs(T *out, char format, size_t first, size_t n) const;
+  
+private:
+  
+  PyObject *mObject;
+  Py_buffer mView;
+  bool mNewStyle;
+  void *mData;
+  size_t mBytes;
+  char mFormat;
+  size_t mItemSize;
+  int mNDim;
+  Py_ssize_t mShape[4];
+};
+
+#endif
@@ -0,0 +1,220 @@
+/*
+Copyright (c) 2016 Gaetan Guidet
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "camera.h"
+#include <cmath>
+
+PyProcCamera::PyProcCamera()
+  : mValid(false)
+  , mFrustum(false)
+  , mOrtho(false)
+  , mTanHalfFov(1.0f)
+  , mNear(0.0f)
+  , mFar(1.0e30f)
+  , mXRes(1)
+  , mYRes(1)
+{
+  mPosition.x = mPosition.y = mPosition.z = 0.0f;
+  mWindowMin.x = mWindowMin.y = -1.0f;
+  mWindowMax.x = mWindowMax.y = 1.0f;
+  AiM4Identity(mWorldToCamera);
+}
+
+bool PyProcCamera::setup(AtNode *camera)
+{
+  mValid = false;
+  mFrustum = false;
+  
+  AtNode *opts = AiUniverseGetOptions();
+  
+  if (!camera && opts)
+  {
+    camera = (AtNode*) AiNodeGetPtr(opts, "camera");
+  }
+  
+  if (!camera)
+  {
+    AtNodeIterator *it = AiUniverseGetNodeIterator(AI_NODE_CAMERA);
+    
+    if (!AiNodeIteratorFinished(it))
+    {
+      camera = AiNodeIteratorGetNext(it);
+    }
+    
+    AiNodeIteratorDestroy(it);
+  }
+  
+  if (!camera)
+  {
+    return false;
+  }
+  
+  if (opts)
+  {
+    mXRes = AiNodeGetInt(opts, "xres");
+    mYRes = AiNodeGetInt(opts, "yres");
+  }
+  
+  if (mXRes <= 0) mXRes = 1;
+  if (mYRes <= 0) mYRes = 1;
+  
+  AtMatrix camToWorld;
+  AtPoint origin = {0.0f, 0.0f, 0.0f};
+  
+  AiNodeGetMatrix(camera, "matrix", camToWorld);
+  AiM4Invert(camToWorld, mWorldToCamera);
+  AiM4PointByMatrixMult(&mPosition, camToWorld, &origin);
+  
+  mNear = AiNodeGetFlt(camera, "near_clip");
+  mFar = AiNodeGetFlt(camera, "far_clip");
+  
+  if (mFar <= mNear)
+  {
+    mFar = 1.0e30f;
+  }
+  
+  mOrtho = AiNodeIs(camera, "ortho_camera");
+  mFrustum = (mOrtho || AiNodeIs(camera, "persp_camera"));
+  
+  if (mFrustum)
+  {
+    mWindowMin = AiNodeGetPnt2(camera, "screen_window_min");
+    mWindowMax = AiNodeGetPnt2(camera, "screen_window_max");
+    
+    if (mWindowMax.x <= mWindowMin.x || mWindowMax.y <= mWindowMin.y)
+    {
+      mWindowMin.x = mWindowMin.y = -1.0f;
+      mWindowMax.x = mWindowMax.y = 1.0f;
+    }
+    
+    // The screen window y range covers the image height, scaled by the frame aspect
+    float aspect = float(mXRes) / float(mYRes);
+    
+    mWindowMin.y /= aspect;
+    mWindowMax.y /= aspect;
+    
+    if (!mOrtho)
+    {
+      float fov = AiNodeGetFlt(camera, "fov");
+      
+      if (fov <= 0.0f || fov >= 180.0f)
+      {
+        mFrustum = false;
+      }
+      else
+      {
+        mTanHalfFov = tanf(0.5f * fov * float(AI_PI) / 180.0f);
+      }
+    }
+  }
+  
+  mValid = true;
+  
+  return true;
+}
+
+float PyProcCamera::distance(const AtPoint &p) const
+{
+  float dx = p.x - mPosition.x;
+  float dy = p.y - mPosition.y;
+  float dz = p.z - mPosition.z;
+  
+  return sqrtf(dx * dx + dy * dy + dz * dz);
+}
+
+static void SetPlane(float *plane, float a, float b, float c, float d)
+{
+  float l = sqrtf(a * a + b * b + c * c);
+  
+  plane[0] = a / l;
+  plane[1] = b / l;
+  plane[2] = c / l;
+  plane[3] = d / l;
+}
+
+int PyProcCamera::frustum(float padding, float planes[6][4]) const
+{
+  if (!mValid || !mFrustum)
+  {
+    return 0;
+  }
+  
+  float px = padding * (mWindowMax.x - mWindowMin.x);
+  float py = padding * (mWindowMax.y - mWindowMin.y);
+  
+  float xmin = mWindowMin.x - px;
+  float xmax = mWindowMax.x + px;
+  float ymin = mWindowMin.y - py;
+  float ymax = mWindowMax.y + py;
+  
+  // The camera looks down -z
+  if (mOrtho)
+  {
+    SetPlane(planes[0], 1.0f, 0.0f, 0.0f, -xmin);
+    SetPlane(planes[1], -1.0f, 0.0f, 0.0f, xmax);
+    SetPlane(planes[2], 0.0f, 1.0f, 0.0f, -ymin);
+    SetPlane(planes[3], 0.0f, -1.0f, 0.0f, ymax);
+  }
+  else
+  {
+    // x / -z in [xmin, xmax] * tan(fov / 2)
+    SetPlane(planes[0], 1.0f, 0.0f, xmin * mTanHalfFov, 0.0f);
+    SetPlane(planes[1], -1.0f, 0.0f, -xmax * mTanHalfFov, 0.0f);
+    SetPlane(planes[2], 0.0f, 1.0f, ymin * mTanHalfFov, 0.0f);
+    SetPlane(planes[3], 0.0f, -1.0f, -ymax * mTanHalfFov, 0.0f);
+  }
+  
+  SetPlane(planes[4], 0.0f, 0.0f, -1.0f, -mNear);
+  SetPlane(planes[5], 0.0f, 0.0f, 1.0f, mFar);
+  
+  return 6;
+}
+
+float PyProcCamera::screenSize(const AtPoint &center, float radius) const
+{
+  if (!mValid)
+  {
+    return 0.0f;
+  }
+  
+  float width = float(mXRes);
+  
+  if (mFrustum && mOrtho)
+  {
+    return width * 2.0f * radius / (mWindowMax.x - mWindowMin.x);
+  }
+  
+  float d = distance(center);
+  
+  if (d <= radius)
+  {
+    return width;
+  }
+  
+  // Other camera types are approximated with a 90 degrees field of view
+  float tanHalfFov = (mFrustum ? mTanHalfFov : 1.0f);
+  
+  // Angular size of the sphere, projected on the screen window
+  float s = radius / sqrtf(d * d - radius * radius);
+  
+  return width * 2.0f * s / (tanHalfFov * (mWindowMax.x - mWindowMin.x));
+}
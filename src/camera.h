@@ -0,0 +1,81 @@
+/*
+Copyright (c) 2016 Gaetan Guidet
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef __pyproc_camera_h__
+#define __pyproc_camera_h__
+
+#include <ai.h>
+
+// Render camera view used by the culling and level of detail code
+//
+// Reads options.camera (or the first camera node) at its first motion key
+// persp_camera and ortho_camera give a view frustum from their screen window, other
+//   camera types (fisheye, spherical...) only give a position
+
+class PyProcCamera
+{
+public:
+  
+  PyProcCamera();
+  
+  // Read a camera node, the render camera when null
+  // Returns false if there is no camera
+  bool setup(AtNode *camera=0);
+  
+  inline bool valid() const { return mValid; }
+  inline bool hasFrustum() const { return mFrustum; }
+  inline const AtPoint& position() const { return mPosition; }
+  inline const AtMatrix& worldToCamera() const { return mWorldToCamera; }
+  inline int xres() const { return mXRes; }
+  inline int yres() const { return mYRes; }
+  
+  // World space distance to the camera
+  float distance(const AtPoint &p) const;
+  
+  // Camera space frustum planes (a, b, c, d), a point p is inside when
+  //   a * p.x + b * p.y + c * p.z + d >= 0 for all planes
+  // The screen window is grown by 'padding' times its size on each side
+  // Planes are normalized so that the plane equation gives a distance
+  // Returns the plane count, 0 when the camera has no frustum
+  int frustum(float padding, float planes[6][4]) const;
+  
+  // Projected diameter in pixels of a world space sphere (along x)
+  // Spheres containing the camera return the image width
+  float screenSize(const AtPoint &center, float radius) const;
+  
+private:
+  
+  bool mValid;
+  bool mFrustum;
+  bool mOrtho;
+  AtPoint mPosition;
+  AtMatrix mWorldToCamera;
+  float mTanHalfFov;
+  AtPoint2 mWindowMin;
+  AtPoint2 mWindowMax;
+  float mNear;
+  float mFar;
+  int mXRes;
+  int mYRes;
+};
+
+#endif
@@ -0,0 +1,712 @@
+/*
+Copyright (c) 2016 Gaetan Guidet
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "cull.h"
+#include "camera.h"
+#include "lod.h"
+#include "array.h"
+#include "buffer.h"
+#include "threads.h"
+#include "simd.h"
+#include "random.h"
+#include <ai.h>
+#include <cmath>
+#include <cfloat>
+
+// ---
+
+PyProcCullSettings::PyProcCullSettings()
+  : radius(1.0f)
+  , radii(0)
+  , padding(0.0f)
+  , maxDistance(0.0f)
+  , falloff(0.0f)
+  , seed(0)
+  , frustum(true)
+  , transform(false)
+{
+  AiM4Identity(objectToWorld);
+}
+
+void PyProcCullSettings::setObjectToWorld(const AtMatrix &m)
+{
+  AtMatrix identity;
+  
+  AiM4Identity(identity);
+  AiM4Copy(objectToWorld, m);
+  
+  transform = false;
+  
+  for (int i=0; !transform && i<4; ++i)
+  {
+    for (int j=0; !transform && j<4; ++j)
+    {
+      transform = (m[i][j] != identity[i][j]);
+    }
+  }
+}
+
+// ---
+
+struct CullTask
+{
+  const float *data;
+  size_t stride;
+  bool matrices;
+  const float *radii;
+  float radius;
+  bool transform;
+  AtMatrix objectToWorld;
+  float objectScale;
+  AtMatrix worldToCamera;
+  AtPoint position;
+  int nplanes;
+  float planes[6][4];
+  float maxDistance;
+  unsigned char *keep;
+  float *distances;
+};
+
+// World space bounding sphere of instance i
+static inline void Sphere(const CullTask *task, size_t i, float &x, float &y, float &z, float &r)
+{
+  const float *d = task->data + i * task->stride;
+  
+  r = (task->radii ? task->radii[i] : task->radius);
+  
+  if (task->matrices)
+  {
+    float s0 = d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+    float s1 = d[4] * d[4] + d[5] * d[5] + d[6] * d[6];
+    float s2 = d[8] * d[8] + d[9] * d[9] + d[10] * d[10];
+    
+    if (s1 > s0) s0 = s1;
+    if (s2 > s0) s0 = s2;
+    
+    r *= sqrtf(s0);
+    
+    d += 12;
+  }
+  
+  x = d[0];
+  y = d[1];
+  z = d[2];
+  
+  if (task->transform)
+  {
+    const AtMatrix &m = task->objectToWorld;
+    
+    float wx = x * m[0][0] + y * m[1][0] + z * m[2][0] + m[3][0];
+    float wy = x * m[0][1] + y * m[1][1] + z * m[2][1] + m[3][1];
+    float wz = x * m[0][2] + y * m[1][2] + z * m[2][2] + m[3][2];
+    
+    x = wx;
+    y = wy;
+    z = wz;
+    r *= task->objectScale;
+  }
+}
+
+static void CullScalar(const CullTask *task, size_t begin, size_t end)
+{
+  const AtMatrix &m = task->worldToCamera;
+  
+  for (size_t i=begin; i<end; ++i)
+  {
+    float x, y, z, r;
+    
+    Sphere(task, i, x, y, z, r);
+    
+    float cx = x * m[0][0] + y * m[1][0] + z * m[2][0] + m[3][0];
+    float cy = x * m[0][1] + y * m[1][1] + z * m[2][1] + m[3][1];
+    float cz = x * m[0][2] + y * m[1][2] + z * m[2][2] + m[3][2];
+    
+    bool in = true;
+    
+    for (int p=0; in && p<task->nplanes; ++p)
+    {
+      const float *pl = task->planes[p];
+      
+      in = (pl[0] * cx + pl[1] * cy + pl[2] * cz + pl[3] >= -r);
+    }
+    
+    float dx = x - task->position.x;
+    float dy = y - task->position.y;
+    float dz = z - task->position.z;
+    
+    float d = sqrtf(dx * dx + dy * dy + dz * dz);
+    
+    if (task->maxDistance > 0.0f && d - r > task->maxDistance)
+    {
+      in = false;
+    }
+    
+    task->keep[i] = (in ? 1 : 0);
+    task->distances[i] = d;
+  }
+}
+
+#ifdef PYPROC_SSE
+
+// 4 spheres per iteration, gathered then transformed and tested in registers
+// Sums are evaluated left to right like in CullScalar so that all levels keep the same
+//   instances for the same input
+static void CullSSE(const CullTask *task, size_t begin, size_t end)
+{
+  const AtMatrix &m = task->worldToCamera;
+  
+  __m128 m00 = _mm_set1_ps(m[0][0]), m10 = _mm_set1_ps(m[1][0]), m20 = _mm_set1_ps(m[2][0]), m30 = _mm_set1_ps(m[3][0]);
+  __m128 m01 = _mm_set1_ps(m[0][1]), m11 = _mm_set1_ps(m[1][1]), m21 = _mm_set1_ps(m[2][1]), m31 = _mm_set1_ps(m[3][1]);
+  __m128 m02 = _mm_set1_ps(m[0][2]), m12 = _mm_set1_ps(m[1][2]), m22 = _mm_set1_ps(m[2][2]), m32 = _mm_set1_ps(m[3][2]);
+  __m128 px = _mm_set1_ps(task->position.x);
+  __m128 py = _mm_set1_ps(task->position.y);
+  __m128 pz = _mm_set1_ps(task->position.z);
+  __m128 maxd = _mm_set1_ps(task->maxDistance > 0.0f ? task->maxDistance : FLT_MAX);
+  __m128 zero = _mm_setzero_ps();
+  
+  size_t i = begin;
+  
+  for (; i+4<=end; i+=4)
+  {
+    float sx[4], sy[4], sz[4], sr[4];
+    
+    for (size_t k=0; k<4; ++k)
+    {
+      Sphere(task, i + k, sx[k], sy[k], sz[k], sr[k]);
+    }
+    
+    __m128 x = _mm_loadu_ps(sx);
+    __m128 y = _mm_loadu_ps(sy);
+    __m128 z = _mm_loadu_ps(sz);
+    __m128 r = _mm_loadu_ps(sr);
+    __m128 nr = _mm_sub_ps(zero, r);
+    
+    __m128 cx = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, m00), _mm_mul_ps(y, m10)), _mm_mul_ps(z, m20)), m30);
+    __m128 cy = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, m01), _mm_mul_ps(y, m11)), _mm_mul_ps(z, m21)), m31);
+    __m128 cz = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, m02), _mm_mul_ps(y, m12)), _mm_mul_ps(z, m22)), m32);
+    
+    __m128 dx = _mm_sub_ps(x, px);
+    __m128 dy = _mm_sub_ps(y, py);
+    __m128 dz = _mm_sub_ps(z, pz);
+    __m128 d = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+    
+    __m128 in = _mm_cmple_ps(_mm_sub_ps(d, r), maxd);
+    
+    for (int p=0; p<task->nplanes; ++p)
+    {
+      const float *pl = task->planes[p];
+      
+      __m128 s = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, _mm_set1_ps(pl[0])), _mm_mul_ps(cy, _mm_set1_ps(pl[1]))),
+                                       _mm_mul_ps(cz, _mm_set1_ps(pl[2]))), _mm_set1_ps(pl[3]));
+      
+      in = _mm_and_ps(in, _mm_cmpge_ps(s, nr));
+    }
+    
+    _mm_storeu_ps(task->distances + i, d);
+    
+    int mask = _mm_movemask_ps(in);
+    
+    for (size_t k=0; k<4; ++k)
+    {
+      task->keep[i + k] = (unsigned char)((mask >> k) & 1);
+    }
+  }
+  
+  CullScalar(task, i, end);
+}
+
+#endif
+
+#ifdef PYPROC_AVX
+
+// 8 spheres per iteration, same as CullSSE
+static PYPROC_AVX_FUNC void CullAVX(const CullTask *task, size_t begin, size_t end)
+{
+  const AtMatrix &m = task->worldToCamera;
+  
+  __m256 m00 = _mm256_set1_ps(m[0][0]), m10 = _mm256_set1_ps(m[1][0]), m20 = _mm256_set1_ps(m[2][0]), m30 = _mm256_set1_ps(m[3][0]);
+  __m256 m01 = _mm256_set1_ps(m[0][1]), m11 = _mm256_set1_ps(m[1][1]), m21 = _mm256_set1_ps(m[2][1]), m31 = _mm256_set1_ps(m[3][1]);
+  __m256 m02 = _mm256_set1_ps(m[0][2]), m12 = _mm256_set1_ps(m[1][2]), m22 = _mm256_set1_ps(m[2][2]), m32 = _mm256_set1_ps(m[3][2]);
+  __m256 px = _mm256_set1_ps(task->position.x);
+  __m256 py = _mm256_set1_ps(task->position.y);
+  __m256 pz = _mm256_set1_ps(task->position.z);
+  __m256 maxd = _mm256_set1_ps(task->maxDistance > 0.0f ? task->maxDistance : FLT_MAX);
+  __m256 zero = _mm256_setzero_ps();
+  
+  size_t i = begin;
+  
+  for (; i+8<=end; i+=8)
+  {
+    float sx[8], sy[8], sz[8], sr[8];
+    
+    for (size_t k=0; k<8; ++k)
+    {
+      Sphere(task, i + k, sx[k], sy[k], sz[k], sr[k]);
+    }
+    
+    __m256 x = _mm256_loadu_ps(sx);
+    __m256 y = _mm256_loadu_ps(sy);
+    __m256 z = _mm256_loadu_ps(sz);
+    __m256 r = _mm256_loadu_ps(sr);
+    __m256 nr = _mm256_sub_ps(zero, r);
+    
+    __m256 cx = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, m00), _mm256_mul_ps(y, m10)), _mm256_mul_ps(z, m20)), m30);
+    __m256 cy = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, m01), _mm256_mul_ps(y, m11)), _mm256_mul_ps(z, m21)), m31);
+    __m256 cz = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, m02), _mm256_mul_ps(y, m12)), _mm256_mul_ps(z, m22)), m32);
+    
+    __m256 dx = _mm256_sub_ps(x, px);
+    __m256 dy = _mm256_sub_ps(y, py);
+    __m256 dz = _mm256_sub_ps(z, pz);
+    __m256 d = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz)));
+    
+    __m256 in = _mm256_cmp_ps(_mm256_sub_ps(d, r), maxd, _CMP_LE_OQ);
+    
+    for (int p=0; p<task->nplanes; ++p)
+    {
+      const float *pl = task->planes[p];
+      
+      __m256 s = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(cx, _mm256_set1_ps(pl[0])), _mm256_mul_ps(cy, _mm256_set1_ps(pl[1]))),
+                                             _mm256_mul_ps(cz, _mm256_set1_ps(pl[2]))), _mm256_set1_ps(pl[3]));
+      
+      in = _mm256_and_ps(in, _mm256_cmp_ps(s, nr, _CMP_GE_OQ));
+    }
+    
+    _mm256_storeu_ps(task->distances + i, d);
+    
+    int mask = _mm256_movemask_ps(in);
+    
+    for (size_t k=0; k<8; ++k)
+    {
+      task->keep[i + k] = (unsigned char)((mask >> k) & 1);
+    }
+  }
+  
+  CullSSE(task, i, end);
+}
+
+#endif
+
+static void CullRange(size_t begin, size_t end, void *data)
+{
+  const CullTask *task = (const CullTask*) data;
+  
+  switch (PyProcSimdLevel())
+  {
+#ifdef PYPROC_AVX
+  case PyProcSimdAVX:
+    CullAVX(task, begin, end);
+    break;
+#endif
+#ifdef PYPROC_SSE
+  case PyProcSimdSSE:
+    CullSSE(task, begin, end);
+    break;
+#endif
+  default:
+    CullScalar(task, begin, end);
+  }
+}
+
+void PyProcCull(const PyProcCamera &camera, const PyProcCullSettings &settings,
+                const float *data, size_t count, size_t stride, bool matrices,
+                std::vector<unsigned int> &kept, std::vector<float> *distances)
+{
+  kept.clear();
+  
+  if (distances)
+  {
+    distances->clear();
+  }
+  
+  if (count == 0)
+  {
+    return;
+  }
+  
+  if (!camera.valid())
+  {
+    // Nothing to cull against
+    kept.resize(count);
+    
+    for (size_t i=0; i<count; ++i)
+    {
+      kept[i] = (unsigned int) i;
+    }
+    
+    if (distances)
+    {
+      distances->assign(count, 0.0f);
+    }
+    
+    return;
+  }
+  
+  std::vector<unsigned char> keep(count);
+  std::vector<float> dist(count);
+  
+  CullTask task;
+  
+  task.data = data;
+  task.stride = stride;
+  task.matrices = matrices;
+  task.radii = settings.radii;
+  task.radius = settings.radius;
+  task.transform = settings.transform;
+  AiM4Copy(task.objectToWorld, settings.objectToWorld);
+  task.objectScale = 1.0f;
+  AiM4Copy(task.worldToCamera, camera.worldToCamera());
+  
+  if (task.transform)
+  {
+    float s0 = 0.0f;
+    
+    for (int i=0; i<3; ++i)
+    {
+      const float *row = settings.objectToWorld[i];
+      float s = row[0] * row[0] + row[1] * row[1] + row[2] * row[2];
+      
+      if (s > s0)
+      {
+        s0 = s;
+      }
+    }
+    
+    task.objectScale = sqrtf(s0);
+  }
+  task.position = camera.position();
+  task.nplanes = (settings.frustum ? camera.frustum(settings.padding, task.planes) : 0);
+  task.maxDistance = settings.maxDistance;
+  task.keep = &keep[0];
+  task.distances = &dist[0];
+  
+  PyProcParallelFor(count, 4096, CullRange, &task);
+  
+  for (size_t i=0; i<count; ++i)
+  {
+    if (!keep[i])
+    {
+      continue;
+    }
+    
+    if (settings.falloff > 0.0f && dist[i] > settings.falloff)
+    {
+      float f = settings.falloff / dist[i];
+      
+      // Dimension 3, scatter draws 0 to 2 so the same seed doesn't correlate them
+      if (PyProcRandom(settings.seed, i, 3) >= double(f * f))
+      {
+        continue;
+      }
+    }
+    
+    kept.push_back((unsigned int) i);
+    
+    if (distances)
+    {
+      distances->push_back(dist[i]);
+    }
+  }
+}
+
+// Keyword flags left unset keep their default, a failing truth test raises
+
+static bool PyProcCullParseFlag(PyObject *obj, bool defaultValue, bool &flag)
+{
+  if (!obj)
+  {
+    flag = defaultValue;
+    return true;
+  }
+  
+  int rv = PyObject_IsTrue(obj);
+  
+  if (rv == -1)
+  {
+    return false;
+  }
+  
+  flag = (rv == 1);
+  
+  return true;
+}
+
+bool PyProcCullParseObjectToWorld(PyObject *obj, PyProcCullSettings &settings)
+{
+  if (!obj || obj == Py_None)
+  {
+    const PyProcLod *lod = PyProcLod::Current();
+    
+    if (lod)
+    {
+      settings.setObjectToWorld(lod->objectToWorld());
+    }
+    
+    return true;
+  }
+  
+  PyProcBuffer buffer;
+  
+  if (!buffer.acquire(obj))
+  {
+    if (!PyErr_Occurred())
+    {
+      PyErr_SetString(PyExc_TypeError, "'object_to_world' must support the buffer protocol");
+    }
+    return false;
+  }
+  
+  if (buffer.count() != 16)
+  {
+    PyErr_Format(PyExc_ValueError, "'object_to_world' holds %lu value(s), expected 16", (unsigned long) buffer.count());
+    return false;
+  }
+  
+  std::vector<float> tmp;
+  
+  const float *data = buffer.floats(tmp);
+  
+  if (!data)
+  {
+    if (!PyErr_Occurred())
+    {
+      PyErr_SetString(PyExc_TypeError, "'object_to_world' must hold numbers");
+    }
+    return false;
+  }
+  
+  AtMatrix m;
+  
+  for (int i=0; i<4; ++i)
+  {
+    for (int j=0; j<4; ++j)
+    {
+      m[i][j] = data[i * 4 + j];
+    }
+  }
+  
+  settings.setObjectToWorld(m);
+  
+  return true;
+}
+
+bool PyProcCullParse(PyObject *obj, PyProcCullSettings &settings)
+{
+  if (obj == Py_True)
+  {
+    return PyProcCullParseObjectToWorld(0, settings);
+  }
+  
+  if (!PyDict_Check(obj))
+  {
+    PyErr_SetString(PyExc_TypeError, "Cull settings must be True or a dict of pyproc.cull keyword arguments");
+    return false;
+  }
+  
+  static char *kwlist[] = {(char*)"radius", (char*)"padding", (char*)"max_distance", (char*)"falloff",
+                           (char*)"seed", (char*)"frustum", (char*)"object_to_world", NULL};
+  
+  PyObject *args = PyTuple_New(0);
+  PyObject *frustum = 0;
+  PyObject *objectToWorld = 0;
+  
+  bool rv = (PyArg_ParseTupleAndKeywords(args, obj, "|ffffKOO", kwlist, &settings.radius, &settings.padding,
+                                         &settings.maxDistance, &settings.falloff, &settings.seed, &frustum,
+                                         &objectToWorld) != 0);
+  
+  Py_DECREF(args);
+  
+  return (rv && PyProcCullParseFlag(frustum, settings.frustum, settings.frustum) &&
+          PyProcCullParseObjectToWorld(objectToWorld, settings));
+}
+
+// ---
+
+static PyObject* PyProc_Cull(PyObject *, PyObject *args, PyObject *kwargs)
+{
+  static char *kwlist[] = {(char*)"centers", (char*)"radius", (char*)"padding", (char*)"max_distance",
+                           (char*)"falloff", (char*)"seed", (char*)"frustum", (char*)"matrices",
+                           (char*)"keys", (char*)"radii", (char*)"distances", (char*)"object_to_world", NULL};
+  
+  PyProcCullSettings settings;
+  
+  PyObject *pycenters = 0;
+  PyObject *pyfrustum = 0;
+  PyObject *pymatrices = 0;
+  int keys = 1;
+  PyObject *pyradii = 0;
+  PyObject *pydistances = 0;
+  PyObject *pyobjectToWorld = 0;
+  
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|ffffKOOiOOO", kwlist, &pycenters, &settings.radius,
+                                   &settings.padding, &settings.maxDistance, &settings.falloff, &settings.seed,
+                                   &pyfrustum, &pymatrices, &keys, &pyradii, &pydistances, &pyobjectToWorld))
+  {
+    return NULL;
+  }
+  
+  if (!PyProcCullParseObjectToWorld(pyobjectToWorld, settings))
+  {
+    return NULL;
+  }
+  
+  bool matrices = false;
+  bool withDistances = false;
+  
+  if (!PyProcCullParseFlag(pyfrustum, true, settings.frustum) ||
+      !PyProcCullParseFlag(pymatrices, false, matrices) ||
+      !PyProcCullParseFlag(pydistances, false, withDistances))
+  {
+    return NULL;
+  }
+  
+  if (keys <= 0 || keys > 255)
+  {
+    PyErr_SetString(PyExc_ValueError, "Invalid motion key count");
+    return NULL;
+  }
+  
+  PyProcBuffer centers;
+  PyProcBuffer radii;
+  
+  if (!centers.acquire(pycenters))
+  {
+    if (!PyErr_Occurred())
+    {
+      PyErr_SetString(PyExc_TypeError, "'centers' must support the buffer protocol");
+    }
+    return NULL;
+  }
+  
+  if (!centers.isNumeric())
+  {
+    PyErr_SetString(PyExc_TypeError, "'centers' must hold numbers");
+    return NULL;
+  }
+  
+  size_t stride = (matrices ? 16 * size_t(keys) : 3);
+  
+  if (centers.count() % stride != 0)
+  {
+    PyErr_Format(PyExc_ValueError, "'centers' holds %lu scalar(s), not a multiple of %lu",
+                 (unsigned long) centers.count(), (unsigned long) stride);
+    return NULL;
+  }
+  
+  size_t count = centers.count() / stride;
+  
+  if (pyradii && pyradii != Py_None)
+  {
+    if (!radii.acquire(pyradii))
+    {
+      if (!PyErr_Occurred())
+      {
+        PyErr_SetString(PyExc_TypeError, "'radii' must support the buffer protocol");
+      }
+      return NULL;
+    }
+    
+    if (!radii.isNumeric())
+    {
+      PyErr_SetString(PyExc_TypeError, "'radii' must hold numbers");
+      return NULL;
+    }
+    
+    if (radii.count() != count)
+    {
+      PyErr_Format(PyExc_ValueError, "'radii' holds %lu value(s), expected %lu",
+                   (unsigned long) radii.count(), (unsigned long) count);
+      return NULL;
+    }
+  }
+  
+  PyProcCamera camera;
+  
+  if (!camera.setup())
+  {
+    AiMsgWarning("[pyproc] cull: No render camera, keeping all instances");
+  }
+  
+  std::vector<unsigned int> kept;
+  std::vector<float> distances;
+  std::vector<float> tmpCenters;
+  std::vector<float> tmpRadii;
+  
+  Py_BEGIN_ALLOW_THREADS
+  
+  const float *data = centers.floats(tmpCenters);
+  
+  settings.radii = (radii.valid() ? radii.floats(tmpRadii) : 0);
+  
+  if (data)
+  {
+    PyProcCull(camera, settings, data, count, stride, matrices, kept, (withDistances ? &distances : 0));
+  }
+  
+  Py_END_ALLOW_THREADS
+  
+  AtArray *kary = AiArrayConvert((AtUInt32) kept.size(), 1, AI_TYPE_UINT, (kept.empty() ? 0 : &kept[0]));
+  
+  PyObject *pykept = PyProcArrayWrap(kary);
+  
+  if (!pykept || !withDistances)
+  {
+    return pykept;
+  }
+  
+  AtArray *dary = AiArrayConvert((AtUInt32) distances.size(), 1, AI_TYPE_FLOAT, (distances.empty() ? 0 : &distances[0]));
+  
+  PyObject *pydist = PyProcArrayWrap(dary);
+  
+  if (!pydist)
+  {
+    Py_DECREF(pykept);
+    return NULL;
+  }
+  
+  PyObject *rt = PyTuple_New(2);
+  
+  PyTuple_SetItem(rt, 0, pykept);
+  PyTuple_SetItem(rt, 1, pydist);
+  
+  return rt;
+}
+
+static PyMethodDef gsCullMethods[] =
+{
+  {"cull", (PyCFunction)PyProc_Cull, METH_VARARGS | METH_KEYWORDS, "cull(centers, radius=1.0, padding=0.0, max_distance=0.0, falloff=0.0, seed=0, frustum=True, matrices=False, keys=1, radii=None, distances=False, object_to_world=None)"},
+  {NULL, NULL, 0, NULL}
+};
+
+bool PyProcCullInit(PyObject *mod)
+{
+  for (PyMethodDef *def = gsCullMethods; def->ml_name; ++def)
+  {
+    PyObject *func = PyCFunction_New(def, NULL);
+    
+    if (!func || PyModule_AddObject(mod, def->ml_name, func) != 0)
+    {
+      return false;
+    }
+  }
+  
+  return true;
+}
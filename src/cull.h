@@ -0,0 +1,97 @@
+/*
+Copyright (c) 2016 Gaetan Guidet
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef __pyproc_cull_h__
+#define __pyproc_cull_h__
+
+#include <Python.h>
+#include <ai.h>
+#include <vector>
+#include <cstddef>
+
+class PyProcCamera;
+
+// Render camera based instance culling
+//
+// pyproc.cull(centers, radius=1.0, padding=0.0, max_distance=0.0, falloff=0.0, seed=0,
+//             frustum=True, matrices=False, keys=1, radii=None, distances=False,
+//             object_to_world=None)
+//   Indices of the instances to keep as a 'uint' pyproc.Array, with their world space
+//   camera distances as a 'float' pyproc.Array when 'distances' is set
+//   centers  : buffer of 3 floats per instance, or of keys * 16 floats per instance
+//              when 'matrices' is set (first key translation, radius scaled by the
+//              largest axis scale), in object space
+//   radius   : bounding sphere radius, 'radii' gives one per instance instead
+//   object_to_world: 16 floats transforming 'centers' to world space, defaults to the
+//              matrix of the procedural being expanded as nodes it creates inherit
+//              its transform (see lod.h), world space outside of any procedural
+//   padding  : frustum growth as a fraction of the screen window on each side, keeps
+//              instances just off screen for reflections and shadows
+//   max_distance: drop instances further than this from the camera (0 disables)
+//   falloff  : beyond this distance instances are thinned with a keep probability of
+//              (falloff / distance)^2, keeping a constant density on screen
+//              (0 disables), the choice is seeded and stable per instance index
+//   frustum  : cull instances outside the camera view
+//
+// pyproc.instance(..., cull=None) takes the same settings as a dict (or True for the
+//   defaults) and only creates the kept instances
+//
+// The camera is options.camera, see camera.h
+
+struct PyProcCullSettings
+{
+  float radius;
+  const float *radii;
+  float padding;
+  float maxDistance;
+  float falloff;
+  unsigned long long seed;
+  bool frustum;
+  bool transform;
+  AtMatrix objectToWorld;
+  
+  PyProcCullSettings();
+  
+  // Non-identity matrices enable 'transform'
+  void setObjectToWorld(const AtMatrix &m);
+};
+
+// Fill settings from a dict of the pyproc.cull keyword arguments (or True), GIL must be held
+// Sets a python exception on failure
+bool PyProcCullParse(PyObject *obj, PyProcCullSettings &settings);
+
+// Set the object to world matrix from a 16 floats buffer, or from the current procedural
+//   when null or None, GIL must be held
+// Sets a python exception on failure
+bool PyProcCullParseObjectToWorld(PyObject *obj, PyProcCullSettings &settings);
+
+// Indices of the instances to keep, 'data' holds 'count' items of 'stride' floats,
+//   points (stride 3) or matrices (stride 16 * keys), transformed by 'objectToWorld'
+//   when 'transform' is set
+// Doesn't need the GIL, runs over threads
+void PyProcCull(const PyProcCamera &camera, const PyProcCullSettings &settings,
+                const float *data, size_t count, size_t stride, bool matrices,
+                std::vector<unsigned int> &kept, std::vector<float> *distances=0);
+
+bool PyProcCullInit(PyObject *mod);
+
+#endif
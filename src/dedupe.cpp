@@ -0,0 +1,370 @@
+/*
+Copyright (c) 2016 Gaetan Guidet
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "dedupe.h"
+#include "nodes.h"
+#include "threads.h"
+#include <map>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+
+// ---
+
+struct DedupeEntry
+{
+  AtNode *node;
+  std::string name;
+  std::string nodeType;
+};
+
+typedef std::multimap<unsigned long long, DedupeEntry> DedupeIndex;
+
+// Allocated on first use and leaked, the library may be unloaded after statics
+//   are destroyed
+static DedupeIndex *gsIndex = 0;
+static AtCritSec gsLock;
+static bool gsLockInit = false;
+static unsigned long gsShapes = 0;
+static unsigned long gsHits = 0;
+static unsigned long long gsBytesSaved = 0;
+
+static const unsigned long long gsPrime1 = 0x9E3779B97F4A7C15ULL;
+static const unsigned long long gsPrime2 = 0xC2B2AE3D27D4EB4FULL;
+
+static unsigned long long HashBytes(const char *data, size_t n, unsigned long long h)
+{
+  size_t nwords = n / 8;
+  
+  for (size_t i=0; i<nwords; ++i)
+  {
+    unsigned long long w;
+    memcpy(&w, data + i * 8, 8);
+    h ^= w * gsPrime1;
+    h = ((h << 31) | (h >> 33)) * gsPrime2;
+  }
+  
+  for (size_t i=nwords*8; i<n; ++i)
+  {
+    h ^= (unsigned long long)(unsigned char)data[i] * gsPrime1;
+    h = ((h << 31) | (h >> 33)) * gsPrime2;
+  }
+  
+  return h;
+}
+
+static const size_t gsChunkSize = 1 << 20;
+
+struct HashTask
+{
+  const char *data;
+  size_t bytes;
+  std::vector<unsigned long long> *hashes;
+};
+
+static void HashChunks(size_t begin, size_t end, void *data)
+{
+  HashTask *task = (HashTask*) data;
+  
+  for (size_t i=begin; i<end; ++i)
+  {
+    size_t offset = i * gsChunkSize;
+    size_t n = (offset + gsChunkSize > task->bytes ? task->bytes - offset : gsChunkSize);
+    (*task->hashes)[i] = HashBytes(task->data + offset, n, gsPrime1 ^ i);
+  }
+}
+
+static size_t ArrayBytes(const AtArray *ary)
+{
+  return size_t(ary->nelements) * ary->nkeys * AiParamGetTypeSize(ary->type);
+}
+
+// Large arrays are hashed in 1MB chunks on all threads
+static unsigned long long HashArray(const AtArray *ary, unsigned long long h)
+{
+  size_t bytes = ArrayBytes(ary);
+  
+  unsigned int header[3] = {ary->nelements, ary->nkeys, ary->type};
+  
+  h = HashBytes((const char*) header, sizeof(header), h);
+  
+  if (bytes <= gsChunkSize)
+  {
+    return HashBytes((const char*) ary->data, bytes, h);
+  }
+  
+  size_t nchunks = (bytes + gsChunkSize - 1) / gsChunkSize;
+  
+  std::vector<unsigned long long> hashes(nchunks, 0);
+  
+  HashTask task = {(const char*) ary->data, bytes, &hashes};
+  
+  PyProcParallelFor(nchunks, 1, HashChunks, &task);
+  
+  return HashBytes((const char*) &hashes[0], nchunks * sizeof(unsigned long long), h);
+}
+
+// ---
+
+PyProcDedupe::PyProcDedupe(const char *nodeType)
+  : mNodeType(nodeType), mHash(0), mBytes(0)
+{
+}
+
+void PyProcDedupe::add(const char *param, AtArray *ary)
+{
+  if (ary)
+  {
+    Param p;
+    p.name = param;
+    p.array = ary;
+    mParams.push_back(p);
+  }
+}
+
+void PyProcDedupe::add(const char *param, const std::string &value)
+{
+  Param p;
+  p.name = param;
+  p.array = 0;
+  p.value = value;
+  mParams.push_back(p);
+}
+
+AtNode* PyProcDedupe::find()
+{
+  unsigned long long h = HashBytes(mNodeType.c_str(), mNodeType.length(), gsPrime2);
+  
+  mBytes = 0;
+  
+  for (size_t i=0; i<mParams.size(); ++i)
+  {
+    const Param &p = mParams[i];
+    
+    h = HashBytes(p.name.c_str(), p.name.length() + 1, h);
+    
+    if (p.array)
+    {
+      h = HashArray(p.array, h);
+      mBytes += ArrayBytes(p.array);
+    }
+    else
+    {
+      h = HashBytes(p.value.c_str(), p.value.length() + 1, h);
+    }
+  }
+  
+  mHash = h;
+  
+  std::vector<AtNode*> candidates;
+  
+  AiCritSecEnter(&gsLock);
+  
+  if (gsIndex)
+  {
+    std::pair<DedupeIndex::iterator, DedupeIndex::iterator> range = gsIndex->equal_range(mHash);
+    
+    DedupeIndex::iterator it = range.first;
+    
+    while (it != range.second)
+    {
+      // Shapes of a previous universe (AiEnd/AiBegin in the same process) are gone
+      if (AiNodeLookUpByName(it->second.name.c_str()) != it->second.node)
+      {
+        gsIndex->erase(it++);
+        continue;
+      }
+      
+      if (it->second.nodeType == mNodeType)
+      {
+        candidates.push_back(it->second.node);
+      }
+      
+      ++it;
+    }
+  }
+  
+  AiCritSecLeave(&gsLock);
+  
+  // Verify outside of the lock, indexed shapes are never modified by pyproc
+  for (size_t i=0; i<candidates.size(); ++i)
+  {
+    AtNode *node = candidates[i];
+    
+    bool same = true;
+    
+    for (size_t j=0; same && j<mParams.size(); ++j)
+    {
+      const Param &p = mParams[j];
+      
+      if (p.array)
+      {
+        const AtArray *other = AiNodeGetArray(node, p.name.c_str());
+        
+        same = (other != 0 &&
+                other->nelements == p.array->nelements &&
+                other->nkeys == p.array->nkeys &&
+                other->type == p.array->type &&
+                memcmp(other->data, p.array->data, ArrayBytes(p.array)) == 0);
+      }
+      else
+      {
+        same = (p.value == AiNodeGetStr(node, p.name.c_str()));
+      }
+    }
+    
+    if (same)
+    {
+      return node;
+    }
+  }
+  
+  return 0;
+}
+
+void PyProcDedupe::insert(AtNode *node)
+{
+  DedupeEntry entry;
+  
+  entry.node = node;
+  entry.name = AiNodeGetName(node);
+  entry.nodeType = mNodeType;
+  
+  AiCritSecEnter(&gsLock);
+  
+  if (!gsIndex)
+  {
+    gsIndex = new DedupeIndex();
+  }
+  
+  gsIndex->insert(std::make_pair(mHash, entry));
+  
+  ++gsShapes;
+  
+  AiCritSecLeave(&gsLock);
+}
+
+AtNode* PyProcDedupe::instance(AtNode *source, const std::string &name)
+{
+  AtNode *node = AiNode("ginstance");
+  
+  if (node)
+  {
+    AiNodeSetStr(node, "name", name.c_str());
+    AiNodeSetPtr(node, "node", source);
+    AiNodeSetBool(node, "inherit_xform", false);
+    
+    AiCritSecEnter(&gsLock);
+    
+    ++gsHits;
+    gsBytesSaved += mBytes;
+    
+    AiCritSecLeave(&gsLock);
+  }
+  
+  return node;
+}
+
+bool PyProcDedupe::Enabled(PyObject *flag)
+{
+  if (flag && flag != Py_None)
+  {
+    return (PyObject_IsTrue(flag) == 1);
+  }
+  
+  static int sDefault = -1;
+  
+  if (sDefault == -1)
+  {
+    const char *env = getenv("PYPROC_DEDUPE");
+    sDefault = ((env && atoi(env) != 0) ? 1 : 0);
+  }
+  
+  return (sDefault == 1);
+}
+
+// ---
+
+static PyObject* PyProc_DedupeStats(PyObject *, PyObject *)
+{
+  AiCritSecEnter(&gsLock);
+  
+  PyObject *stats = Py_BuildValue("{s:k,s:k,s:K}", "shapes", gsShapes, "hits", gsHits, "bytes_saved", gsBytesSaved);
+  
+  AiCritSecLeave(&gsLock);
+  
+  return stats;
+}
+
+static PyMethodDef gsDedupeMethods[] =
+{
+  {"dedupestats", (PyCFunction)PyProc_DedupeStats, METH_NOARGS, "dedupestats()"},
+  {NULL, NULL, 0, NULL}
+};
+
+bool PyProcDedupeInit(PyObject *mod)
+{
+  if (!gsLockInit)
+  {
+    AiCritSecInit(&gsLock);
+    gsLockInit = true;
+  }
+  
+  for (PyMethodDef *def = gsDedupeMethods; def->ml_name; ++def)
+  {
+    PyObject *func = PyCFunction_New(def, NULL);
+    
+    if (!func || PyModule_AddObject(mod, def->ml_name, func) != 0)
+    {
+      return false;
+    }
+  }
+  
+  return true;
+}
+
+void PyProcDedupeCleanup()
+{
+  if (!gsLockInit)
+  {
+    return;
+  }
+  
+  AiCritSecEnter(&gsLock);
+  
+  if (gsShapes > 0)
+  {
+    AiMsgInfo("[pyproc] Geometry dedupe: %lu shape(s), %lu duplicate(s) instanced, %.2f MB saved",
+              gsShapes, gsHits, double(gsBytesSaved) / (1024.0 * 1024.0));
+  }
+  
+  if (gsIndex)
+  {
+    gsIndex->clear();
+  }
+  
+  gsShapes = 0;
+  gsHits = 0;
+  gsBytesSaved = 0;
+  
+  AiCritSecLeave(&gsLock);
+}
@@ -0,0 +1,94 @@
+/*
+Copyright (c) 2016 Gaetan Guidet
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef __pyproc_dedupe_h__
+#define __pyproc_dedupe_h__
+
+#include <Python.h>
+#include <ai.h>
+#include <string>
+#include <vector>
+
+// Content addressed geometry deduplication for the native builders
+//
+// Shapes are keyed by a hash of their node type, arrays and settings, the first
+//   shape built with a given content is kept in a process wide index and later
+//   identical shapes are replaced by a ginstance of it (inherit_xform off), named
+//   and returned as the shape would have been
+// Matches are verified byte for byte, hash collisions never alias geometry
+// Indexed shapes are looked up by name before use, shapes of an ended universe are
+//   dropped from the index
+//
+// The key only covers the geometry, builders may return a ginstance: parameters set
+//   on it afterwards (shader, subdivision, displacement...) don't reach the shared
+//   shape, which keeps those of the first shape built
+//
+// Builders take a 'dedupe' argument, PYPROC_DEDUPE=1 enables it by default
+//
+// pyproc.dedupestats()
+//   {'shapes': n, 'hits': n, 'bytes_saved': n}
+//   Also logged when pyproc shuts down
+
+class PyProcDedupe
+{
+public:
+  
+  // Node parameters describing the shape, arrays are not owned
+  PyProcDedupe(const char *nodeType);
+  
+  void add(const char *param, AtArray *ary);
+  void add(const char *param, const std::string &value);
+  
+  // Hash and look up an identical shape, doesn't need the GIL
+  AtNode* find();
+  
+  // Register a newly created shape
+  void insert(AtNode *node);
+  
+  // Create a ginstance of a shape returned by find()
+  AtNode* instance(AtNode *source, const std::string &name);
+  
+  // Is deduplication requested, 'flag' is the builder argument (may be null or None)
+  static bool Enabled(PyObject *flag);
+  
+private:
+  
+  struct Param
+  {
+    std::string name;
+    AtArray *array;
+    std::string value;
+  };
+  
+  std::string mNodeType;
+  std::vector<Param> mParams;
+  unsigned long long mHash;
+  size_t mBytes;
+};
+
+// Setup the index lock and register pyproc.dedupestats(), GIL must be held
+bool PyProcDedupeInit(PyObject *mod);
+
+// Log statistics and forget indexed shapes
+void PyProcDedupeCleanup();
+
+#endif
@@ -0,0 +1,739 @@
+/*
+Copyright (c) 2016 Gaetan Guidet
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "geometry.h"
+#include "array.h"
+#include "buffer.h"
+#include "nodes.h"
+#include "names.h"
+#include "dedupe.h"
+#include <ai.h>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdio>
+
+// ---
+
+// One array valued shape input
+// set() is called with the GIL held, build() without, finish() with
+class Input
+{
+public:
+  
+  Input(const char *param, const char *arg, int type, unsigned int keys=1)
+    : mParam(param), mArg(arg), mType(type), mKeys(keys), mObject(0), mAdopt(false), mArray(0)
+  {
+  }
+  
+  ~Input()
+  {
+    if (mArray && !mAdopt)
+    {
+      AiArrayDestroy(mArray);
+    }
+  }
+  
+  // Unset (None) inputs are skipped, unless required
+  bool set(PyObject *obj, bool required=false)
+  {
+    if (obj == 0 || obj == Py_None)
+    {
+      if (required)
+      {
+        PyErr_Format(PyExc_TypeError, "'%s' is required and can't be None", mArg.c_str());
+        return false;
+      }
+      return true;
+    }
+    
+    if (!mBuffer.acquire(obj))
+    {
+      if (!PyErr_Occurred())
+      {
+        PyErr_Format(PyExc_TypeError, "'%s' must support the buffer protocol", mArg.c_str());
+      }
+      return false;
+    }
+    
+    mObject = obj;
+    
+    // The buffer view keeps the array from being assigned elsewhere until finish()
+    if (PyProcArrayCheck(obj))
+    {
+      AtArray *ary = PyProcArrayPeek(obj);
+      
+      if (ary && ary->type == mType && ary->nkeys == mKeys)
+      {
+        mAdopt = true;
+        mArray = ary;
+        return true;
+      }
+    }
+    
+    size_t stride = PyProcNumComponents(mType) * mKeys;
+    
+    if (mBuffer.count() % stride != 0)
+    {
+      PyErr_Format(PyExc_ValueError, "'%s' holds %lu scalar(s), not a multiple of %lu",
+                   mArg.c_str(), (unsigned long) mBuffer.count(), (unsigned long) stride);
+      return false;
+    }
+    
+    return true;
+  }
+  
+  // Allocate 'count' values if no input was given
+  void alloc(unsigned int count)
+  {
+    mArray = AiArrayAllocate(AtUInt32(count), AtByte(mKeys), AtByte(mType));
+  }
+  
+  // Declare the parameter on the node in finish(), i.e. "uniform FLOAT"
+  void declare(const std::string &decl)
+  {
+    mDeclare = decl;
+  }
+  
+  bool build(std::string &err)
+  {
+    if (!mObject || mAdopt)
+    {
+      return true;
+    }
+    
+    size_t stride = PyProcNumComponents(mType) * mKeys;
+    
+    mArray = AiArrayAllocate(AtUInt32(mBuffer.count() / stride), AtByte(mKeys), AtByte(mType));
+    
+    if (!mArray || !PyProcArrayFill(mArray, mBuffer))
+    {
+      err = std::string("Unsupported buffer format for '") + mArg + "'";
+      return false;
+    }
+    
+    return true;
+  }
+  
+  // Give the array to the node, nothing is done for unset inputs
+  bool finish(AtNode *node)
+  {
+    mBuffer.release();
+    
+    if (!mArray)
+    {
+      return true;
+    }
+    
+    if (!node)
+    {
+      // Adopted arrays are left to their python owner
+      if (!mAdopt)
+      {
+        AiArrayDestroy(mArray);
+      }
+      mArray = 0;
+      mAdopt = false;
+      return true;
+    }
+    
+    if (mAdopt)
+    {
+      if (PyProcArrayTake(mObject) == 0)
+      {
+        return false;
+      }
+      mAdopt = false;
+    }
+    
+    if (!mDeclare.empty())
+    {
+      AiNodeDeclare(node, mParam.c_str(), mDeclare.c_str());
+    }
+    
+    AiNodeSetArray(node, mParam.c_str(), mArray);
+    
+    mArray = 0;
+    
+    return true;
+  }
+  
+  inline bool valid() const { return (mArray != 0); }
+  inline AtArray* array() const { return mArray; }
+  inline unsigned int count() const { return (mArray ? (unsigned int) mArray->nelements : 0); }
+  inline const char* param() const { return mParam.c_str(); }
+  inline const char* arg() const { return mArg.c_str(); }
+  inline int type() const { return mType; }
+  
+  template <typename T>
+  inline T* data() const { return (mArray ? (T*) mArray->data : 0); }
+  
+private:
+  
+  Input(const Input&);
+  Input& operator=(const Input&);
+  
+private:
+  
+  std::string mParam;
+  std::string mArg;
+  std::string mDeclare;
+  int mType;
+  unsigned int mKeys;
+  PyObject *mObject;
+  PyProcBuffer mBuffer;
+  bool mAdopt;
+  AtArray *mArray;
+};
+
+static bool CheckIndices(const Input &indices, unsigned int count, std::string &err)
+{
+  const unsigned int *idx = indices.data<unsigned int>();
+  unsigned int n = indices.count();
+  
+  for (unsigned int i=0; i<n; ++i)
+  {
+    if (idx[i] >= count)
+    {
+      char buf[256];
+      sprintf(buf, "'%s' value %u at %u is out of range (%u)", indices.arg(), idx[i], i, count);
+      err = buf;
+      return false;
+    }
+  }
+  
+  return true;
+}
+
+// Fill missing indices for a per point or per face vertex attribute
+static bool DefaultIndices(const Input &values, const Input &vidxs, unsigned int npoints, Input &indices, std::string &err)
+{
+  if (indices.valid())
+  {
+    return CheckIndices(indices, values.count(), err);
+  }
+  
+  unsigned int n = vidxs.count();
+  
+  if (values.count() == npoints)
+  {
+    indices.alloc(n);
+    memcpy(indices.data<unsigned int>(), vidxs.data<unsigned int>(), n * sizeof(unsigned int));
+  }
+  else if (values.count() == n)
+  {
+    indices.alloc(n);
+    unsigned int *idx = indices.data<unsigned int>();
+    for (unsigned int i=0; i<n; ++i)
+    {
+      idx[i] = i;
+    }
+  }
+  else
+  {
+    err = std::string("'") + values.arg() + "' count doesn't match points or indices count, indices required";
+    return false;
+  }
+  
+  return true;
+}
+
+// ---
+
+static PyObject* PyProc_Polymesh(PyObject *, PyObject *args, PyObject *kwargs)
+{
+  static char *kwlist[] = {(char*)"name", (char*)"points", (char*)"face_counts", (char*)"indices",
+                           (char*)"normals", (char*)"uvs", (char*)"shidxs",
+                           (char*)"normal_indices", (char*)"uv_indices", (char*)"keys", (char*)"dedupe", NULL};
+  
+  PyObject *pyname = 0;
+  PyObject *objs[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+  int keys = 1;
+  PyObject *pydedupe = 0;
+  
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OOOO|OOOOOiO", kwlist, &pyname,
+                                   &objs[0], &objs[1], &objs[2], &objs[3],
+                                   &objs[4], &objs[5], &objs[6], &objs[7], &keys, &pydedupe))
+  {
+    return NULL;
+  }
+  
+  if (keys <= 0 || keys > 255)
+  {
+    PyErr_SetString(PyExc_ValueError, "Invalid motion key count");
+    return NULL;
+  }
+  
+  if (pyname != Py_None && !PyString_Check(pyname))
+  {
+    PyErr_SetString(PyExc_TypeError, "'name' must be a string or None");
+    return NULL;
+  }
+  
+  std::string name = (pyname != Py_None ? std::string(PyString_AsString(pyname)) : PyProcNames::Current()->next());
+  
+  Input vlist("vlist", "points", AI_TYPE_POINT, (unsigned int) keys);
+  Input nsides("nsides", "face_counts", AI_TYPE_UINT);
+  Input vidxs("vidxs", "indices", AI_TYPE_UINT);
+  Input nlist("nlist", "normals", AI_TYPE_VECTOR, (unsigned int) keys);
+  Input uvlist("uvlist", "uvs", AI_TYPE_POINT2);
+  Input shidxs("shidxs", "shidxs", AI_TYPE_BYTE);
+  Input nidxs("nidxs", "normal_indices", AI_TYPE_UINT);
+  Input uvidxs("uvidxs", "uv_indices", AI_TYPE_UINT);
+  
+  Input *inputs[8] = {&vlist, &nsides, &vidxs, &nlist, &uvlist, &shidxs, &nidxs, &uvidxs};
+  
+  bool dedupe = PyProcDedupe::Enabled(pydedupe);
+  PyProcDedupe content("polymesh");
+  AtNode *source = 0;
+  
+  // points, face_counts and indices are required
+  for (int i=0; i<8; ++i)
+  {
+    if (!inputs[i]->set(objs[i], i < 3))
+    {
+      return NULL;
+    }
+  }
+  
+  AtNode *node = 0;
+  std::string err;
+  
+  Py_BEGIN_ALLOW_THREADS
+  
+  bool ok = true;
+  
+  for (int i=0; ok && i<8; ++i)
+  {
+    ok = inputs[i]->build(err);
+  }
+  
+  if (ok)
+  {
+    unsigned int npoints = vlist.count();
+    unsigned int nfaces = nsides.count();
+    
+    unsigned long long nverts = 0;
+    const unsigned int *counts = nsides.data<unsigned int>();
+    
+    for (unsigned int i=0; i<nfaces; ++i)
+    {
+      nverts += counts[i];
+    }
+    
+    if (nverts != vidxs.count())
+    {
+      char buf[256];
+      sprintf(buf, "'face_counts' sum to %llu, 'indices' holds %u value(s)", nverts, vidxs.count());
+      err = buf;
+      ok = false;
+    }
+    else if (shidxs.valid() && shidxs.count() != nfaces)
+    {
+      err = "'shidxs' must hold one value per face";
+      ok = false;
+    }
+    else
+    {
+      ok = CheckIndices(vidxs, npoints, err);
+      
+      if (ok && nlist.valid())
+      {
+        ok = DefaultIndices(nlist, vidxs, npoints, nidxs, err);
+      }
+      
+      if (ok && uvlist.valid())
+      {
+        ok = DefaultIndices(uvlist, vidxs, npoints, uvidxs, err);
+      }
+    }
+  }
+  
+  if (ok && dedupe)
+  {
+    for (int i=0; i<8; ++i)
+    {
+      content.add(inputs[i]->param(), inputs[i]->array());
+    }
+    
+    source = content.find();
+  }
+  
+  if (ok && source)
+  {
+    node = content.instance(source, name);
+  }
+  else if (ok)
+  {
+    node = AiNode("polymesh");
+    
+    if (node)
+    {
+      AiNodeSetStr(node, "name", name.c_str());
+    }
+  }
+  
+  Py_END_ALLOW_THREADS
+  
+  if (!err.empty())
+  {
+    PyErr_SetString(PyExc_ValueError, err.c_str());
+  }
+  else if (!node)
+  {
+    PyErr_SetString(PyExc_RuntimeError, "Failed to create polymesh node");
+  }
+  
+  // Arrays of an instanced duplicate are dropped
+  AtNode *shape = (source ? 0 : node);
+  
+  bool rv = (node != 0);
+  
+  for (int i=0; i<8; ++i)
+  {
+    rv = (inputs[i]->finish(shape) && rv);
+  }
+  
+  if (rv && dedupe && shape)
+  {
+    content.insert(shape);
+  }
+  
+  return (rv ? PyLong_FromVoidPtr(node) : NULL);
+}
+
+// ---
+
+// Number of radius (varying) values for a curve with 'n' control points
+static unsigned int VaryingCount(const char *basis, unsigned int n)
+{
+  if (!strcmp(basis, "linear"))
+  {
+    return n;
+  }
+  else if (!strcmp(basis, "b-spline") || !strcmp(basis, "catmull-rom"))
+  {
+    return (n >= 2 ? n - 2 : 0);
+  }
+  else
+  {
+    // bezier
+    return (n >= 1 ? (n - 1) / 3 + 1 : 0);
+  }
+}
+
+static PyObject* PyProc_Curves(PyObject *, PyObject *args, PyObject *kwargs)
+{
+  static char *kwlist[] = {(char*)"name", (char*)"num_points", (char*)"points", (char*)"radius",
+                           (char*)"basis", (char*)"mode", (char*)"keys", (char*)"user_data", (char*)"dedupe", NULL};
+  
+  PyObject *pyname = 0;
+  PyObject *pynpoints = 0;
+  PyObject *pypoints = 0;
+  PyObject *pyradius = 0;
+  const char *basis = "bezier";
+  const char *mode = 0;
+  int keys = 1;
+  PyObject *userData = 0;
+  PyObject *pydedupe = 0;
+  
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OOO|OsziOO", kwlist, &pyname, &pynpoints, &pypoints,
+                                   &pyradius, &basis, &mode, &keys, &userData, &pydedupe))
+  {
+    return NULL;
+  }
+  
+  if (pyname != Py_None && !PyString_Check(pyname))
+  {
+    PyErr_SetString(PyExc_TypeError, "'name' must be a string or None");
+    return NULL;
+  }
+  
+  if (keys <= 0 || keys > 255)
+  {
+    PyErr_SetString(PyExc_ValueError, "Invalid motion key count");
+    return NULL;
+  }
+  
+  if (strcmp(basis, "bezier") && strcmp(basis, "b-spline") && strcmp(basis, "catmull-rom") && strcmp(basis, "linear"))
+  {
+    PyErr_Format(PyExc_ValueError, "Invalid curves basis \"%s\"", basis);
+    return NULL;
+  }
+  
+  if (userData && userData != Py_None && !PyDict_Check(userData))
+  {
+    PyErr_SetString(PyExc_TypeError, "'user_data' must be a dict");
+    return NULL;
+  }
+  
+  std::string name = (pyname != Py_None ? std::string(PyString_AsString(pyname)) : PyProcNames::Current()->next());
+  
+  Input numPoints("num_points", "num_points", AI_TYPE_UINT);
+  Input points("points", "points", AI_TYPE_POINT, (unsigned int) keys);
+  Input radius("radius", "radius", AI_TYPE_FLOAT);
+  
+  // A single radius for all vertices
+  float constRadius = -1.0f;
+  
+  if (!numPoints.set(pynpoints, true) || !points.set(pypoints, true))
+  {
+    return NULL;
+  }
+  
+  if (pyradius && (PyFloat_Check(pyradius) || PyInt_Check(pyradius)))
+  {
+    constRadius = float(PyFloat_AsDouble(pyradius));
+    
+    if (constRadius < 0.0f)
+    {
+      PyErr_SetString(PyExc_ValueError, "'radius' can't be negative");
+      return NULL;
+    }
+  }
+  else if (!radius.set(pyradius))
+  {
+    return NULL;
+  }
+  
+  // name: (type, buffer[, scope]), scope guessed from the value count if omitted
+  std::vector<Input*> extra;
+  std::vector<std::string> scopes;
+  
+  PyObject *key = 0;
+  PyObject *value = 0;
+  Py_ssize_t pos = 0;
+  
+  bool rv = true;
+  
+  while (rv && userData && userData != Py_None && PyDict_Next(userData, &pos, &key, &value))
+  {
+    int type = AI_TYPE_UNDEFINED;
+    PyObject *buffer = 0;
+    const char *scope = "";
+    
+    if (!PyString_Check(key) || !PyTuple_Check(value) || !PyArg_ParseTuple(value, "iO|s", &type, &buffer, &scope))
+    {
+      PyErr_SetString(PyExc_TypeError, "'user_data' items must be name: (type, buffer[, scope])");
+      rv = false;
+    }
+    else if (*scope && strcmp(scope, "uniform") && strcmp(scope, "varying") && strcmp(scope, "vertex"))
+    {
+      PyErr_Format(PyExc_ValueError, "Invalid user data scope \"%s\"", scope);
+      rv = false;
+    }
+    else if (type == AI_TYPE_STRING || type == AI_TYPE_NODE || type == AI_TYPE_POINTER ||
+             type == AI_TYPE_ARRAY || type == AI_TYPE_UNDEFINED)
+    {
+      PyErr_Format(PyExc_ValueError, "Unsupported user data type %d", type);
+      rv = false;
+    }
+    else
+    {
+      Input *input = new Input(PyString_AsString(key), PyString_AsString(key), type);
+      extra.push_back(input);
+      scopes.push_back(scope);
+      rv = input->set(buffer);
+    }
+  }
+  
+  bool dedupe = PyProcDedupe::Enabled(pydedupe);
+  PyProcDedupe content("curves");
+  AtNode *source = 0;
+  
+  AtNode *node = 0;
+  std::string err;
+  
+  if (rv)
+  {
+    Py_BEGIN_ALLOW_THREADS
+    
+    bool ok = (numPoints.build(err) && points.build(err) && radius.build(err));
+    
+    for (size_t i=0; ok && i<extra.size(); ++i)
+    {
+      ok = extra[i]->build(err);
+    }
+    
+    unsigned int ncurves = numPoints.count();
+    unsigned long long npoints = 0;
+    unsigned long long nvarying = 0;
+    
+    if (ok)
+    {
+      const unsigned int *counts = numPoints.data<unsigned int>();
+      
+      for (unsigned int i=0; i<ncurves; ++i)
+      {
+        npoints += counts[i];
+        nvarying += VaryingCount(basis, counts[i]);
+      }
+      
+      if (npoints != points.count())
+      {
+        char buf[256];
+        sprintf(buf, "'num_points' sum to %llu, 'points' holds %u value(s) per key", npoints, points.count());
+        err = buf;
+        ok = false;
+      }
+      else if (constRadius >= 0.0f)
+      {
+        radius.alloc((unsigned int) nvarying);
+        float *r = radius.data<float>();
+        for (unsigned long long i=0; i<nvarying; ++i)
+        {
+          r[i] = constRadius;
+        }
+      }
+      else if (radius.valid() && radius.count() != nvarying)
+      {
+        char buf[256];
+        sprintf(buf, "'radius' holds %u value(s), %s curves need %llu", radius.count(), basis, nvarying);
+        err = buf;
+        ok = false;
+      }
+    }
+    
+    for (size_t i=0; ok && i<extra.size(); ++i)
+    {
+      Input *input = extra[i];
+      std::string &scope = scopes[i];
+      
+      if (scope.empty())
+      {
+        scope = (input->count() == ncurves ? "uniform" : (input->count() == npoints ? "vertex" : "varying"));
+      }
+      
+      unsigned long long expected = (scope == "uniform" ? ncurves : (scope == "vertex" ? npoints : nvarying));
+      
+      if (input->count() != expected)
+      {
+        char buf[256];
+        sprintf(buf, "'%s' %s user data holds %u value(s), %llu expected", input->arg(), scope.c_str(), input->count(), expected);
+        err = buf;
+        ok = false;
+      }
+      else
+      {
+        input->declare(scope + " " + AiParamGetTypeName(input->type()));
+      }
+    }
+    
+    if (ok && dedupe)
+    {
+      content.add("num_points", numPoints.array());
+      content.add("points", points.array());
+      content.add("radius", radius.array());
+      content.add("basis", std::string(basis));
+      
+      if (mode)
+      {
+        content.add("mode", std::string(mode));
+      }
+      
+      for (size_t i=0; i<extra.size(); ++i)
+      {
+        content.add(extra[i]->param(), extra[i]->array());
+      }
+      
+      source = content.find();
+    }
+    
+    if (ok && source)
+    {
+      node = content.instance(source, name);
+    }
+    else if (ok)
+    {
+      node = AiNode("curves");
+      
+      if (node)
+      {
+        AiNodeSetStr(node, "name", name.c_str());
+        
+        AiNodeSetStr(node, "basis", basis);
+        
+        if (mode)
+        {
+          AiNodeSetStr(node, "mode", mode);
+        }
+      }
+    }
+    
+    Py_END_ALLOW_THREADS
+    
+    if (!err.empty())
+    {
+      PyErr_SetString(PyExc_ValueError, err.c_str());
+    }
+    else if (!node)
+    {
+      PyErr_SetString(PyExc_RuntimeError, "Failed to create curves node");
+    }
+    
+    rv = (node != 0);
+  }
+  
+  // Arrays of an instanced duplicate are dropped
+  AtNode *shape = (source ? 0 : node);
+  
+  rv = (numPoints.finish(shape) && rv);
+  rv = (points.finish(shape) && rv);
+  rv = (radius.finish(shape) && rv);
+  
+  for (size_t i=0; i<extra.size(); ++i)
+  {
+    rv = (extra[i]->finish(shape) && rv);
+    delete extra[i];
+  }
+  
+  if (rv && dedupe && shape)
+  {
+    content.insert(shape);
+  }
+  
+  return (rv ? PyLong_FromVoidPtr(node) : NULL);
+}
+
+// ---
+
+static PyMethodDef gsGeometryMethods[] =
+{
+  {"polymesh", (PyCFunction)PyProc_Polymesh, METH_VARARGS | METH_KEYWORDS, "polymesh(name, points, face_counts, indices, normals=None, uvs=None, shidxs=None, normal_indices=None, uv_indices=None, keys=1, dedupe=None)"},
+  {"curves", (PyCFunction)PyProc_Curves, METH_VARARGS | METH_KEYWORDS, "curves(name, num_points, points, radius=None, basis='bezier', mode=None, keys=1, user_data=None, dedupe=None)"},
+  {NULL, NULL, 0, NULL}
+};
+
+bool PyProcGeometryInit(PyObject *mod)
+{
+  for (PyMethodDef *def = gsGeometryMethods; def->ml_name; ++def)
+  {
+    PyObject *func = PyCFunction_New(def, NULL);
+    
+    if (!func || PyModule_AddObject(mod, def->ml_name, func) != 0)
+    {
+      return false;
+    }
+  }
+  
+  return true;
+}
@@ -0,0 +1,62 @@
+/*
+Copyright (c) 2016 Gaetan Guidet
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef __pyproc_geometry_h__
+#define __pyproc_geometry_h__
+
+#include <Python.h>
+
+// Native shape builders
+//
+// Geometry inputs are pyproc.Array objects of the expected type, adopted without
+//   copy, or any buffer protocol object, converted once
+// Shapes are validated and built with the GIL released, builders return the
+//   node address which GetNode/Generate may return as is
+// A None name gives the node a unique name (see names.h)
+// Identical shapes are instanced when 'dedupe' is set (see dedupe.h)
+//
+// pyproc.polymesh(name, points, face_counts, indices, normals=None, uvs=None,
+//                 shidxs=None, normal_indices=None, uv_indices=None, keys=1, dedupe=None)
+//   points     : 'point' values, vlist, 'keys' motion keys one after the other
+//   face_counts: 'uint' vertex count per face, nsides
+//   indices    : 'uint' point index per face vertex, vidxs
+//   normals    : 'vector' values, nlist, 'keys' motion keys one after the other
+//   uvs        : 'point2' values, uvlist
+//   shidxs     : 'byte' shader index per face
+//   When no indices are given, normals and uvs are indexed like points if there
+//   are as many as points, or per face vertex if there are as many as indices
+//
+// pyproc.curves(name, num_points, points, radius=None, basis='bezier', mode=None,
+//               keys=1, user_data=None, dedupe=None)
+//   num_points: 'uint' control point count per curve
+//   points    : 'point' values, 'keys' motion keys one after the other
+//   radius    : 'float' values, one per segment end point for the basis, or a
+//               single number for all
+//   user_data : {name: (type, buffer[, scope])} with scope 'uniform' (per curve),
+//               'vertex' (per control point) or 'varying' (per radius), guessed
+//               from the value count when omitted
+
+// All functions must be called with the GIL held
+
+bool PyProcGeometryInit(PyObject *mod);
+
+#endif
@@ -0,0 +1,497 @@
+/*
+Copyright (c) 2016 Gaetan Guidet
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "instance.h"
+#include "batch.h"
+#include "buffer.h"
+#include "nodes.h"
+#include "names.h"
+#include "threads.h"
+#include "camera.h"
+#include "cull.h"
+#include <ai.h>
+#include <string>
+#include <vector>
+#include <cstdio>
+
+// ---
+
+struct InstanceData
+{
+  std::string param;
+  std::string declaration;
+  int type;
+  size_t components;
+  PyProcBuffer buffer;
+};
+
+struct InstanceTask
+{
+  size_t count;
+  const std::vector<unsigned int> *indices;
+  unsigned int keys;
+  const std::vector<AtNode*> *sources;
+  const PyProcBuffer *matrices;
+  const PyProcBuffer *protoIds;
+  std::vector<InstanceData*> *userData;
+  const char *prefix;
+  PyProcNames *names;
+  unsigned long firstName;
+  int inheritXform;
+  std::vector<AtNode*> *nodes;
+};
+
+static bool ReadData(const InstanceData *ud, size_t i, PyProcValue &v)
+{
+  size_t first = i * ud->components;
+  
+  switch (ud->type)
+  {
+  case AI_TYPE_BYTE:
+    return ud->buffer.read(&v.b, first, 1);
+  case AI_TYPE_INT:
+  case AI_TYPE_ENUM:
+    return ud->buffer.read(&v.i, first, 1);
+  case AI_TYPE_UINT:
+    return ud->buffer.read(&v.u, first, 1);
+  case AI_TYPE_BOOLEAN:
+    return ud->buffer.read(&v.bo, first, 1);
+  default:
+    return ud->buffer.read(v.f, first, ud->components);
+  }
+}
+
+static void CreateInstances(size_t begin, size_t end, void *data)
+{
+  InstanceTask *task = (InstanceTask*) data;
+  
+  const std::vector<AtNode*> &sources = *(task->sources);
+  std::vector<InstanceData*> &userData = *(task->userData);
+  
+  std::string name;
+  char index[32];
+  PyProcValue v;
+  
+  for (size_t j=begin; j<end; ++j)
+  {
+    // Source index, differs from the node index when culling
+    size_t i = (task->indices ? (*task->indices)[j] : j);
+    
+    unsigned int proto = 0;
+    
+    if (task->protoIds)
+    {
+      task->protoIds->read(&proto, i, 1);
+    }
+    
+    AtNode *node = AiNode("ginstance");
+    
+    (*task->nodes)[j] = node;
+    
+    if (!node)
+    {
+      continue;
+    }
+    
+    if (task->prefix)
+    {
+      sprintf(index, "%lu", (unsigned long)i);
+      name = task->prefix;
+      name += index;
+    }
+    else
+    {
+      task->names->format(task->firstName + j, 0, name);
+    }
+    
+    AiNodeSetStr(node, "name", name.c_str());
+    
+    AiNodeSetPtr(node, "node", sources[proto]);
+    
+    if (task->inheritXform >= 0)
+    {
+      AiNodeSetBool(node, "inherit_xform", task->inheritXform != 0);
+    }
+    
+    if (task->keys == 1)
+    {
+      AtMatrix mtx;
+      task->matrices->read(&mtx[0][0], i * 16, 16);
+      AiNodeSetMatrix(node, "matrix", mtx);
+    }
+    else
+    {
+      AtArray *ary = AiArrayAllocate(1, AtByte(task->keys), AI_TYPE_MATRIX);
+      task->matrices->read((float*) ary->data, i * 16 * task->keys, 16 * task->keys);
+      AiNodeSetArray(node, "matrix", ary);
+    }
+    
+    for (size_t u=0; u<userData.size(); ++u)
+    {
+      const InstanceData *ud = userData[u];
+      
+      if (AiNodeDeclare(node, ud->param.c_str(), ud->declaration.c_str()) && ReadData(ud, i, v))
+      {
+        PyProcSetValue(node, ud->param.c_str(), ud->type, &v);
+      }
+    }
+  }
+}
+
+// ---
+
+static PyObject* PyProc_Instance(PyObject *, PyObject *args, PyObject *kwargs)
+{
+  static char *kwlist[] = {(char*)"sources", (char*)"matrices", (char*)"proto_ids", (char*)"user_data",
+                           (char*)"prefix", (char*)"keys", (char*)"inherit_xform", (char*)"cull", NULL};
+  
+  PyObject *pysources = 0;
+  PyObject *pymatrices = 0;
+  PyObject *pyprotos = 0;
+  PyObject *pyuserdata = 0;
+  const char *prefix = 0;
+  int keys = 1;
+  PyObject *pyinherit = 0;
+  PyObject *pycull = 0;
+  
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OO|OOziOO", kwlist, &pysources, &pymatrices, &pyprotos,
+                                   &pyuserdata, &prefix, &keys, &pyinherit, &pycull))
+  {
+    return NULL;
+  }
+  
+  PyProcCullSettings cullSettings;
+  
+  bool cull = (pycull && pycull != Py_None && pycull != Py_False);
+  
+  if (cull && !PyProcCullParse(pycull, cullSettings))
+  {
+    return NULL;
+  }
+  
+  int inheritXform = (pyinherit && pyinherit != Py_None ? PyObject_IsTrue(pyinherit) : -1);
+  
+  if (inheritXform == -1 && PyErr_Occurred())
+  {
+    return NULL;
+  }
+  
+  if (keys <= 0 || keys > 255)
+  {
+    PyErr_SetString(PyExc_ValueError, "Invalid motion key count");
+    return NULL;
+  }
+  
+  if (pyuserdata && pyuserdata != Py_None && !PyDict_Check(pyuserdata))
+  {
+    PyErr_SetString(PyExc_TypeError, "'user_data' must be a dict");
+    return NULL;
+  }
+  
+  // Source nodes
+  
+  std::vector<AtNode*> sources;
+  
+  PyObject *seq = PySequence_Fast(pysources, "'sources' must be a sequence of nodes");
+  
+  if (!seq)
+  {
+    return NULL;
+  }
+  
+  for (Py_ssize_t i=0; i<PySequence_Fast_GET_SIZE(seq); ++i)
+  {
+    AtNode *node = PyProcGetNode(PySequence_Fast_GET_ITEM(seq, i));
+    
+    if (!node)
+    {
+      Py_DECREF(seq);
+      return NULL;
+    }
+    
+    sources.push_back(node);
+  }
+  
+  Py_DECREF(seq);
+  
+  if (sources.empty())
+  {
+    PyErr_SetString(PyExc_ValueError, "No source nodes");
+    return NULL;
+  }
+  
+  // Matrices and prototype indices
+  
+  PyProcBuffer matrices;
+  PyProcBuffer protoIds;
+  
+  if (!matrices.acquire(pymatrices))
+  {
+    if (!PyErr_Occurred())
+    {
+      PyErr_SetString(PyExc_TypeError, "'matrices' must support the buffer protocol");
+    }
+    return NULL;
+  }
+  
+  if (!matrices.isNumeric())
+  {
+    PyErr_Format(PyExc_TypeError, "'matrices' must hold numbers (buffer format '%c')", (matrices.format() ? matrices.format() : '?'));
+    return NULL;
+  }
+  
+  size_t stride = 16 * size_t(keys);
+  
+  if (matrices.count() % stride != 0)
+  {
+    PyErr_Format(PyExc_ValueError, "'matrices' holds %lu scalar(s), not a multiple of %lu",
+                 (unsigned long) matrices.count(), (unsigned long) stride);
+    return NULL;
+  }
+  
+  size_t count = matrices.count() / stride;
+  
+  if (pyprotos && pyprotos != Py_None)
+  {
+    if (!protoIds.acquire(pyprotos))
+    {
+      if (!PyErr_Occurred())
+      {
+        PyErr_SetString(PyExc_TypeError, "'proto_ids' must support the buffer protocol");
+      }
+      return NULL;
+    }
+    
+    if (!protoIds.isNumeric())
+    {
+      PyErr_SetString(PyExc_TypeError, "'proto_ids' must hold numbers");
+      return NULL;
+    }
+    
+    if (protoIds.count() != count)
+    {
+      PyErr_Format(PyExc_ValueError, "'proto_ids' holds %lu value(s), expected %lu",
+                   (unsigned long) protoIds.count(), (unsigned long) count);
+      return NULL;
+    }
+  }
+  else if (sources.size() > 1)
+  {
+    PyErr_SetString(PyExc_ValueError, "'proto_ids' required with several sources");
+    return NULL;
+  }
+  
+  // Per instance user data
+  
+  std::vector<InstanceData*> userData;
+  
+  PyObject *key = 0;
+  PyObject *value = 0;
+  Py_ssize_t pos = 0;
+  
+  bool rv = true;
+  
+  while (rv && pyuserdata && pyuserdata != Py_None && PyDict_Next(pyuserdata, &pos, &key, &value))
+  {
+    int type = AI_TYPE_UNDEFINED;
+    PyObject *buffer = 0;
+    
+    if (!PyString_Check(key) || !PyTuple_Check(value) || !PyArg_ParseTuple(value, "iO", &type, &buffer))
+    {
+      PyErr_SetString(PyExc_TypeError, "'user_data' items must be name: (type, buffer)");
+      rv = false;
+    }
+    else if (type == AI_TYPE_STRING || type == AI_TYPE_NODE || type == AI_TYPE_POINTER ||
+             type == AI_TYPE_ARRAY || type == AI_TYPE_UNDEFINED)
+    {
+      PyErr_Format(PyExc_ValueError, "Unsupported user data type %d", type);
+      rv = false;
+    }
+    else
+    {
+      InstanceData *ud = new InstanceData();
+      
+      userData.push_back(ud);
+      
+      ud->param = PyString_AsString(key);
+      ud->declaration = std::string("constant ") + AiParamGetTypeName(type);
+      ud->type = type;
+      ud->components = PyProcNumComponents(type);
+      
+      if (!ud->buffer.acquire(buffer))
+      {
+        if (!PyErr_Occurred())
+        {
+          PyErr_Format(PyExc_TypeError, "'%s' user data must support the buffer protocol", ud->param.c_str());
+        }
+        rv = false;
+      }
+      else if (!ud->buffer.isNumeric())
+      {
+        PyErr_Format(PyExc_TypeError, "'%s' user data must hold numbers", ud->param.c_str());
+        rv = false;
+      }
+      else if (ud->buffer.count() != count * ud->components)
+      {
+        PyErr_Format(PyExc_ValueError, "'%s' user data holds %lu scalar(s), expected %lu", ud->param.c_str(),
+                     (unsigned long) ud->buffer.count(), (unsigned long) (count * ud->components));
+        rv = false;
+      }
+    }
+  }
+  
+  // Camera culling, on the first motion key
+  
+  std::vector<unsigned int> kept;
+  
+  if (rv && cull)
+  {
+    PyProcCamera camera;
+    
+    if (!camera.setup())
+    {
+      AiMsgWarning("[pyproc] instance: No render camera, culling disabled");
+      cull = false;
+    }
+    else
+    {
+      std::vector<float> tmp;
+      
+      Py_BEGIN_ALLOW_THREADS
+      
+      const float *data = matrices.floats(tmp);
+      
+      if (data)
+      {
+        PyProcCull(camera, cullSettings, data, count, stride, true, kept);
+      }
+      
+      Py_END_ALLOW_THREADS
+      
+      AiMsgDebug("[pyproc] instance: Culled %lu of %lu instance(s)", (unsigned long)(count - kept.size()), (unsigned long) count);
+    }
+  }
+  
+  size_t ncreate = (cull ? kept.size() : count);
+  
+  std::vector<AtNode*> nodes;
+  
+  if (rv)
+  {
+    InstanceTask task;
+    
+    task.count = ncreate;
+    task.indices = (cull ? &kept : 0);
+    task.keys = (unsigned int) keys;
+    task.sources = &sources;
+    task.matrices = &matrices;
+    task.protoIds = (protoIds.valid() ? &protoIds : 0);
+    task.userData = &userData;
+    task.prefix = prefix;
+    task.names = PyProcNames::Current();
+    task.firstName = (prefix ? 0 : task.names->reserve(ncreate));
+    task.inheritXform = inheritXform;
+    task.nodes = &nodes;
+    
+    std::string err;
+    
+    Py_BEGIN_ALLOW_THREADS
+    
+    if (task.protoIds)
+    {
+      unsigned int id = 0;
+      
+      for (size_t i=0; i<count; ++i)
+      {
+        if (!protoIds.read(&id, i, 1) || id >= sources.size())
+        {
+          char buf[256];
+          sprintf(buf, "'proto_ids' value %u at %lu is out of range (%lu)", id, (unsigned long) i, (unsigned long) sources.size());
+          err = buf;
+          break;
+        }
+      }
+    }
+    
+    if (err.empty())
+    {
+      nodes.resize(ncreate, 0);
+      
+      PyProcParallelFor(ncreate, 1024, CreateInstances, &task);
+      
+      // Keep the batch free of failed nodes
+      size_t n = 0;
+      
+      for (size_t i=0; i<ncreate; ++i)
+      {
+        if (nodes[i])
+        {
+          nodes[n++] = nodes[i];
+        }
+      }
+      
+      if (n < ncreate)
+      {
+        AiMsgError("[pyproc] instance: Failed to create %lu ginstance node(s)", (unsigned long)(ncreate - n));
+        nodes.resize(n);
+      }
+    }
+    
+    Py_END_ALLOW_THREADS
+    
+    if (!err.empty())
+    {
+      PyErr_SetString(PyExc_ValueError, err.c_str());
+      rv = false;
+    }
+  }
+  
+  for (size_t i=0; i<userData.size(); ++i)
+  {
+    delete userData[i];
+  }
+  
+  return (rv ? PyProcBatchWrap("ginstance", nodes) : NULL);
+}
+
+// ---
+
+static PyMethodDef gsInstanceMethods[] =
+{
+  {"instance", (PyCFunction)PyProc_Instance, METH_VARARGS | METH_KEYWORDS, "instance(sources, matrices, proto_ids=None, user_data=None, prefix=None, keys=1, inherit_xform=None, cull=None)"},
+  {NULL, NULL, 0, NULL}
+};
+
+bool PyProcInstanceInit(PyObject *mod)
+{
+  for (PyMethodDef *def = gsInstanceMethods; def->ml_name; ++def)
+  {
+    PyObject *func = PyCFunction_New(def, NULL);
+    
+    if (!func || PyModule_AddObject(mod, def->ml_name, func) != 0)
+    {
+      return false;
+    }
+  }
+  
+  return true;
+}
@@ -0,0 +1,48 @@
+/*
+Copyright (c) 2016 Gaetan Guidet
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef __pyproc_instance_h__
+#define __pyproc_instance_h__
+
+#include <Python.h>
+
+// pyproc.instance(sources, matrices, proto_ids=None, user_data=None, prefix=None,
+//                 keys=1, inherit_xform=None, cull=None)
+//
+// Create one ginstance node per matrix with the GIL released
+//   sources  : sequence of source nodes (names, addresses or arnold node pointers)
+//   matrices : buffer of count * keys * 16 floats, the keys of an instance one
+//              after the other
+//   proto_ids: 'uint' buffer of count source indices, optional with a single source
+//   user_data: {name: (type, buffer)} per instance constant user parameters
+//   prefix   : instances are named prefix + index when given, uniquely otherwise
+//   cull     : only create the instances kept by the render camera, pyproc.cull
+//              settings as a dict or True (see cull.h), prefixed names keep the
+//              original index
+//
+// Returns a committed pyproc.NodeBatch, which Generate/GetNodes may return as is
+
+// All functions must be called with the GIL held
+
+bool PyProcInstanceInit(PyObject *mod);
+
+#endif
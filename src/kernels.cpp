@@ -0,0 +1,1440 @@
+/*
+Copyright (c) 2016 Gaetan Guidet
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "kernels.h"
+#include "array.h"
+#include "buffer.h"
+#include "threads.h"
+#include "simd.h"
+#include "random.h"
+#include <ai.h>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cfloat>
+#include <cstring>
+#include <algorithm>
+#include <cstdio>
+
+// ---
+
+// Read only view on a buffer argument as T scalars
+// Buffers already holding 32 bits values are used in place, others are converted to
+//   a temporary by prepare(), which doesn't need the GIL
+
+template <typename T>
+class Values
+{
+public:
+  
+  Values()
+    : mData(0), mCount(0), mDims(1)
+  {
+  }
+  
+  // GIL must be held, sets a python exception on failure
+  bool acquire(PyObject *obj, const char *name, size_t dims)
+  {
+    if (!PyProcBuffer::Supported(obj) || !mBuffer.acquire(obj))
+    {
+      if (!PyErr_Occurred())
+      {
+        PyErr_Format(PyExc_TypeError, "'%s' must support the buffer protocol", name);
+      }
+      return false;
+    }
+    
+    if (mBuffer.format() != 0 && !mBuffer.isFloat() && !mBuffer.isInteger())
+    {
+      PyErr_Format(PyExc_TypeError, "'%s' must hold numeric values", name);
+      return false;
+    }
+    
+    if (mBuffer.count() % dims != 0)
+    {
+      PyErr_Format(PyExc_ValueError, "'%s' size must be a multiple of %lu", name, (unsigned long) dims);
+      return false;
+    }
+    
+    mDims = dims;
+    mCount = mBuffer.count() / dims;
+    mData = (native() ? (const T*) mBuffer.data() : 0);
+    
+    return true;
+  }
+  
+  void prepare()
+  {
+    if (mData || mCount == 0)
+    {
+      return;
+    }
+    
+    mTemp.resize(mCount * mDims);
+    mBuffer.read(&mTemp[0], 0, mTemp.size());
+    mData = &mTemp[0];
+  }
+  
+  inline bool valid() const { return mBuffer.valid(); }
+  inline const T* data() const { return mData; }
+  inline size_t count() const { return mCount; }
+  
+private:
+  
+  bool native() const;
+  
+private:
+  
+  PyProcBuffer mBuffer;
+  std::vector<T> mTemp;
+  const T *mData;
+  size_t mCount;
+  size_t mDims;
+};
+
+template <>
+bool Values<float>::native() const
+{
+  return (mBuffer.itemSize() == 4 && (mBuffer.format() == 'f' || mBuffer.format() == 0));
+}
+
+template <>
+bool Values<unsigned int>::native() const
+{
+  char fmt = mBuffer.format();
+  
+  return (mBuffer.itemSize() == 4 && (fmt == 0 || fmt == 'I' || fmt == 'i' || fmt == 'L' || fmt == 'l'));
+}
+
+// --- Bounds and normalization, one implementation per instruction set
+
+static void ReduceBounds(const float *lo, const float *hi, size_t n, float *bmin, float *bmax)
+{
+  // n is a multiple of 3, lane k holds component k % 3
+  for (size_t k=0; k<n; ++k)
+  {
+    size_t c = k % 3;
+    
+    if (lo[k] < bmin[c]) bmin[c] = lo[k];
+    if (hi[k] > bmax[c]) bmax[c] = hi[k];
+  }
+}
+
+static void BoundsScalar(const float *p, size_t n, float *bmin, float *bmax)
+{
+  ReduceBounds(p, p, 3 * n, bmin, bmax);
+}
+
+static void NormalizeScalar(float *v, size_t n)
+{
+  for (size_t i=0; i<n; ++i, v+=4)
+  {
+    float l = sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    
+    if (l > 0.0f)
+    {
+      v[0] /= l;
+      v[1] /= l;
+      v[2] /= l;
+    }
+  }
+}
+
+#ifdef PYPROC_SSE
+
+// 4 points per iteration, the 3 registers hold x y z x | y z x y | z x y z
+static void BoundsSSE(const float *p, size_t n, float *bmin, float *bmax)
+{
+  size_t n4 = n & ~size_t(3);
+  
+  if (n4 > 0)
+  {
+    __m128 lo0 = _mm_loadu_ps(p);
+    __m128 lo1 = _mm_loadu_ps(p + 4);
+    __m128 lo2 = _mm_loadu_ps(p + 8);
+    __m128 hi0 = lo0;
+    __m128 hi1 = lo1;
+    __m128 hi2 = lo2;
+    
+    for (size_t i=4; i<n4; i+=4)
+    {
+      const float *q = p + 3 * i;
+      
+      __m128 a = _mm_loadu_ps(q);
+      __m128 b = _mm_loadu_ps(q + 4);
+      __m128 c = _mm_loadu_ps(q + 8);
+      
+      lo0 = _mm_min_ps(lo0, a);
+      lo1 = _mm_min_ps(lo1, b);
+      lo2 = _mm_min_ps(lo2, c);
+      hi0 = _mm_max_ps(hi0, a);
+      hi1 = _mm_max_ps(hi1, b);
+      hi2 = _mm_max_ps(hi2, c);
+    }
+    
+    float lo[12], hi[12];
+    
+    _mm_storeu_ps(lo, lo0);
+    _mm_storeu_ps(lo + 4, lo1);
+    _mm_storeu_ps(lo + 8, lo2);
+    _mm_storeu_ps(hi, hi0);
+    _mm_storeu_ps(hi + 4, hi1);
+    _mm_storeu_ps(hi + 8, hi2);
+    
+    ReduceBounds(lo, hi, 12, bmin, bmax);
+  }
+  
+  BoundsScalar(p + 3 * n4, n - n4, bmin, bmax);
+}
+
+static void NormalizeSSE(float *v, size_t n)
+{
+  const __m128 zero = _mm_setzero_ps();
+  
+  for (size_t i=0; i<n; ++i, v+=4)
+  {
+    __m128 x = _mm_loadu_ps(v);
+    __m128 d = _mm_mul_ps(x, x);
+    
+    d = _mm_add_ps(d, _mm_shuffle_ps(d, d, _MM_SHUFFLE(2, 3, 0, 1)));
+    d = _mm_add_ps(d, _mm_shuffle_ps(d, d, _MM_SHUFFLE(1, 0, 3, 2)));
+    
+    __m128 l = _mm_sqrt_ps(d);
+    
+    _mm_storeu_ps(v, _mm_and_ps(_mm_cmpgt_ps(l, zero), _mm_div_ps(x, l)));
+  }
+}
+
+#endif
+
+#ifdef PYPROC_AVX
+
+// 8 points per iteration, same layout as BoundsSSE over 3 x 8 floats
+static PYPROC_AVX_FUNC void BoundsAVX(const float *p, size_t n, float *bmin, float *bmax)
+{
+  size_t n8 = n & ~size_t(7);
+  
+  if (n8 > 0)
+  {
+    __m256 lo0 = _mm256_loadu_ps(p);
+    __m256 lo1 = _mm256_loadu_ps(p + 8);
+    __m256 lo2 = _mm256_loadu_ps(p + 16);
+    __m256 hi0 = lo0;
+    __m256 hi1 = lo1;
+    __m256 hi2 = lo2;
+    
+    for (size_t i=8; i<n8; i+=8)
+    {
+      const float *q = p + 3 * i;
+      
+      __m256 a = _mm256_loadu_ps(q);
+      __m256 b = _mm256_loadu_ps(q + 8);
+      __m256 c = _mm256_loadu_ps(q + 16);
+      
+      lo0 = _mm256_min_ps(lo0, a);
+      lo1 = _mm256_min_ps(lo1, b);
+      lo2 = _mm256_min_ps(lo2, c);
+      hi0 = _mm256_max_ps(hi0, a);
+      hi1 = _mm256_max_ps(hi1, b);
+      hi2 = _mm256_max_ps(hi2, c);
+    }
+    
+    float lo[24], hi[24];
+    
+    _mm256_storeu_ps(lo, lo0);
+    _mm256_storeu_ps(lo + 8, lo1);
+    _mm256_storeu_ps(lo + 16, lo2);
+    _mm256_storeu_ps(hi, hi0);
+    _mm256_storeu_ps(hi + 8, hi1);
+    _mm256_storeu_ps(hi + 16, hi2);
+    
+    ReduceBounds(lo, hi, 24, bmin, bmax);
+  }
+  
+  BoundsSSE(p + 3 * n8, n - n8, bmin, bmax);
+}
+
+// 2 vectors per iteration, hadd sums within each 128 bits half
+static PYPROC_AVX_FUNC void NormalizeAVX(float *v, size_t n)
+{
+  size_t n2 = n & ~size_t(1);
+  
+  const __m256 zero = _mm256_setzero_ps();
+  
+  for (size_t i=0; i<n2; i+=2, v+=8)
+  {
+    __m256 x = _mm256_loadu_ps(v);
+    __m256 d = _mm256_mul_ps(x, x);
+    
+    d = _mm256_hadd_ps(d, d);
+    d = _mm256_hadd_ps(d, d);
+    
+    __m256 l = _mm256_sqrt_ps(d);
+    
+    _mm256_storeu_ps(v, _mm256_and_ps(_mm256_cmp_ps(l, zero, _CMP_GT_OQ), _mm256_div_ps(x, l)));
+  }
+  
+  NormalizeSSE(v, n - n2);
+}
+
+#endif
+
+void PyProcBounds(const float *points, size_t n, float bmin[3], float bmax[3])
+{
+  switch (PyProcSimdLevel())
+  {
+#ifdef PYPROC_AVX
+  case PyProcSimdAVX:
+    BoundsAVX(points, n, bmin, bmax);
+    break;
+#endif
+#ifdef PYPROC_SSE
+  case PyProcSimdSSE:
+    BoundsSSE(points, n, bmin, bmax);
+    break;
+#endif
+  default:
+    BoundsScalar(points, n, bmin, bmax);
+  }
+}
+
+void PyProcNormalize4(float *vectors, size_t n)
+{
+  switch (PyProcSimdLevel())
+  {
+#ifdef PYPROC_AVX
+  case PyProcSimdAVX:
+    NormalizeAVX(vectors, n);
+    break;
+#endif
+#ifdef PYPROC_SSE
+  case PyProcSimdSSE:
+    NormalizeSSE(vectors, n);
+    break;
+#endif
+  default:
+    NormalizeScalar(vectors, n);
+  }
+}
+
+// Sum 4 floats vectors v[idx[0..n)] into out
+static inline void Gather4(const float *v, const unsigned int *idx, size_t n, float *out)
+{
+#ifdef PYPROC_SSE
+  __m128 acc = _mm_setzero_ps();
+  
+  for (size_t i=0; i<n; ++i)
+  {
+    acc = _mm_add_ps(acc, _mm_loadu_ps(v + 4 * size_t(idx[i])));
+  }
+  
+  _mm_storeu_ps(out, acc);
+#else
+  out[0] = out[1] = out[2] = out[3] = 0.0f;
+  
+  for (size_t i=0; i<n; ++i)
+  {
+    const float *x = v + 4 * size_t(idx[i]);
+    
+    out[0] += x[0];
+    out[1] += x[1];
+    out[2] += x[2];
+    out[3] += x[3];
+  }
+#endif
+}
+
+static inline void Cross(const float *a, const float *b, float *out)
+{
+  out[0] = a[1] * b[2] - a[2] * b[1];
+  out[1] = a[2] * b[0] - a[0] * b[2];
+  out[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+static inline float Dot(const float *a, const float *b)
+{
+  return (a[0] * b[0] + a[1] * b[1] + a[2] * b[2]);
+}
+
+// --- Mesh topology
+
+// Face ranges in the index list and faces touching each point
+struct Topology
+{
+  std::vector<unsigned int> faceStart;
+  std::vector<unsigned int> pointStart;
+  std::vector<unsigned int> pointFaces;
+  
+  inline size_t numFaces() const { return faceStart.size() - 1; }
+};
+
+// Doesn't need the GIL
+static bool BuildTopology(const unsigned int *indices, size_t nindices,
+                          const unsigned int *counts, size_t ncounts,
+                          size_t npoints, Topology &topo, std::string &err,
+                          bool adjacency=true)
+{
+  char msg[256];
+  
+  size_t nfaces = (counts ? ncounts : nindices / 3);
+  
+  if (!counts && nindices % 3 != 0)
+  {
+    err = "Index count is not a multiple of 3, pass 'face_counts' for polygons";
+    return false;
+  }
+  
+  topo.faceStart.resize(nfaces + 1);
+  topo.faceStart[0] = 0;
+  
+  size_t total = 0;
+  
+  for (size_t f=0; f<nfaces; ++f)
+  {
+    total += (counts ? counts[f] : 3);
+    
+    if (total > nindices)
+    {
+      break;
+    }
+    
+    topo.faceStart[f+1] = (unsigned int) total;
+  }
+  
+  if (total != nindices)
+  {
+    sprintf(msg, "Face counts sum doesn't match the index count (%lu)", (unsigned long) nindices);
+    err = msg;
+    return false;
+  }
+  
+  topo.pointStart.assign(npoints + 1, 0);
+  
+  for (size_t i=0; i<nindices; ++i)
+  {
+    if (indices[i] >= npoints)
+    {
+      sprintf(msg, "Index %lu out of range (%u >= %lu)", (unsigned long) i, indices[i], (unsigned long) npoints);
+      err = msg;
+      return false;
+    }
+    
+    topo.pointStart[indices[i] + 1] += 1;
+  }
+  
+  if (!adjacency)
+  {
+    return true;
+  }
+  
+  for (size_t p=0; p<npoints; ++p)
+  {
+    topo.pointStart[p+1] += topo.pointStart[p];
+  }
+  
+  std::vector<unsigned int> cursor(topo.pointStart.begin(), topo.pointStart.end() - 1);
+  
+  topo.pointFaces.resize(nindices);
+  
+  for (size_t f=0; f<nfaces; ++f)
+  {
+    for (unsigned int i=topo.faceStart[f]; i<topo.faceStart[f+1]; ++i)
+    {
+      topo.pointFaces[cursor[indices[i]]++] = (unsigned int) f;
+    }
+  }
+  
+  return true;
+}
+
+// --- Normals
+
+struct NormalsTask
+{
+  const float *points;
+  const unsigned int *indices;
+  const Topology *topo;
+  std::vector<float> faceNormals;
+  std::vector<float> pointNormals;
+  float *out;
+};
+
+// Fan triangles cross products, summed length is twice the face area
+static void FaceNormals(size_t begin, size_t end, void *data)
+{
+  NormalsTask *task = (NormalsTask*) data;
+  
+  for (size_t f=begin; f<end; ++f)
+  {
+    unsigned int s = task->topo->faceStart[f];
+    unsigned int e = task->topo->faceStart[f+1];
+    
+    float *n = &(task->faceNormals[4 * f]);
+    
+    n[0] = n[1] = n[2] = n[3] = 0.0f;
+    
+    if (e - s < 3)
+    {
+      continue;
+    }
+    
+    const float *p0 = task->points + 3 * size_t(task->indices[s]);
+    
+    for (unsigned int i=s+1; i+1<e; ++i)
+    {
+      const float *p1 = task->points + 3 * size_t(task->indices[i]);
+      const float *p2 = task->points + 3 * size_t(task->indices[i+1]);
+      
+      float e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+      float e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+      float c[3];
+      
+      Cross(e1, e2, c);
+      
+      n[0] += c[0];
+      n[1] += c[1];
+      n[2] += c[2];
+    }
+  }
+}
+
+static void PointNormals(size_t begin, size_t end, void *data)
+{
+  NormalsTask *task = (NormalsTask*) data;
+  
+  const Topology *topo = task->topo;
+  
+  float *n = &(task->pointNormals[4 * begin]);
+  
+  for (size_t p=begin; p<end; ++p, n+=4)
+  {
+    unsigned int s = topo->pointStart[p];
+    
+    Gather4(&(task->faceNormals[0]), &(topo->pointFaces[0]) + s, topo->pointStart[p+1] - s, n);
+  }
+  
+  PyProcNormalize4(&(task->pointNormals[4 * begin]), end - begin);
+  
+  n = &(task->pointNormals[4 * begin]);
+  
+  float *out = task->out + 3 * begin;
+  
+  for (size_t p=begin; p<end; ++p, n+=4, out+=3)
+  {
+    out[0] = n[0];
+    out[1] = n[1];
+    out[2] = n[2];
+  }
+}
+
+// --- Tangents
+
+struct TangentsTask
+{
+  const float *points;
+  const float *normals;
+  const float *uvs;
+  const unsigned int *indices;
+  const unsigned int *uvIndices;
+  const Topology *topo;
+  std::vector<float> faceTangents;
+  std::vector<float> faceBitangents;
+  std::vector<float> pointTangents;
+  std::vector<float> pointBitangents;
+  float *outTangents;
+  float *outBitangents;
+};
+
+static inline void AddWeighted(float *acc, float *v, float w)
+{
+  float l = sqrtf(Dot(v, v));
+  
+  if (l > 0.0f)
+  {
+    w /= l;
+    
+    acc[0] += w * v[0];
+    acc[1] += w * v[1];
+    acc[2] += w * v[2];
+  }
+}
+
+// Fan triangles u and v directions, weighted by the triangle area
+static void FaceTangents(size_t begin, size_t end, void *data)
+{
+  TangentsTask *task = (TangentsTask*) data;
+  
+  const unsigned int *uvidx = (task->uvIndices ? task->uvIndices : task->indices);
+  
+  for (size_t f=begin; f<end; ++f)
+  {
+    unsigned int s = task->topo->faceStart[f];
+    unsigned int e = task->topo->faceStart[f+1];
+    
+    float *t = &(task->faceTangents[4 * f]);
+    float *b = &(task->faceBitangents[4 * f]);
+    
+    t[0] = t[1] = t[2] = t[3] = 0.0f;
+    b[0] = b[1] = b[2] = b[3] = 0.0f;
+    
+    if (e - s < 3)
+    {
+      continue;
+    }
+    
+    const float *p0 = task->points + 3 * size_t(task->indices[s]);
+    const float *t0 = task->uvs + 2 * size_t(uvidx[s]);
+    
+    for (unsigned int i=s+1; i+1<e; ++i)
+    {
+      const float *p1 = task->points + 3 * size_t(task->indices[i]);
+      const float *p2 = task->points + 3 * size_t(task->indices[i+1]);
+      const float *t1 = task->uvs + 2 * size_t(uvidx[i]);
+      const float *t2 = task->uvs + 2 * size_t(uvidx[i+1]);
+      
+      float e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+      float e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+      
+      float du1 = t1[0] - t0[0];
+      float dv1 = t1[1] - t0[1];
+      float du2 = t2[0] - t0[0];
+      float dv2 = t2[1] - t0[1];
+      
+      float det = du1 * dv2 - du2 * dv1;
+      
+      if (fabsf(det) < FLT_MIN)
+      {
+        continue;
+      }
+      
+      float c[3];
+      
+      Cross(e1, e2, c);
+      
+      float area = sqrtf(Dot(c, c));
+      
+      float sdir[3] = {(e1[0] * dv2 - e2[0] * dv1) / det,
+                       (e1[1] * dv2 - e2[1] * dv1) / det,
+                       (e1[2] * dv2 - e2[2] * dv1) / det};
+      float tdir[3] = {(e2[0] * du1 - e1[0] * du2) / det,
+                       (e2[1] * du1 - e1[1] * du2) / det,
+                       (e2[2] * du1 - e1[2] * du2) / det};
+      
+      AddWeighted(t, sdir, area);
+      AddWeighted(b, tdir, area);
+    }
+  }
+}
+
+// Gram-Schmidt against the point normal, the bitangent is rebuilt from the normal and
+//   tangent keeping the handedness of the accumulated v direction
+static void PointTangents(size_t begin, size_t end, void *data)
+{
+  TangentsTask *task = (TangentsTask*) data;
+  
+  const Topology *topo = task->topo;
+  
+  float *t = &(task->pointTangents[4 * begin]);
+  float *b = &(task->pointBitangents[4 * begin]);
+  
+  for (size_t p=begin; p<end; ++p, t+=4, b+=4)
+  {
+    unsigned int s = topo->pointStart[p];
+    unsigned int n = topo->pointStart[p+1] - s;
+    
+    Gather4(&(task->faceTangents[0]), &(topo->pointFaces[0]) + s, n, t);
+    Gather4(&(task->faceBitangents[0]), &(topo->pointFaces[0]) + s, n, b);
+    
+    const float *nrm = task->normals + 3 * p;
+    
+    float d = Dot(nrm, t);
+    
+    t[0] -= d * nrm[0];
+    t[1] -= d * nrm[1];
+    t[2] -= d * nrm[2];
+    t[3] = 0.0f;
+  }
+  
+  PyProcNormalize4(&(task->pointTangents[4 * begin]), end - begin);
+  
+  t = &(task->pointTangents[4 * begin]);
+  b = &(task->pointBitangents[4 * begin]);
+  
+  float *ot = task->outTangents + 3 * begin;
+  float *ob = task->outBitangents + 3 * begin;
+  
+  for (size_t p=begin; p<end; ++p, t+=4, b+=4, ot+=3, ob+=3)
+  {
+    float c[3];
+    
+    Cross(task->normals + 3 * p, t, c);
+    
+    float w = (Dot(c, b) < 0.0f ? -1.0f : 1.0f);
+    
+    ot[0] = t[0];
+    ot[1] = t[1];
+    ot[2] = t[2];
+    ob[0] = w * c[0];
+    ob[1] = w * c[1];
+    ob[2] = w * c[2];
+  }
+}
+
+// --- Scatter
+
+struct ScatterTask
+{
+  const float *points;
+  const float *normals;
+  const float *density;
+  bool varying;
+  std::vector<unsigned int> triangles;
+  std::vector<unsigned int> triangleFaces;
+  std::vector<double> cdf;
+  double total;
+  size_t count;
+  unsigned long long seed;
+  std::vector<float> outPoints;
+  std::vector<float> outNormals;
+  std::vector<unsigned int> outFaces;
+};
+
+static void TriangleWeights(size_t begin, size_t end, void *data)
+{
+  ScatterTask *task = (ScatterTask*) data;
+  
+  for (size_t t=begin; t<end; ++t)
+  {
+    const unsigned int *tri = &(task->triangles[3 * t]);
+    
+    const float *p0 = task->points + 3 * size_t(tri[0]);
+    const float *p1 = task->points + 3 * size_t(tri[1]);
+    const float *p2 = task->points + 3 * size_t(tri[2]);
+    
+    float e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+    float e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+    float c[3];
+    
+    Cross(e1, e2, c);
+    
+    double w = 0.5 * sqrt(double(Dot(c, c)));
+    
+    if (task->density)
+    {
+      double d = (task->varying ? (task->density[tri[0]] + task->density[tri[1]] + task->density[tri[2]]) / 3.0
+                                : task->density[task->triangleFaces[t]]);
+      
+      w = (d > 0.0 ? w * d : 0.0);
+    }
+    
+    task->cdf[t] = w;
+  }
+}
+
+// Stratified triangle selection along the weight CDF, uniform barycentric coordinates
+static void ScatterSamples(size_t begin, size_t end, void *data)
+{
+  ScatterTask *task = (ScatterTask*) data;
+  
+  size_t ntris = task->cdf.size();
+  
+  for (size_t i=begin; i<end; ++i)
+  {
+    double u = (double(i) + PyProcRandom(task->seed, i, 0)) / double(task->count) * task->total;
+    
+    size_t t = size_t(std::upper_bound(task->cdf.begin(), task->cdf.end(), u) - task->cdf.begin());
+    
+    if (t >= ntris)
+    {
+      t = ntris - 1;
+    }
+    
+    float s = float(sqrt(PyProcRandom(task->seed, i, 1)));
+    float r = float(PyProcRandom(task->seed, i, 2));
+    float b[3] = {1.0f - s, s * (1.0f - r), s * r};
+    
+    const unsigned int *tri = &(task->triangles[3 * t]);
+    
+    float *p = &(task->outPoints[3 * i]);
+    float *n = &(task->outNormals[3 * i]);
+    
+    p[0] = p[1] = p[2] = 0.0f;
+    n[0] = n[1] = n[2] = 0.0f;
+    
+    for (int k=0; k<3; ++k)
+    {
+      const float *x = task->points + 3 * size_t(tri[k]);
+      
+      p[0] += b[k] * x[0];
+      p[1] += b[k] * x[1];
+      p[2] += b[k] * x[2];
+      
+      if (task->normals)
+      {
+        x = task->normals + 3 * size_t(tri[k]);
+        
+        n[0] += b[k] * x[0];
+        n[1] += b[k] * x[1];
+        n[2] += b[k] * x[2];
+      }
+    }
+    
+    if (!task->normals)
+    {
+      const float *p0 = task->points + 3 * size_t(tri[0]);
+      const float *p1 = task->points + 3 * size_t(tri[1]);
+      const float *p2 = task->points + 3 * size_t(tri[2]);
+      
+      float e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+      float e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+      
+      Cross(e1, e2, n);
+    }
+    
+    float l = sqrtf(Dot(n, n));
+    
+    if (l > 0.0f)
+    {
+      n[0] /= l;
+      n[1] /= l;
+      n[2] /= l;
+    }
+    
+    task->outFaces[i] = task->triangleFaces[t];
+  }
+}
+
+// Open addressing hash grid cell, 'head' is the first sample in the cell (-1 if free)
+struct GridCell
+{
+  int x, y, z;
+  int head;
+};
+
+static inline size_t FindCell(const std::vector<GridCell> &cells, int x, int y, int z)
+{
+  size_t mask = cells.size() - 1;
+  size_t h = size_t((unsigned int)(x * 73856093) ^ (unsigned int)(y * 19349663) ^ (unsigned int)(z * 83492791)) & mask;
+  
+  while (cells[h].head >= 0 && (cells[h].x != x || cells[h].y != y || cells[h].z != z))
+  {
+    h = (h + 1) & mask;
+  }
+  
+  return h;
+}
+
+// Dart throwing over the samples in a random (seeded) order on a hash grid of
+//   'radius' sized cells, keeps the samples with no kept neighbour closer than 'radius'
+static void PoissonReject(ScatterTask &task, float radius, std::vector<bool> &keep)
+{
+  size_t n = task.count;
+  
+  std::vector< std::pair<unsigned long long, unsigned int> > order(n);
+  
+  for (size_t i=0; i<n; ++i)
+  {
+    order[i].first = PyProcMix64(task.seed ^ PyProcMix64((i << 2) | 3));
+    order[i].second = (unsigned int) i;
+  }
+  
+  std::sort(order.begin(), order.end());
+  
+  size_t capacity = 16;
+  
+  while (capacity < 2 * n)
+  {
+    capacity <<= 1;
+  }
+  
+  GridCell empty = {0, 0, 0, -1};
+  
+  std::vector<GridCell> cells(capacity, empty);
+  std::vector<int> next(n, -1);
+  
+  float r2 = radius * radius;
+  float inv = 1.0f / radius;
+  
+  keep.assign(n, false);
+  
+  for (size_t o=0; o<n; ++o)
+  {
+    unsigned int i = order[o].second;
+    
+    const float *p = &(task.outPoints[3 * size_t(i)]);
+    
+    int cx = int(floorf(p[0] * inv));
+    int cy = int(floorf(p[1] * inv));
+    int cz = int(floorf(p[2] * inv));
+    
+    bool reject = false;
+    
+    for (int dz=-1; dz<=1 && !reject; ++dz)
+    {
+      for (int dy=-1; dy<=1 && !reject; ++dy)
+      {
+        for (int dx=-1; dx<=1 && !reject; ++dx)
+        {
+          size_t h = FindCell(cells, cx + dx, cy + dy, cz + dz);
+          
+          for (int j=cells[h].head; j>=0 && !reject; j=next[j])
+          {
+            const float *q = &(task.outPoints[3 * size_t(j)]);
+            
+            float d[3] = {p[0] - q[0], p[1] - q[1], p[2] - q[2]};
+            
+            reject = (Dot(d, d) < r2);
+          }
+        }
+      }
+    }
+    
+    if (reject)
+    {
+      continue;
+    }
+    
+    size_t h = FindCell(cells, cx, cy, cz);
+    
+    cells[h].x = cx;
+    cells[h].y = cy;
+    cells[h].z = cz;
+    
+    next[i] = cells[h].head;
+    cells[h].head = int(i);
+    
+    keep[i] = true;
+  }
+}
+
+// --- Bounds
+
+struct BoundsTask
+{
+  const float *points;
+  size_t count;
+  size_t chunk;
+  std::vector<float> bounds;
+};
+
+static void ChunkBounds(size_t begin, size_t end, void *data)
+{
+  BoundsTask *task = (BoundsTask*) data;
+  
+  for (size_t c=begin; c<end; ++c)
+  {
+    size_t first = c * task->chunk;
+    size_t last = first + task->chunk;
+    
+    if (last > task->count)
+    {
+      last = task->count;
+    }
+    
+    float *b = &(task->bounds[6 * c]);
+    
+    b[0] = b[1] = b[2] = FLT_MAX;
+    b[3] = b[4] = b[5] = -FLT_MAX;
+    
+    PyProcBounds(task->points + 3 * first, last - first, b, b + 3);
+  }
+}
+
+// ---
+
+static const size_t gsGrain = 16384;
+
+static PyObject* PyProc_Bounds(PyObject *, PyObject *args)
+{
+  PyObject *pobj = 0;
+  
+  if (!PyArg_ParseTuple(args, "O", &pobj))
+  {
+    return NULL;
+  }
+  
+  Values<float> points;
+  
+  if (!points.acquire(pobj, "points", 3))
+  {
+    return NULL;
+  }
+  
+  if (points.count() == 0)
+  {
+    PyErr_SetString(PyExc_ValueError, "No points");
+    return NULL;
+  }
+  
+  BoundsTask task;
+  
+  task.count = points.count();
+  task.chunk = 4 * gsGrain;
+  
+  size_t nchunks = (task.count + task.chunk - 1) / task.chunk;
+  
+  task.bounds.resize(6 * nchunks);
+  
+  Py_BEGIN_ALLOW_THREADS
+  
+  points.prepare();
+  
+  task.points = points.data();
+  
+  PyProcParallelFor(nchunks, 1, ChunkBounds, &task);
+  
+  for (size_t c=1; c<nchunks; ++c)
+  {
+    for (int i=0; i<3; ++i)
+    {
+      if (task.bounds[6 * c + i] < task.bounds[i]) task.bounds[i] = task.bounds[6 * c + i];
+      if (task.bounds[6 * c + 3 + i] > task.bounds[3 + i]) task.bounds[3 + i] = task.bounds[6 * c + 3 + i];
+    }
+  }
+  
+  Py_END_ALLOW_THREADS
+  
+  const float *b = &(task.bounds[0]);
+  
+  return Py_BuildValue("((fff)(fff))", b[0], b[1], b[2], b[3], b[4], b[5]);
+}
+
+static PyObject* PyProc_Normals(PyObject *, PyObject *args, PyObject *kwargs)
+{
+  static char *kwlist[] = {(char*)"points", (char*)"indices", (char*)"face_counts", NULL};
+  
+  PyObject *pobj = 0;
+  PyObject *iobj = 0;
+  PyObject *cobj = Py_None;
+  
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OO|O", kwlist, &pobj, &iobj, &cobj))
+  {
+    return NULL;
+  }
+  
+  Values<float> points;
+  Values<unsigned int> indices;
+  Values<unsigned int> counts;
+  
+  if (!points.acquire(pobj, "points", 3) || !indices.acquire(iobj, "indices", 1) ||
+      (cobj != Py_None && !counts.acquire(cobj, "face_counts", 1)))
+  {
+    return NULL;
+  }
+  
+  AtArray *ary = AiArrayAllocate((AtUInt32) points.count(), 1, AI_TYPE_VECTOR);
+  
+  if (!ary)
+  {
+    PyErr_SetString(PyExc_MemoryError, "Failed to allocate normals array");
+    return NULL;
+  }
+  
+  Topology topo;
+  NormalsTask task;
+  std::string err;
+  bool rv = false;
+  
+  Py_BEGIN_ALLOW_THREADS
+  
+  points.prepare();
+  indices.prepare();
+  counts.prepare();
+  
+  rv = BuildTopology(indices.data(), indices.count(), counts.data(), counts.count(), points.count(), topo, err);
+  
+  if (rv)
+  {
+    task.points = points.data();
+    task.indices = indices.data();
+    task.topo = &topo;
+    task.faceNormals.resize(4 * topo.numFaces());
+    task.pointNormals.resize(4 * points.count());
+    task.out = (float*) ary->data;
+    
+    PyProcParallelFor(topo.numFaces(), gsGrain, FaceNormals, &task);
+    PyProcParallelFor(points.count(), gsGrain, PointNormals, &task);
+  }
+  
+  Py_END_ALLOW_THREADS
+  
+  if (!rv)
+  {
+    AiArrayDestroy(ary);
+    PyErr_Format(PyExc_ValueError, "normals: %s", err.c_str());
+    return NULL;
+  }
+  
+  return PyProcArrayWrap(ary);
+}
+
+static PyObject* PyProc_Tangents(PyObject *, PyObject *args, PyObject *kwargs)
+{
+  static char *kwlist[] = {(char*)"points", (char*)"normals", (char*)"uvs", (char*)"indices",
+                           (char*)"face_counts", (char*)"uv_indices", NULL};
+  
+  PyObject *pobj = 0;
+  PyObject *nobj = 0;
+  PyObject *uobj = 0;
+  PyObject *iobj = 0;
+  PyObject *cobj = Py_None;
+  PyObject *uiobj = Py_None;
+  
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OOOO|OO", kwlist, &pobj, &nobj, &uobj, &iobj, &cobj, &uiobj))
+  {
+    return NULL;
+  }
+  
+  Values<float> points;
+  Values<float> normals;
+  Values<float> uvs;
+  Values<unsigned int> indices;
+  Values<unsigned int> counts;
+  Values<unsigned int> uvIndices;
+  
+  if (!points.acquire(pobj, "points", 3) || !normals.acquire(nobj, "normals", 3) ||
+      !uvs.acquire(uobj, "uvs", 2) || !indices.acquire(iobj, "indices", 1) ||
+      (cobj != Py_None && !counts.acquire(cobj, "face_counts", 1)) ||
+      (uiobj != Py_None && !uvIndices.acquire(uiobj, "uv_indices", 1)))
+  {
+    return NULL;
+  }
+  
+  if (normals.count() != points.count())
+  {
+    PyErr_SetString(PyExc_ValueError, "tangents: Expected one normal per point");
+    return NULL;
+  }
+  
+  if (uvIndices.valid() ? (uvIndices.count() != indices.count()) : (uvs.count() < points.count()))
+  {
+    PyErr_SetString(PyExc_ValueError, (uvIndices.valid() ? "tangents: Expected one uv index per point index"
+                                                         : "tangents: Expected one uv per point"));
+    return NULL;
+  }
+  
+  AtArray *tary = AiArrayAllocate((AtUInt32) points.count(), 1, AI_TYPE_VECTOR);
+  AtArray *bary = AiArrayAllocate((AtUInt32) points.count(), 1, AI_TYPE_VECTOR);
+  
+  if (!tary || !bary)
+  {
+    if (tary) AiArrayDestroy(tary);
+    if (bary) AiArrayDestroy(bary);
+    PyErr_SetString(PyExc_MemoryError, "Failed to allocate tangents arrays");
+    return NULL;
+  }
+  
+  Topology topo;
+  TangentsTask task;
+  std::string err;
+  bool rv = false;
+  
+  Py_BEGIN_ALLOW_THREADS
+  
+  points.prepare();
+  normals.prepare();
+  uvs.prepare();
+  indices.prepare();
+  counts.prepare();
+  uvIndices.prepare();
+  
+  rv = BuildTopology(indices.data(), indices.count(), counts.data(), counts.count(), points.count(), topo, err);
+  
+  for (size_t i=0; rv && i<uvIndices.count(); ++i)
+  {
+    if (uvIndices.data()[i] >= uvs.count())
+    {
+      char msg[128];
+      sprintf(msg, "UV index %lu out of range (%u >= %lu)", (unsigned long) i, uvIndices.data()[i], (unsigned long) uvs.count());
+      err = msg;
+      rv = false;
+    }
+  }
+  
+  if (rv)
+  {
+    task.points = points.data();
+    task.normals = normals.data();
+    task.uvs = uvs.data();
+    task.indices = indices.data();
+    task.uvIndices = (uvIndices.valid() ? uvIndices.data() : 0);
+    task.topo = &topo;
+    task.faceTangents.resize(4 * topo.numFaces());
+    task.faceBitangents.resize(4 * topo.numFaces());
+    task.pointTangents.resize(4 * points.count());
+    task.pointBitangents.resize(4 * points.count());
+    task.outTangents = (float*) tary->data;
+    task.outBitangents = (float*) bary->data;
+    
+    PyProcParallelFor(topo.numFaces(), gsGrain, FaceTangents, &task);
+    PyProcParallelFor(points.count(), gsGrain, PointTangents, &task);
+  }
+  
+  Py_END_ALLOW_THREADS
+  
+  if (!rv)
+  {
+    AiArrayDestroy(tary);
+    AiArrayDestroy(bary);
+    PyErr_Format(PyExc_ValueError, "tangents: %s", err.c_str());
+    return NULL;
+  }
+  
+  PyObject *pyt = PyProcArrayWrap(tary);
+  
+  if (!pyt)
+  {
+    AiArrayDestroy(bary);
+    return NULL;
+  }
+  
+  PyObject *pyb = PyProcArrayWrap(bary);
+  
+  if (!pyb)
+  {
+    Py_DECREF(pyt);
+    return NULL;
+  }
+  
+  PyObject *rt = PyTuple_New(2);
+  
+  PyTuple_SetItem(rt, 0, pyt);
+  PyTuple_SetItem(rt, 1, pyb);
+  
+  return rt;
+}
+
+static PyObject* PyProc_Scatter(PyObject *, PyObject *args, PyObject *kwargs)
+{
+  static char *kwlist[] = {(char*)"points", (char*)"indices", (char*)"count", (char*)"rate",
+                           (char*)"face_counts", (char*)"density", (char*)"density_scope",
+                           (char*)"normals", (char*)"seed", (char*)"min_distance", NULL};
+  
+  PyObject *pobj = 0;
+  PyObject *iobj = 0;
+  Py_ssize_t count = 0;
+  double rate = 0.0;
+  PyObject *cobj = Py_None;
+  PyObject *dobj = Py_None;
+  const char *scope = "varying";
+  PyObject *nobj = Py_None;
+  unsigned long long seed = 0;
+  float minDistance = 0.0f;
+  
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OO|ndOOsOKf", kwlist, &pobj, &iobj, &count, &rate,
+                                   &cobj, &dobj, &scope, &nobj, &seed, &minDistance))
+  {
+    return NULL;
+  }
+  
+  if ((count > 0) == (rate > 0.0))
+  {
+    PyErr_SetString(PyExc_ValueError, "scatter: Expected either a positive 'count' or a positive 'rate'");
+    return NULL;
+  }
+  
+  bool varying = (strcmp(scope, "varying") == 0);
+  
+  if (!varying && strcmp(scope, "uniform") != 0)
+  {
+    PyErr_Format(PyExc_ValueError, "scatter: Invalid density scope \"%s\" (expected \"uniform\" or \"varying\")", scope);
+    return NULL;
+  }
+  
+  Values<float> points;
+  Values<unsigned int> indices;
+  Values<unsigned int> counts;
+  Values<float> density;
+  Values<float> normals;
+  
+  if (!points.acquire(pobj, "points", 3) || !indices.acquire(iobj, "indices", 1) ||
+      (cobj != Py_None && !counts.acquire(cobj, "face_counts", 1)) ||
+      (dobj != Py_None && !density.acquire(dobj, "density", 1)) ||
+      (nobj != Py_None && !normals.acquire(nobj, "normals", 3)))
+  {
+    return NULL;
+  }
+  
+  if (normals.valid() && normals.count() != points.count())
+  {
+    PyErr_SetString(PyExc_ValueError, "scatter: Expected one normal per point");
+    return NULL;
+  }
+  
+  Topology topo;
+  ScatterTask task;
+  std::vector<bool> keep;
+  size_t nkeep = 0;
+  std::string err;
+  bool rv = false;
+  
+  Py_BEGIN_ALLOW_THREADS
+  
+  points.prepare();
+  indices.prepare();
+  counts.prepare();
+  density.prepare();
+  normals.prepare();
+  
+  rv = BuildTopology(indices.data(), indices.count(), counts.data(), counts.count(), points.count(), topo, err, false);
+  
+  if (rv && density.valid() && density.count() != (varying ? points.count() : topo.numFaces()))
+  {
+    err = (varying ? "Expected one density value per point" : "Expected one density value per face");
+    rv = false;
+  }
+  
+  if (rv)
+  {
+    const unsigned int *idx = indices.data();
+    
+    for (size_t f=0; f<topo.numFaces(); ++f)
+    {
+      for (unsigned int i=topo.faceStart[f]+1; i+1<topo.faceStart[f+1]; ++i)
+      {
+        task.triangles.push_back(idx[topo.faceStart[f]]);
+        task.triangles.push_back(idx[i]);
+        task.triangles.push_back(idx[i+1]);
+        task.triangleFaces.push_back((unsigned int) f);
+      }
+    }
+    
+    task.points = points.data();
+    task.normals = (normals.valid() ? normals.data() : 0);
+    task.density = (density.valid() ? density.data() : 0);
+    task.varying = varying;
+    task.seed = seed;
+    task.cdf.resize(task.triangleFaces.size());
+    
+    PyProcParallelFor(task.cdf.size(), gsGrain, TriangleWeights, &task);
+    
+    task.total = 0.0;
+    
+    for (size_t t=0; t<task.cdf.size(); ++t)
+    {
+      task.total += task.cdf[t];
+      task.cdf[t] = task.total;
+    }
+    
+    task.count = (count > 0 ? size_t(count) : size_t(task.total * rate + 0.5));
+    
+    if (task.total <= 0.0)
+    {
+      task.count = 0;
+    }
+    
+    task.outPoints.resize(3 * task.count);
+    task.outNormals.resize(3 * task.count);
+    task.outFaces.resize(task.count);
+    
+    PyProcParallelFor(task.count, gsGrain, ScatterSamples, &task);
+    
+    if (minDistance > 0.0f)
+    {
+      PoissonReject(task, minDistance, keep);
+    }
+    else
+    {
+      keep.assign(task.count, true);
+    }
+    
+    for (size_t i=0; i<task.count; ++i)
+    {
+      if (!keep[i])
+      {
+        continue;
+      }
+      
+      if (nkeep != i)
+      {
+        memcpy(&(task.outPoints[3 * nkeep]), &(task.outPoints[3 * i]), 3 * sizeof(float));
+        memcpy(&(task.outNormals[3 * nkeep]), &(task.outNormals[3 * i]), 3 * sizeof(float));
+        task.outFaces[nkeep] = task.outFaces[i];
+      }
+      
+      ++nkeep;
+    }
+  }
+  
+  Py_END_ALLOW_THREADS
+  
+  if (!rv)
+  {
+    PyErr_Format(PyExc_ValueError, "scatter: %s", err.c_str());
+    return NULL;
+  }
+  
+  AtArray *pary = AiArrayConvert((AtUInt32) nkeep, 1, AI_TYPE_POINT, (nkeep > 0 ? &(task.outPoints[0]) : 0));
+  AtArray *nary = AiArrayConvert((AtUInt32) nkeep, 1, AI_TYPE_VECTOR, (nkeep > 0 ? &(task.outNormals[0]) : 0));
+  AtArray *fary = AiArrayConvert((AtUInt32) nkeep, 1, AI_TYPE_UINT, (nkeep > 0 ? &(task.outFaces[0]) : 0));
+  
+  PyObject *rt = PyTuple_New(3);
+  
+  PyObject *pyp = PyProcArrayWrap(pary);
+  PyObject *pyn = PyProcArrayWrap(nary);
+  PyObject *pyf = PyProcArrayWrap(fary);
+  
+  if (!rt || !pyp || !pyn || !pyf)
+  {
+    Py_XDECREF(rt);
+    Py_XDECREF(pyp);
+    Py_XDECREF(pyn);
+    Py_XDECREF(pyf);
+    return NULL;
+  }
+  
+  PyTuple_SetItem(rt, 0, pyp);
+  PyTuple_SetItem(rt, 1, pyn);
+  PyTuple_SetItem(rt, 2, pyf);
+  
+  return rt;
+}
+
+static PyObject* PyProc_Simd(PyObject *, PyObject *)
+{
+  return PyString_FromString(PyProcSimdName(PyProcSimdLevel()));
+}
+
+static PyMethodDef gsKernelsMethods[] =
+{
+  {"bounds", (PyCFunction)PyProc_Bounds, METH_VARARGS, "bounds(points)"},
+  {"normals", (PyCFunction)PyProc_Normals, METH_VARARGS | METH_KEYWORDS, "normals(points, indices, face_counts=None)"},
+  {"tangents", (PyCFunction)PyProc_Tangents, METH_VARARGS | METH_KEYWORDS, "tangents(points, normals, uvs, indices, face_counts=None, uv_indices=None)"},
+  {"scatter", (PyCFunction)PyProc_Scatter, METH_VARARGS | METH_KEYWORDS, "scatter(points, indices, count=0, rate=0.0, face_counts=None, density=None, density_scope='varying', normals=None, seed=0, min_distance=0.0)"},
+  {"simd", (PyCFunction)PyProc_Simd, METH_NOARGS, "simd()"},
+  {NULL, NULL, 0, NULL}
+};
+
+bool PyProcKernelsInit(PyObject *mod)
+{
+  for (PyMethodDef *def = gsKernelsMethods; def->ml_name; ++def)
+  {
+    PyObject *func = PyCFunction_New(def, NULL);
+    
+    if (!func || PyModule_AddObject(mod, def->ml_name, func) != 0)
+    {
+      return false;
+    }
+  }
+  
+  return true;
+}
@@ -0,0 +1,73 @@
+/*
+Copyright (c) 2016 Gaetan Guidet
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef __pyproc_kernels_h__
+#define __pyproc_kernels_h__
+
+#include <Python.h>
+#include <cstddef>
+
+// Native mesh kernels, inputs are buffer protocol objects (numpy arrays, pyproc.Array...)
+//   read without copy when they already hold 32 bits floats / integers
+// Work runs with the GIL released, split over threads for large meshes, using SSE or
+//   AVX code paths depending on the CPU (see simd.h)
+//
+// pyproc.bounds(points)
+//   ((xmin, ymin, zmin), (xmax, ymax, zmax)) of a buffer of 3 floats per point
+//
+// pyproc.normals(points, indices, face_counts=None)
+//   Area weighted smooth vertex normals as a 'vector' pyproc.Array with one element
+//   per point (use indices as 'nidxs'), unreferenced points get a null normal
+//   Faces are triangles unless face_counts ('nsides') is given
+//
+// pyproc.tangents(points, normals, uvs, indices, face_counts=None, uv_indices=None)
+//   Per point (tangents, bitangents) 'vector' pyproc.Array pair, orthonormal to the
+//   given per point normals and following the u and v directions of the uvs
+//   uvs are indexed by uv_indices ('uvidxs') when given, by indices otherwise
+//
+// pyproc.scatter(points, indices, count=0, rate=0.0, face_counts=None, density=None,
+//                density_scope='varying', normals=None, seed=0, min_distance=0.0)
+//   Distribute 'count' points (or 'rate' points per unit area) over the faces, by area
+//   or by area times a per point ('varying') or per face ('uniform') density
+//   Returns (positions, normals, face_ids) as 'point', 'vector' and 'uint' pyproc.Array
+//   Normals are interpolated from the given per point normals, geometric otherwise
+//   Samples come from a counter based generator keyed by (seed, sample), the result
+//   only depends on the inputs and seed, never on the thread count
+//   min_distance > 0 removes samples closer than it to an already kept one (Poisson
+//   disk rejection, processed in a seeded random order), this part runs on one thread
+//
+// pyproc.simd()
+//   Name of the instruction set used by the kernels ('avx', 'sse' or 'scalar')
+
+// Axis aligned bounds of n points (3 floats each), doesn't need the GIL
+// bmin/bmax are expanded, not reset
+void PyProcBounds(const float *points, size_t n, float bmin[3], float bmax[3]);
+
+// Normalize n 4 floats vectors (x, y, z, 0) in place, null vectors are left untouched
+// Doesn't need the GIL
+void PyProcNormalize4(float *vectors, size_t n);
+
+// All functions must be called with the GIL held
+
+bool PyProcKernelsInit(PyObject *mod);
+
+#endif
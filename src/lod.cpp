@@ -0,0 +1,277 @@
+/*
+Copyright (c) 2016 Gaetan Guidet
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "lod.h"
+#include "camera.h"
+#include "cull.h"
+#include "threads.h"
+#include <map>
+#include <vector>
+#include <cmath>
+#include <cstdlib>
+
+// ---
+
+static PYPROC_THREAD_LOCAL const PyProcLod *gsCurrentLod = 0;
+
+// Published contexts by procedural name, all access must happen with the GIL held
+// Leaked on purpose, may be used until the library is unloaded
+static std::map<std::string, const PyProcLod*> *gsLods = 0;
+
+PyProcLod::PyProcLod()
+  : mCamera(false)
+  , mBounded(false)
+  , mVisible(true)
+  , mScreenSize(0.0f)
+  , mDistance(0.0f)
+  , mQuality(1.0f)
+{
+  AiM4Identity(mObjectToWorld);
+}
+
+void PyProcLod::setup(AtNode *proc)
+{
+  AtNode *opts = AiUniverseGetOptions();
+  
+  mQuality = Quality();
+  mScreenSize = (opts ? float(AiNodeGetInt(opts, "xres")) : 0.0f);
+  mDistance = 0.0f;
+  mVisible = true;
+  
+  AiNodeGetMatrix(proc, "matrix", mObjectToWorld);
+  
+  // Deferred copies sit under the procedural that created them (see PythonDso::defer)
+  if (AiNodeLookUpUserParameter(proc, "pyproc_parent_matrix") != NULL)
+  {
+    AtMatrix local, parent;
+    
+    AiM4Copy(local, mObjectToWorld);
+    AiNodeGetMatrix(proc, "pyproc_parent_matrix", parent);
+    AiM4Mult(mObjectToWorld, local, parent);
+  }
+  
+  PyProcCamera camera;
+  
+  mCamera = camera.setup();
+  
+  AtPoint bmin = AiNodeGetPnt(proc, "min");
+  AtPoint bmax = AiNodeGetPnt(proc, "max");
+  
+  // Unset bounds are left to their (0, 0, 0) default
+  mBounded = (bmax.x >= bmin.x && bmax.y >= bmin.y && bmax.z >= bmin.z &&
+              (bmax.x > bmin.x || bmax.y > bmin.y || bmax.z > bmin.z));
+  
+  if (!mCamera || !mBounded)
+  {
+    return;
+  }
+  
+  // World space bounding sphere
+  const AtMatrix &mtx = mObjectToWorld;
+  AtPoint center, wcenter;
+  
+  center.x = 0.5f * (bmin.x + bmax.x);
+  center.y = 0.5f * (bmin.y + bmax.y);
+  center.z = 0.5f * (bmin.z + bmax.z);
+  
+  AiM4PointByMatrixMult(&wcenter, mtx, &center);
+  
+  float dx = bmax.x - center.x;
+  float dy = bmax.y - center.y;
+  float dz = bmax.z - center.z;
+  
+  float scale = 0.0f;
+  
+  for (int i=0; i<3; ++i)
+  {
+    float s = mtx[i][0] * mtx[i][0] + mtx[i][1] * mtx[i][1] + mtx[i][2] * mtx[i][2];
+    
+    if (s > scale)
+    {
+      scale = s;
+    }
+  }
+  
+  PyProcCullSettings settings;
+  
+  settings.radius = sqrtf(scale * (dx * dx + dy * dy + dz * dz));
+  
+  std::vector<unsigned int> kept;
+  
+  PyProcCull(camera, settings, &wcenter.x, 1, 3, false, kept);
+  
+  mVisible = !kept.empty();
+  mDistance = camera.distance(wcenter);
+  mScreenSize = camera.screenSize(wcenter, settings.radius);
+}
+
+void PyProcLod::publish(const std::string &name)
+{
+  if (!gsLods)
+  {
+    gsLods = new std::map<std::string, const PyProcLod*>();
+  }
+  
+  unpublish();
+  
+  mName = name;
+  
+  (*gsLods)[mName] = this;
+}
+
+void PyProcLod::unpublish()
+{
+  if (gsLods && mName.length() > 0)
+  {
+    std::map<std::string, const PyProcLod*>::iterator it = gsLods->find(mName);
+    
+    if (it != gsLods->end() && it->second == this)
+    {
+      gsLods->erase(it);
+    }
+  }
+  
+  mName = "";
+}
+
+PyObject* PyProcLod::toPython() const
+{
+  PyObject *rv = PyDict_New();
+  PyObject *val;
+  
+  PyDict_SetItemString(rv, "camera", mCamera ? Py_True : Py_False);
+  PyDict_SetItemString(rv, "bounded", mBounded ? Py_True : Py_False);
+  PyDict_SetItemString(rv, "visible", mVisible ? Py_True : Py_False);
+  
+  val = PyFloat_FromDouble(mScreenSize);
+  PyDict_SetItemString(rv, "screen_size", val);
+  Py_DECREF(val);
+  
+  val = PyFloat_FromDouble(mDistance);
+  PyDict_SetItemString(rv, "distance", val);
+  Py_DECREF(val);
+  
+  val = PyFloat_FromDouble(mQuality);
+  PyDict_SetItemString(rv, "quality", val);
+  Py_DECREF(val);
+  
+  return rv;
+}
+
+float PyProcLod::Quality()
+{
+  float quality = 1.0f;
+  
+  AtNode *opts = AiUniverseGetOptions();
+  
+  if (opts && AiNodeLookUpUserParameter(opts, "pyproc_quality") != NULL)
+  {
+    quality = AiNodeGetFlt(opts, "pyproc_quality");
+  }
+  else
+  {
+    const char *env = getenv("PYPROC_QUALITY");
+    
+    if (env)
+    {
+      quality = float(atof(env));
+    }
+  }
+  
+  return (quality < 0.0f ? 0.0f : quality);
+}
+
+const PyProcLod* PyProcLod::Current()
+{
+  return gsCurrentLod;
+}
+
+// ---
+
+PyProcLodScope::PyProcLodScope(const PyProcLod &lod)
+  : mPrevious(gsCurrentLod)
+{
+  gsCurrentLod = &lod;
+}
+
+PyProcLodScope::~PyProcLodScope()
+{
+  gsCurrentLod = mPrevious;
+}
+
+// ---
+
+static PyObject* PyProc_Lod(PyObject *, PyObject *args, PyObject *kwargs)
+{
+  static char *kwlist[] = {(char*)"name", NULL};
+  
+  const char *name = 0;
+  
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|z", kwlist, &name))
+  {
+    return NULL;
+  }
+  
+  const PyProcLod *lod = 0;
+  
+  if (!name)
+  {
+    lod = PyProcLod::Current();
+  }
+  else if (gsLods)
+  {
+    std::map<std::string, const PyProcLod*>::const_iterator it = gsLods->find(name);
+    
+    if (it != gsLods->end())
+    {
+      lod = it->second;
+    }
+  }
+  
+  if (!lod)
+  {
+    Py_RETURN_NONE;
+  }
+  
+  return lod->toPython();
+}
+
+static PyMethodDef gsLodMethods[] =
+{
+  {"lod", (PyCFunction)PyProc_Lod, METH_VARARGS | METH_KEYWORDS, "lod(name=None)"},
+  {NULL, NULL, 0, NULL}
+};
+
+bool PyProcLodInit(PyObject *mod)
+{
+  for (PyMethodDef *def = gsLodMethods; def->ml_name; ++def)
+  {
+    PyObject *func = PyCFunction_New(def, NULL);
+    
+    if (!func || PyModule_AddObject(mod, def->ml_name, func) != 0)
+    {
+      return false;
+    }
+  }
+  
+  return true;
+}
@@ -0,0 +1,132 @@
+/*
+Copyright (c) 2016 Gaetan Guidet
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef __pyproc_lod_h__
+#define __pyproc_lod_h__
+
+#include <Python.h>
+#include <ai.h>
+#include <string>
+
+// Level of detail context
+//
+// Each procedural measures itself against the render camera (see camera.h) before
+//   its Init function runs, from its 'min'/'max' bounds and first 'matrix' key,
+//   composed with its 'pyproc_parent_matrix' user parameter when set (deferred copies
+//   carry the world matrix of the procedural that created them)
+// The context of the procedural being expanded is current on the calling thread
+//   while its python functions run, like its name generator (see names.h)
+//
+// pyproc.lod(name=None)
+//   Context of the named procedural (the current one when None) as a dict, None
+//   outside of any procedural or for an unknown name
+//   'camera'     : a render camera was found
+//   'bounded'    : the procedural has valid bounds (not with load_at_init and no
+//                  min/max set)
+//   'visible'    : the bounding sphere touches the camera frustum, True when unknown
+//   'screen_size': projected diameter of the bounding sphere in pixels, the image
+//                  width when unknown or when the camera is inside the bounds
+//   'distance'   : camera to bounds center distance, 0 when unknown
+//   'quality'    : global quality level, 1 by default, lowered for fast previews
+//                  using the 'pyproc_quality' options user parameter or the
+//                  PYPROC_QUALITY environment variable
+//
+// Coroutines run on the event loop threads, where no procedural is current, and
+//   must pass their procedural name
+// Procedurals sharing their Init result (share_init) all get the one computed with
+//   the context of the first of them
+// Procedurals sharing their expansion (share_expansion) only do so within the same
+//   screen size octave, visibility and quality, and get the expansion made with the
+//   context of the first of them
+
+class PyProcLod
+{
+public:
+  
+  PyProcLod();
+  
+  // Measure a procedural node, doesn't need the GIL
+  void setup(AtNode *proc);
+  
+  // Make the context available by procedural name, GIL must be held
+  void publish(const std::string &name);
+  void unpublish();
+  
+  // Context as a dict, new reference, GIL must be held
+  PyObject* toPython() const;
+  
+  inline bool camera() const { return mCamera; }
+  inline bool bounded() const { return mBounded; }
+  inline bool visible() const { return mVisible; }
+  inline float screenSize() const { return mScreenSize; }
+  inline float distance() const { return mDistance; }
+  inline float quality() const { return mQuality; }
+  
+  // World matrix of the procedural, the transform inherited by the nodes it creates
+  inline const AtMatrix& objectToWorld() const { return mObjectToWorld; }
+  
+  // Options or environment quality level
+  static float Quality();
+  
+  // Context current on the calling thread, may be null
+  static const PyProcLod* Current();
+  
+private:
+  
+  friend class PyProcLodScope;
+  
+  PyProcLod(const PyProcLod&);
+  PyProcLod& operator=(const PyProcLod&);
+  
+private:
+  
+  std::string mName;
+  bool mCamera;
+  bool mBounded;
+  bool mVisible;
+  float mScreenSize;
+  float mDistance;
+  float mQuality;
+  AtMatrix mObjectToWorld;
+};
+
+// Make a context current on the calling thread for the scope lifetime
+class PyProcLodScope
+{
+public:
+  
+  PyProcLodScope(const PyProcLod &lod);
+  ~PyProcLodScope();
+  
+private:
+  
+  PyProcLodScope(const PyProcLodScope&);
+  PyProcLodScope& operator=(const PyProcLodScope&);
+  
+private:
+  
+  const PyProcLod *mPrevious;
+};
+
+bool PyProcLodInit(PyObject *mod);
+
+#endif
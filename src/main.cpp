@@ -22,10 +22,447 @@ SOFTWARE.
 
 #include <Python.h>
 #include <ai.h>
+#include <pyproc.h>
+#include "module.h"
+#include "nodes.h"
+#include "batch.h"
+#include "wire.h"
+#include "names.h"
+#include "lod.h"
 #include <iostream>
 #include <string>
 #include <vector>
+#include <map>
 #include <cstring>
+#include <cstdio>
+#include <cmath>
+
+// ---
+
+// Compiled code objects for inline procedural sources ('py:' data prefix)
+// Keyed by a 64 bits FNV-1a hash of the source, all access must happen with the GIL held
+
+class CodeCache
+{
+public:
+  
+  static unsigned long long Hash(const std::string &source)
+  {
+    unsigned long long h = 14695981039346656037ULL;
+    
+    for (size_t i=0; i<source.length(); ++i)
+    {
+      h ^= (unsigned char) source[i];
+      h *= 1099511628211ULL;
+    }
+    
+    return h;
+  }
+  
+  // Returns a new reference
+  static PyObject* Get(const std::string &source, const std::string &filename, bool verbose)
+  {
+    unsigned long long h = Hash(source);
+    
+    if (!msEntries)
+    {
+      msEntries = new std::map<unsigned long long, Entry>();
+    }
+    
+    std::map<unsigned long long, Entry>::iterator it = msEntries->find(h);
+    
+    if (it != msEntries->end())
+    {
+      if (it->second.source == source)
+      {
+        if (verbose)
+        {
+          AiMsgInfo("[pyproc] Re-use compiled inline source \"%s\"", filename.c_str());
+        }
+        Py_INCREF(it->second.code);
+        return it->second.code;
+      }
+      else
+      {
+        // Hash collision, compile without caching
+        return Py_CompileString(source.c_str(), filename.c_str(), Py_file_input);
+      }
+    }
+    
+    if (verbose)
+    {
+      AiMsgInfo("[pyproc] Compile inline source \"%s\"", filename.c_str());
+    }
+    
+    PyObject *code = Py_CompileString(source.c_str(), filename.c_str(), Py_file_input);
+    
+    if (code)
+    {
+      Entry &e = (*msEntries)[h];
+      e.source = source;
+      e.code = code;
+      Py_INCREF(code);
+    }
+    
+    return code;
+  }
+  
+  static void Clear()
+  {
+    if (!msEntries)
+    {
+      return;
+    }
+    
+    std::map<unsigned long long, Entry>::iterator it = msEntries->begin();
+    
+    while (it != msEntries->end())
+    {
+      Py_DECREF(it->second.code);
+      ++it;
+    }
+    
+    delete msEntries;
+    msEntries = 0;
+  }
+  
+private:
+  
+  struct Entry
+  {
+    std::string source;
+    PyObject *code;
+  };
+  
+  // Allocated on demand so that it is still alive when the library destructor runs
+  static std::map<unsigned long long, Entry> *msEntries;
+};
+
+std::map<unsigned long long, CodeCache::Entry>* CodeCache::msEntries = 0;
+
+// ---
+
+// Init results shared by procedurals with identical script and user parameters (opt-in)
+// Keyed by a FNV-1a hash of the script and marshalled parameters, all access must happen with the GIL held
+
+class SharedInit
+{
+public:
+  
+  // Returns new references in 'module' and 'userData' on success
+  static bool Acquire(const std::string &key, PyObject *&module, PyObject *&userData)
+  {
+    if (!msEntries)
+    {
+      return false;
+    }
+    
+    std::map<unsigned long long, Entry>::iterator it = msEntries->find(CodeCache::Hash(key));
+    
+    if (it == msEntries->end() || it->second.key != key)
+    {
+      return false;
+    }
+    
+    it->second.refs += 1;
+    
+    module = it->second.module;
+    userData = it->second.userData;
+    
+    Py_INCREF(module);
+    Py_INCREF(userData);
+    
+    return true;
+  }
+  
+  // Register a successful Init result, the caller holds the first reference
+  // Returns false when the slot is already taken (concurrent Init or hash collision)
+  static bool Add(const std::string &key, PyObject *module, PyObject *userData)
+  {
+    if (!msEntries)
+    {
+      msEntries = new std::map<unsigned long long, Entry>();
+    }
+    
+    unsigned long long h = CodeCache::Hash(key);
+    
+    if (msEntries->find(h) != msEntries->end())
+    {
+      return false;
+    }
+    
+    Entry &e = (*msEntries)[h];
+    e.key = key;
+    e.module = module;
+    e.userData = userData;
+    e.refs = 1;
+    
+    Py_INCREF(module);
+    Py_INCREF(userData);
+    
+    return true;
+  }
+  
+  // Returns true if this was the last reference
+  static bool Release(const std::string &key)
+  {
+    if (!msEntries)
+    {
+      return true;
+    }
+    
+    std::map<unsigned long long, Entry>::iterator it = msEntries->find(CodeCache::Hash(key));
+    
+    if (it == msEntries->end() || it->second.key != key)
+    {
+      return true;
+    }
+    
+    if (--(it->second.refs) > 0)
+    {
+      return false;
+    }
+    
+    Py_DECREF(it->second.userData);
+    Py_DECREF(it->second.module);
+    
+    msEntries->erase(it);
+    
+    return true;
+  }
+  
+  static void Clear()
+  {
+    if (!msEntries)
+    {
+      return;
+    }
+    
+    std::map<unsigned long long, Entry>::iterator it = msEntries->begin();
+    
+    while (it != msEntries->end())
+    {
+      Py_DECREF(it->second.userData);
+      Py_DECREF(it->second.module);
+      ++it;
+    }
+    
+    delete msEntries;
+    msEntries = 0;
+  }
+  
+private:
+  
+  struct Entry
+  {
+    std::string key;
+    PyObject *module;
+    PyObject *userData;
+    int refs;
+  };
+  
+  // Allocated on demand so that it is still alive when the library destructor runs
+  static std::map<unsigned long long, Entry> *msEntries;
+};
+
+std::map<unsigned long long, SharedInit::Entry>* SharedInit::msEntries = 0;
+
+// ---
+
+// Expansions shared by procedurals with identical script and user parameters (opt-in)
+// The first procedural expanding a key keeps its shapes as hidden prototypes, the others
+//   only create ginstance nodes of them (see PythonDso::shareExpansion)
+// Procedurals arriving while the first one still expands wait on the key gate, a
+//   critical section held by the expanding thread until it publishes
+// Keyed like SharedInit plus a level of detail bucket (screen size octave, visibility
+//   and quality, see pyproc.lod), procedurals of a bucket all get the expansion made
+//   with the detail level of the first of them
+// All access must happen with the GIL held (but Wait)
+
+class SharedExpansion
+{
+public:
+  
+  enum State
+  {
+    Expand = 0,  // caller owns the expansion and must Publish it with the returned gate
+    Instance,    // 'prototypes' and 'visibility' are filled
+    Pending,     // being expanded, Wait on the returned gate then Release it
+    Busy         // hash collision, expand without sharing
+  };
+  
+  struct Gate
+  {
+    AtCritSec lock;
+    int refs;
+  };
+  
+  static State Acquire(const std::string &key, std::vector<AtNode*> &prototypes, std::vector<AtByte> &visibility, Gate *&gate)
+  {
+    gate = 0;
+    
+    if (!msEntries)
+    {
+      msEntries = new std::map<unsigned long long, Entry>();
+    }
+    
+    unsigned long long h = CodeCache::Hash(key);
+    
+    std::map<unsigned long long, Entry>::iterator it = msEntries->find(h);
+    
+    if (it == msEntries->end())
+    {
+      Entry &e = (*msEntries)[h];
+      e.key = key;
+      e.ready = false;
+      e.gate = 0;
+      gate = Own(e);
+      return Expand;
+    }
+    
+    Entry &e = it->second;
+    
+    if (e.key != key)
+    {
+      return Busy;
+    }
+    
+    if (!e.ready)
+    {
+      if (!e.gate)
+      {
+        return Busy;
+      }
+      
+      gate = e.gate;
+      gate->refs += 1;
+      return Pending;
+    }
+    
+    // Node pointers don't outlive the arnold universe they were created in
+    for (size_t i=0; i<e.prototypes.size(); ++i)
+    {
+      if (AiNodeLookUpByName(e.names[i].c_str()) != e.prototypes[i])
+      {
+        e.prototypes.clear();
+        e.names.clear();
+        e.visibility.clear();
+        e.ready = false;
+        gate = Own(e);
+        return Expand;
+      }
+    }
+    
+    prototypes = e.prototypes;
+    visibility = e.visibility;
+    
+    return Instance;
+  }
+  
+  // Complete an expansion acquired with State::Expand, an empty prototype list drops the key
+  // Opens the gate for waiting procedurals
+  static void Publish(const std::string &key, const std::vector<AtNode*> &prototypes, const std::vector<AtByte> &visibility, Gate *gate)
+  {
+    AiCritSecLeave(&gate->lock);
+    
+    if (!msEntries)
+    {
+      Release(gate);
+      return;
+    }
+    
+    std::map<unsigned long long, Entry>::iterator it = msEntries->find(CodeCache::Hash(key));
+    
+    if (it == msEntries->end() || it->second.key != key)
+    {
+      Release(gate);
+      return;
+    }
+    
+    if (it->second.gate == gate)
+    {
+      it->second.gate = 0;
+    }
+    
+    Release(gate);
+    
+    if (prototypes.size() == 0)
+    {
+      msEntries->erase(it);
+      return;
+    }
+    
+    Entry &e = it->second;
+    
+    e.prototypes = prototypes;
+    e.visibility = visibility;
+    e.names.resize(prototypes.size());
+    
+    for (size_t i=0; i<prototypes.size(); ++i)
+    {
+      e.names[i] = AiNodeGetName(prototypes[i]);
+    }
+    
+    e.ready = true;
+  }
+  
+  // Block until the expanding procedural publishes, doesn't need the GIL
+  static void Wait(Gate *gate)
+  {
+    AiCritSecEnter(&gate->lock);
+    AiCritSecLeave(&gate->lock);
+  }
+  
+  // Drop a reference to a gate returned by Acquire
+  static void Release(Gate *gate)
+  {
+    if (--(gate->refs) == 0)
+    {
+      AiCritSecClose(&gate->lock);
+      delete gate;
+    }
+  }
+  
+  static void Clear()
+  {
+    if (msEntries)
+    {
+      delete msEntries;
+      msEntries = 0;
+    }
+  }
+  
+private:
+  
+  struct Entry
+  {
+    std::string key;
+    bool ready;
+    Gate *gate;
+    std::vector<AtNode*> prototypes;
+    std::vector<std::string> names;
+    std::vector<AtByte> visibility;
+  };
+  
+  // New gate held by the calling thread, referenced by the entry and the caller
+  static Gate* Own(Entry &e)
+  {
+    Gate *gate = new Gate();
+    
+    AiCritSecInit(&gate->lock);
+    AiCritSecEnter(&gate->lock);
+    
+    gate->refs = 1;
+    e.gate = gate;
+    
+    return gate;
+  }
+  
+  // Allocated on demand so that it is still alive when the library destructor runs
+  static std::map<unsigned long long, Entry> *msEntries;
+};
+
+std::map<unsigned long long, SharedExpansion::Entry>* SharedExpansion::msEntries = 0;
 
 // ---
 
@@ -184,11 +621,28 @@ private:
         
         PyEval_RestoreThread(mMainState);
         
+        PyProcModuleCleanup();
+        SharedExpansion::Clear();
+        SharedInit::Clear();
+        CodeCache::Clear();
+        
         Py_Finalize();
         
         mMainState = 0;
       }
-      else if (mRestoreState)
+      else if (Py_IsInitialized())
+      {
+        PyGILState_STATE gil = PyGILState_Ensure();
+        
+        PyProcModuleCleanup();
+        SharedExpansion::Clear();
+        SharedInit::Clear();
+        CodeCache::Clear();
+        
+        PyGILState_Release(gil);
+      }
+      
+      if (mRestoreState)
       {
         PyEval_RestoreThread(mRestoreState);
         
@@ -217,6 +671,8 @@ if sys.platform == \"win32\":\n\
   sys.path.insert(0, dlls)\n";
        
     PyRun_SimpleString(scr);
+    
+    PyProcModuleInit();
   }
   
 public:
@@ -239,15 +695,33 @@ PythonInterpreter* PythonInterpreter::msInstance = NULL;
 
 // ---
 
+
 class PythonDso
 {
 public:
   
   PythonDso(AtNode *node)
-    : mProcName("")
+    : mNode(node)
+    , mProcName("")
     , mScript("")
+    , mSource("")
+    , mInline(false)
     , mModule(0)
     , mUserData(0)
+    , mNumNodesFunc(0)
+    , mGetNodeFunc(0)
+    , mGenerateFunc(0)
+    , mGenerateName("Generate")
+    , mCleanupFunc(0)
+    , mBound(false)
+    , mNative(0)
+    , mNativeData(0)
+    , mShareInit(false)
+    , mShareExpansion(false)
+    , mShared(false)
+    , mExpanded(false)
+    , mDeferrable(false)
+    , mDeferred(false)
     , mVerbose(false)
   {
     if (AiNodeLookUpUserParameter(node, "verbose") != NULL)
@@ -256,12 +730,30 @@ public:
     }
     
     mProcName = AiNodeGetStr(node, "name");
+    mNames.setPrefix(mProcName);
     
     std::string script = AiNodeGetStr(node, "data");
     
     struct stat st;
     
-    if ((stat(script.c_str(), &st) != 0) || ((st.st_mode & S_IFREG) == 0))
+    if (script.compare(0, 3, "py:") == 0)
+    {
+      // Inline python source, never touches the filesystem
+      char label[64];
+      
+      mSource = script.substr(3);
+      mInline = true;
+      
+      sprintf(label, "<inline %016llx>", CodeCache::Hash(mSource));
+      
+      mScript = label;
+      
+      if (mVerbose)
+      {
+        AiMsgInfo("[pyproc] Using inline python source %s", mScript.c_str());
+      }
+    }
+    else if ((stat(script.c_str(), &st) != 0) || ((st.st_mode & S_IFREG) == 0))
     {
       if (mVerbose)
       {
@@ -291,7 +783,7 @@ public:
       mScript = script;
     }
     
-    if (mScript.length() > 0)
+    if (!mInline && mScript.length() > 0)
     {
       size_t p0, p1;
       
@@ -318,6 +810,50 @@ public:
         AiMsgInfo("[pyproc] Resolved script path \"%s\"", mScript.c_str());
       }
     }
+    
+    // Procedurals with the same script and user parameters share a single Init result
+    //   when 'share_init' is set or PYPROC_SHARE_INIT=1, and a single expansion
+    //   when 'share_expansion' is set or PYPROC_SHARE_EXPANSION=1
+    mShareInit = getOption(node, "share_init", "PYPROC_SHARE_INIT");
+    mShareExpansion = getOption(node, "share_expansion", "PYPROC_SHARE_EXPANSION");
+    
+    if ((mShareInit || mShareExpansion) && mScript.length() > 0)
+    {
+      static const char *skip[] = {"verbose", "share_init", "share_expansion", "pyproc_parent_matrix", 0};
+      
+      mShareKey = (mInline ? mSource : mScript);
+      mShareKey.push_back('\0');
+      
+      PyProcUserParamsKey(node, mShareKey, skip);
+    }
+    
+    // Camera based level of detail context, read by the script with pyproc.lod()
+    mLod.setup(node);
+    
+    if (mVerbose)
+    {
+      AiMsgInfo("[pyproc] Screen size %f, camera distance %f, quality %f%s", mLod.screenSize(), mLod.distance(),
+                mLod.quality(), (mLod.visible() ? "" : " (off screen)"));
+    }
+    
+    // Expansions may depend on the level of detail, only share them within the same
+    //   screen size octave, visibility and quality
+    if (mShareExpansion && mShareKey.length() > 0)
+    {
+      int octave = 0;
+      char bucket[64];
+      
+      frexp(mLod.screenSize(), &octave);
+      sprintf(bucket, "%d:%d:%d", octave, (mLod.visible() ? 1 : 0), int(floor(mLod.quality() * 100.0f + 0.5f)));
+      
+      mExpansionKey = mShareKey;
+      mExpansionKey.push_back('\0');
+      mExpansionKey += bucket;
+    }
+    
+    // Procedurals expanded at scene init may hand their expansion over to a bounded
+    //   procedural that arnold loads on demand (see defer)
+    mDeferrable = (AiNodeGetBool(node, "load_at_init") || !mLod.bounded());
   }
   
   ~PythonDso()
@@ -331,119 +867,111 @@ public:
   
   int init()
   {
+    PyProcNamesScope names(mNames);
+    PyProcLodScope lod(mLod);
+    
     PyGILState_STATE gil = PyGILState_Ensure();
     
     int rv = 0;
     
-    // Derive python module name
-    std::string modname = "pyproc_";
+    mLod.publish(mProcName);
     
-    size_t p0 = mScript.find_last_of("\\/");
-    
-    if (p0 != std::string::npos)
+    if (mShareInit && mShareKey.length() > 0 && SharedInit::Acquire(mShareKey, mModule, mUserData))
     {
-      modname += mScript.substr(p0+1);
+      if (mVerbose)
+      {
+        AiMsgInfo("[pyproc] Re-use shared \"Init\" result for module \"%s\"", mScript.c_str());
+      }
+      
+      mShared = true;
+      
+      rv = (bindNative() && bindFunctions(mNative == 0) ? 1 : 0);
+      
+      PyGILState_Release(gil);
+      
+      return rv;
     }
-    else
+    
+    if (mVerbose)
     {
-      modname += mScript;
+      AiMsgInfo("[pyproc] Loading procedural module");
     }
     
-    p0 = modname.find('.');
+    mModule = (mInline ? loadInlineModule() : loadFileModule());
     
-    if (p0 != std::string::npos)
-    {
-      modname = modname.substr(0, p0);
-    }
-    
-    PyObject *pyimp = PyImport_ImportModule("imp");
-    
-    if (pyimp == NULL)
+    if (mModule == NULL)
     {
-      AiMsgError("[pyproc] Could not import imp module");
+      AiMsgError("[pyproc] Failed to import procedural python module");
       PyErr_Print();
       PyErr_Clear();
     }
+    else if (mDeferrable && PyObject_HasAttrString(mModule, "Bounds") && defer())
+    {
+      rv = 1;
+    }
     else
     {
-      PyObject *pyload = PyObject_GetAttrString(pyimp, "load_source");
+      PyObject *func = PyObject_GetAttrString(mModule, "Init");
       
-      if (pyload == NULL)
-      {
-        AiMsgError("[pyproc] No \"load_source\" function in imp module");
-        PyErr_Print();
-        PyErr_Clear();
-        Py_DECREF(pyimp);
-      }
-      else
+      if (func)
       {
-        if (mVerbose)
-        {
-          AiMsgInfo("[pyproc] Loading procedural module");
-        }
+        PyObject *pyrv = await(PyObject_CallFunction(func, (char*)"s", mProcName.c_str()));
         
-        mModule = PyObject_CallFunction(pyload, (char*)"ss", modname.c_str(), mScript.c_str());
-        
-        if (mModule == NULL)
+        if (pyrv)
         {
-          AiMsgError("[pyproc] Failed to import procedural python module");
-          PyErr_Print();
-          PyErr_Clear();
-        }
-        else
-        {
-          PyObject *func = PyObject_GetAttrString(mModule, "Init");
-    
-          if (func)
+          if (PyTuple_Check(pyrv) && PyTuple_Size(pyrv) == 2)
           {
-            PyObject *pyrv = PyObject_CallFunction(func, (char*)"s", mProcName.c_str());
+            mUserData = PyTuple_GetItem(pyrv, 1);
             
-            if (pyrv)
-            {
-              if (PyTuple_Check(pyrv) && PyTuple_Size(pyrv) == 2)
-              {
-                mUserData = PyTuple_GetItem(pyrv, 1);
-                
-                Py_INCREF(mUserData);
-                
-                rv = PyInt_AsLong(PyTuple_GetItem(pyrv, 0));
-                
-                if (rv == -1 && PyErr_Occurred() != NULL)
-                {
-                  AiMsgError("[pyproc] Invalid return value for \"Init\" function in module \"%s\"", mScript.c_str());
-                  PyErr_Print();
-                  PyErr_Clear();
-                  
-                  rv = 0;
-                }
-              }
-              else
-              {
-                AiMsgError("[pyproc] Invalid return value for \"Init\" function in module \"%s\"", mScript.c_str());
-              }
-              
-              Py_DECREF(pyrv);
-            }
-            else
+            Py_INCREF(mUserData);
+            
+            rv = PyInt_AsLong(PyTuple_GetItem(pyrv, 0));
+            
+            if (rv == -1 && PyErr_Occurred() != NULL)
             {
-              AiMsgError("[pyproc] \"Init\" function failed in module \"%s\"", mScript.c_str());
+              AiMsgError("[pyproc] Invalid return value for \"Init\" function in module \"%s\"", mScript.c_str());
               PyErr_Print();
               PyErr_Clear();
+              
+              rv = 0;
             }
-            
-            Py_DECREF(func);
           }
           else
           {
-            AiMsgError("[pyproc] No \"Init\" function in module \"%s\"", mScript.c_str());
-            PyErr_Clear();
+            AiMsgError("[pyproc] Invalid return value for \"Init\" function in module \"%s\"", mScript.c_str());
+          }
+          
+          Py_DECREF(pyrv);
+          
+          if (rv != 0 && !bindNative())
+          {
+            rv = 0;
+          }
+          
+          if (rv != 0 && !bindFunctions(mNative == 0))
+          {
+            rv = 0;
+          }
+          
+          if (rv != 0 && mShareInit && mShareKey.length() > 0)
+          {
+            mShared = SharedInit::Add(mShareKey, mModule, mUserData);
           }
         }
+        else
+        {
+          AiMsgError("[pyproc] \"Init\" function failed in module \"%s\"", mScript.c_str());
+          PyErr_Print();
+          PyErr_Clear();
+        }
         
-        Py_DECREF(pyload);
+        Py_DECREF(func);
+      }
+      else
+      {
+        AiMsgError("[pyproc] No \"Init\" function in module \"%s\"", mScript.c_str());
+        PyErr_Clear();
       }
-      
-      Py_DECREF(pyimp);
     }
     
     PyGILState_Release(gil);
@@ -453,15 +981,69 @@ public:
   
   int numNodes()
   {
+    PyProcNamesScope names(mNames);
+    PyProcLodScope lod(mLod);
+    
+    if (mDeferred)
+    {
+      return int(mNodes.size());
+    }
+    
+    if (mExpansionKey.length() > 0)
+    {
+      return shareExpansion();
+    }
+    
+    return expand();
+  }
+  
+  AtNode* getNode(int i)
+  {
+    PyProcNamesScope names(mNames);
+    PyProcLodScope lod(mLod);
+    
+    if (mExpanded)
+    {
+      return ((i >= 0 && size_t(i) < mNodes.size()) ? mNodes[i] : 0);
+    }
+    
+    return fetch(i);
+  }
+  
+  int cleanup()
+  {
+    PyProcNamesScope names(mNames);
+    PyProcLodScope lod(mLod);
+    
+    bool deferred = mDeferred;
+    
+    mExpanded = false;
+    mDeferred = false;
+    mNodes.clear();
+    
+    if (mNative)
+    {
+      if (mNative->release)
+      {
+        mNative->release(mNativeData);
+      }
+      
+      mNative = 0;
+      mNativeData = 0;
+    }
+    
     PyGILState_STATE gil = PyGILState_Ensure();
     
     int rv = 0;
     
-    PyObject *func = PyObject_GetAttrString(mModule, "NumNodes");
-    
-    if (func)
+    if (mShared && !SharedInit::Release(mShareKey))
+    {
+      // Other procedurals still use the shared user data, Cleanup runs with the last one
+      rv = 1;
+    }
+    else if (mCleanupFunc)
     {
-      PyObject *pyrv = PyObject_CallFunction(func, (char*)"O", mUserData);
+      PyObject *pyrv = await(call(mCleanupFunc));
       
       if (pyrv)
       {
@@ -469,7 +1051,7 @@ public:
         
         if (rv == -1 && PyErr_Occurred() != NULL)
         {
-          AiMsgError("[pyproc] Invalid return value for \"NumNodes\" function in module \"%s\"", mScript.c_str());
+          AiMsgError("[pyproc] Invalid return value for \"Cleanup\" function in module \"%s\"", mScript.c_str());
           PyErr_Print();
           PyErr_Clear();
           rv = 0;
@@ -479,67 +1061,237 @@ public:
       }
       else
       {
-        AiMsgError("[pyproc] \"NumNodes\" function failed in module \"%s\"", mScript.c_str());
+        AiMsgError("[pyproc] \"Cleanup\" function failed in module \"%s\"", mScript.c_str());
         PyErr_Print();
         PyErr_Clear();
       }
-      
-      Py_DECREF(func);
     }
-    else
+    else if (mBound || deferred)
     {
-      AiMsgError("[pyproc] No \"NumNodes\" function in module \"%s\"", mScript.c_str());
-      PyErr_Clear();
+      // cleanup method is optional on procedural objects, deferred procedurals never ran Init
+      rv = 1;
+    }
+    else if (mModule)
+    {
+      AiMsgError("[pyproc] No \"Cleanup\" function in module \"%s\"", mScript.c_str());
     }
     
+    Py_XDECREF(mNumNodesFunc);
+    Py_XDECREF(mGetNodeFunc);
+    Py_XDECREF(mGenerateFunc);
+    Py_XDECREF(mCleanupFunc);
+    Py_XDECREF(mUserData);
+    Py_XDECREF(mModule);
+    
+    mNumNodesFunc = 0;
+    mGetNodeFunc = 0;
+    mGenerateFunc = 0;
+    mCleanupFunc = 0;
+    mUserData = 0;
+    mModule = 0;
+    mShared = false;
+    
+    mLod.unpublish();
+    
     PyGILState_Release(gil);
     
     return rv;
   }
   
-  AtNode* getNode(int i)
+private:
+  
+  // Boolean procedural user parameter, falling back to an environment variable when not declared
+  static bool getOption(AtNode *node, const char *param, const char *envvar)
   {
-    PyGILState_STATE gil = PyGILState_Ensure();
+    if (AiNodeLookUpUserParameter(node, param) != NULL)
+    {
+      return AiNodeGetBool(node, param);
+    }
     
-    AtNode *rv = 0;
+    const char *env = getenv(envvar);
+    
+    return (env && atoi(env) != 0);
+  }
+  
+  // Call the module Bounds function and, when it returns bounds, expand to a single
+  //   copy of this procedural using them, with load_at_init off, so that arnold only
+  //   runs Init once a ray reaches them
+  // Returns false to expand right away (no bounds or error)
+  // GIL must be held
+  bool defer()
+  {
+    PyObject *func = PyObject_GetAttrString(mModule, "Bounds");
+    
+    if (!func)
+    {
+      PyErr_Clear();
+      return false;
+    }
     
-    PyObject *func = PyObject_GetAttrString(mModule, "GetNode");
+    PyObject *pyrv = await(PyObject_CallFunction(func, (char*)"s", mProcName.c_str()));
     
-    if (func)
+    Py_DECREF(func);
+    
+    if (!pyrv)
     {
-      PyObject *pyrv = PyObject_CallFunction(func, (char*)"Oi", mUserData, i);
+      AiMsgError("[pyproc] \"Bounds\" function failed in module \"%s\"", mScript.c_str());
+      PyErr_Print();
+      PyErr_Clear();
+      return false;
+    }
+    
+    if (pyrv == Py_None)
+    {
+      Py_DECREF(pyrv);
+      return false;
+    }
+    
+    AtPoint bmin, bmax;
+    
+    bool valid = (PySequence_Check(pyrv) && PySequence_Size(pyrv) == 2);
+    
+    for (Py_ssize_t i=0; valid && i<2; ++i)
+    {
+      PyObject *item = PySequence_GetItem(pyrv, i);
+      
+      valid = (item && PyProcConvertValue(AI_TYPE_POINT, item, (i == 0 ? &bmin : &bmax)));
+      
+      Py_XDECREF(item);
+    }
+    
+    Py_DECREF(pyrv);
+    
+    if (!valid || bmax.x < bmin.x || bmax.y < bmin.y || bmax.z < bmin.z)
+    {
+      AiMsgError("[pyproc] Invalid return value for \"Bounds\" function in module \"%s\"", mScript.c_str());
+      PyErr_Clear();
+      return false;
+    }
+    
+    // The copy keeps the procedural parameters, user parameters included, and
+    //   inherits its transform, which it gets told about for its level of detail
+    AtNode *node = AiNodeClone(mNode);
+    
+    if (!node)
+    {
+      return false;
+    }
+    
+    AtMatrix identity, parent;
+    
+    AiM4Identity(identity);
+    AiM4Copy(parent, mLod.objectToWorld());
+    
+    if (AiNodeLookUpUserParameter(node, "pyproc_parent_matrix") == NULL)
+    {
+      AiNodeDeclare(node, "pyproc_parent_matrix", "constant MATRIX");
+    }
+    
+    AiNodeSetStr(node, "name", mNames.next("deferred").c_str());
+    AiNodeSetMatrix(node, "matrix", identity);
+    AiNodeSetMatrix(node, "pyproc_parent_matrix", parent);
+    AiNodeSetPnt(node, "min", bmin.x, bmin.y, bmin.z);
+    AiNodeSetPnt(node, "max", bmax.x, bmax.y, bmax.z);
+    AiNodeSetBool(node, "load_at_init", false);
+    
+    if (mVerbose)
+    {
+      AiMsgInfo("[pyproc] Defer expansion to \"%s\" within (%f, %f, %f) - (%f, %f, %f)", AiNodeGetName(node),
+                bmin.x, bmin.y, bmin.z, bmax.x, bmax.y, bmax.z);
+    }
+    
+    mNodes.clear();
+    mNodes.push_back(node);
+    
+    mExpanded = true;
+    mDeferred = true;
+    
+    return true;
+  }
+  
+  // Run the procedural NumNodes (or Generate) function
+  int expand()
+  {
+    if (mNative)
+    {
+      return mNative->numNodes(mNativeData);
+    }
+    
+    PyGILState_STATE gil = PyGILState_Ensure();
+    
+    int rv = 0;
+    
+    if (mGenerateFunc)
+    {
+      rv = generate();
+    }
+    else if (mNumNodesFunc)
+    {
+      PyObject *pyrv = await(call(mNumNodesFunc));
       
       if (pyrv)
       {
-        if (!PyString_Check(pyrv))
-        {
-          AiMsgError("[pyproc] Invalid return value for \"GetNode\" function in module \"%s\"", mScript.c_str());
-        }
-        
-        const char *nodeName = PyString_AsString(pyrv);
-        
-        rv = AiNodeLookUpByName(nodeName);
+        rv = PyInt_AsLong(pyrv);
         
-        if (rv == NULL)
+        if (rv == -1 && PyErr_Occurred() != NULL)
         {
-          AiMsgError("[pyproc] Invalid node name \"%s\" return by \"GetNode\" function in modulde \"%s\"", nodeName, mScript.c_str());
+          AiMsgError("[pyproc] Invalid return value for \"NumNodes\" function in module \"%s\"", mScript.c_str());
+          PyErr_Print();
+          PyErr_Clear();
+          rv = 0;
         }
         
         Py_DECREF(pyrv);
       }
       else
       {
-        AiMsgError("[pyproc] \"GetNode\" function failed in module \"%s\"", mScript.c_str());
+        AiMsgError("[pyproc] \"NumNodes\" function failed in module \"%s\"", mScript.c_str());
         PyErr_Print();
         PyErr_Clear();
       }
-      
-      Py_DECREF(func);
     }
-    else
+    
+    PyGILState_Release(gil);
+    
+    return rv;
+  }
+  
+  // Run the procedural GetNode function (or read the generated nodes)
+  AtNode* fetch(int i)
+  {
+    if (mNative)
     {
-      AiMsgError("[pyproc] No \"GetNode\" function in module \"%s\"", mScript.c_str());
-      PyErr_Clear();
+      return mNative->getNode(mNativeData, i);
+    }
+    
+    if (mGenerateFunc)
+    {
+      return ((i >= 0 && size_t(i) < mNodes.size()) ? mNodes[i] : 0);
+    }
+    
+    PyGILState_STATE gil = PyGILState_Ensure();
+    
+    AtNode *rv = 0;
+    
+    if (mGetNodeFunc)
+    {
+      PyObject *pyi = PyInt_FromLong(i);
+      PyObject *pyrv = await(call(mGetNodeFunc, pyi));
+      
+      Py_DECREF(pyi);
+      
+      if (pyrv)
+      {
+        rv = toNode(pyrv, "GetNode");
+        
+        Py_DECREF(pyrv);
+      }
+      else
+      {
+        AiMsgError("[pyproc] \"GetNode\" function failed in module \"%s\"", mScript.c_str());
+        PyErr_Print();
+        PyErr_Clear();
+      }
     }
     
     PyGILState_Release(gil);
@@ -547,59 +1299,502 @@ public:
     return rv;
   }
   
-  int cleanup()
+  // Expand once per share key (see SharedExpansion)
+  // The first procedural keeps the shapes it expands as hidden prototypes and instances them,
+  //   the following ones only instance the prototypes
+  int shareExpansion()
   {
+    std::vector<AtNode*> prototypes;
+    std::vector<AtByte> visibility;
+    SharedExpansion::Gate *gate = 0;
+    
     PyGILState_STATE gil = PyGILState_Ensure();
+    SharedExpansion::State state = SharedExpansion::Acquire(mExpansionKey, prototypes, visibility, gate);
+    PyGILState_Release(gil);
     
-    int rv = 0;
+    if (state == SharedExpansion::Pending)
+    {
+      if (mVerbose)
+      {
+        AiMsgInfo("[pyproc] Wait for shared expansion of module \"%s\"", mScript.c_str());
+      }
+      
+      SharedExpansion::Wait(gate);
+      
+      gil = PyGILState_Ensure();
+      
+      SharedExpansion::Release(gate);
+      
+      state = SharedExpansion::Acquire(mExpansionKey, prototypes, visibility, gate);
+      
+      if (state == SharedExpansion::Pending)
+      {
+        // Expanded again meanwhile (or by this very thread), don't wait twice
+        SharedExpansion::Release(gate);
+        gate = 0;
+        state = SharedExpansion::Busy;
+      }
+      
+      PyGILState_Release(gil);
+    }
+    
+    if (state == SharedExpansion::Busy)
+    {
+      return expand();
+    }
     
-    PyObject *func = PyObject_GetAttrString(mModule, "Cleanup");
+    std::vector<AtNode*> nodes;
     
-    if (func)
+    if (state == SharedExpansion::Expand)
     {
-      PyObject *pyrv = PyObject_CallFunction(func, (char*)"O", mUserData);
+      int n = expand();
       
-      if (pyrv)
+      for (int i=0; i<n; ++i)
       {
-        rv = PyInt_AsLong(pyrv);
+        AtNode *node = fetch(i);
         
-        if (rv == -1 && PyErr_Occurred() != NULL)
+        if (!node)
         {
-          AiMsgError("[pyproc] Invalid return value for \"Cleanup\" function in module \"%s\"", mScript.c_str());
-          PyErr_Print();
-          PyErr_Clear();
-          rv = 0;
+          continue;
         }
         
-        Py_DECREF(pyrv);
+        if (AiNodeEntryGetType(AiNodeGetNodeEntry(node)) == AI_NODE_SHAPE)
+        {
+          visibility.push_back(AiNodeGetByte(node, "visibility"));
+          prototypes.push_back(node);
+          
+          AiNodeSetByte(node, "visibility", 0);
+        }
+        
+        nodes.push_back(node);
       }
-      else
+      
+      gil = PyGILState_Ensure();
+      SharedExpansion::Publish(mExpansionKey, prototypes, visibility, gate);
+      PyGILState_Release(gil);
+      
+      if (mVerbose)
       {
-        AiMsgError("[pyproc] \"Cleanup\" function failed in module \"%s\"", mScript.c_str());
+        AiMsgInfo("[pyproc] Shared expansion of module \"%s\": %lu prototype(s)", mScript.c_str(), (unsigned long) prototypes.size());
+      }
+    }
+    else if (mVerbose)
+    {
+      AiMsgInfo("[pyproc] Re-use shared expansion of module \"%s\": %lu prototype(s)", mScript.c_str(), (unsigned long) prototypes.size());
+    }
+    
+    for (size_t i=0; i<prototypes.size(); ++i)
+    {
+      AtNode *src = prototypes[i];
+      AtNode *inst = AiNode("ginstance");
+      
+      if (!inst)
+      {
+        continue;
+      }
+      
+      AiNodeSetStr(inst, "name", mNames.next().c_str());
+      AiNodeSetPtr(inst, "node", src);
+      AiNodeSetBool(inst, "inherit_xform", true);
+      AiNodeSetByte(inst, "visibility", visibility[i]);
+      AiNodeSetByte(inst, "sidedness", AiNodeGetByte(src, "sidedness"));
+      AiNodeSetBool(inst, "receive_shadows", AiNodeGetBool(src, "receive_shadows"));
+      AiNodeSetBool(inst, "self_shadows", AiNodeGetBool(src, "self_shadows"));
+      AiNodeSetBool(inst, "opaque", AiNodeGetBool(src, "opaque"));
+      AiNodeSetBool(inst, "matte", AiNodeGetBool(src, "matte"));
+      
+      nodes.push_back(inst);
+    }
+    
+    mNodes = nodes;
+    mExpanded = true;
+    
+    return int(mNodes.size());
+  }
+  
+  // Resolve procedural callables once
+  // If Init returned an object with numNodes/getNode (or generate) methods, use its bound methods,
+  //   otherwise use the NumNodes/GetNode/Generate/Cleanup module functions
+  // NumNodes/GetNode are not required when a native function table was bound
+  // GIL must be held
+  bool bindFunctions(bool required)
+  {
+    mBound = (mUserData != Py_None &&
+              ((PyObject_HasAttrString(mUserData, "numNodes") &&
+                PyObject_HasAttrString(mUserData, "getNode")) ||
+               PyObject_HasAttrString(mUserData, "generate") ||
+               PyObject_HasAttrString(mUserData, "getNodes")));
+    
+    PyObject *obj = (mBound ? mUserData : mModule);
+    
+    mNumNodesFunc = PyObject_GetAttrString(obj, mBound ? "numNodes" : "NumNodes");
+    mGetNodeFunc = PyObject_GetAttrString(obj, mBound ? "getNode" : "GetNode");
+    mCleanupFunc = PyObject_GetAttrString(obj, mBound ? "cleanup" : "Cleanup");
+    PyErr_Clear();
+    
+    // Generate is optional, GetNodes is an alias returning a list rather than a generator
+    mGenerateName = (mBound ? "generate" : "Generate");
+    mGenerateFunc = PyObject_GetAttrString(obj, mGenerateName);
+    PyErr_Clear();
+    
+    if (!mGenerateFunc)
+    {
+      mGenerateName = (mBound ? "getNodes" : "GetNodes");
+      mGenerateFunc = PyObject_GetAttrString(obj, mGenerateName);
+      PyErr_Clear();
+    }
+    
+    if (mVerbose && mBound)
+    {
+      AiMsgInfo("[pyproc] Using procedural object methods from module \"%s\"", mScript.c_str());
+    }
+    
+    if (!required || mGenerateFunc)
+    {
+      return true;
+    }
+    
+    if (!mNumNodesFunc)
+    {
+      AiMsgError("[pyproc] No \"NumNodes\" function in module \"%s\"", mScript.c_str());
+    }
+    
+    if (!mGetNodeFunc)
+    {
+      AiMsgError("[pyproc] No \"GetNode\" function in module \"%s\"", mScript.c_str());
+    }
+    
+    return (mNumNodesFunc && mGetNodeFunc);
+  }
+  
+  // Returns a new reference, GIL must be held
+  PyObject* call(PyObject *func, PyObject *arg=NULL)
+  {
+    if (mBound)
+    {
+      return PyObject_CallFunctionObjArgs(func, arg, NULL);
+    }
+    else
+    {
+      return PyObject_CallFunctionObjArgs(func, mUserData, arg, NULL);
+    }
+  }
+  
+  // Coroutine results (generators from @pyproc.coroutine functions) are run on the
+  //   shared event loop and waited on, other results are returned as is
+  // Steals the reference to pyrv and returns a new reference, GIL must be held
+  PyObject* await(PyObject *pyrv)
+  {
+    if (pyrv == NULL || !PyProcIsCoroutine(pyrv))
+    {
+      return pyrv;
+    }
+    
+    if (mVerbose)
+    {
+      AiMsgInfo("[pyproc] Waiting on coroutine from module \"%s\"", mScript.c_str());
+    }
+    
+    PyObject *rv = PyProcAwait(pyrv);
+    
+    Py_DECREF(pyrv);
+    
+    return rv;
+  }
+  
+  // Drain the Generate iterator (or GetNodes sequence) into the node buffer
+  // GIL must be held
+  int generate()
+  {
+    mNodes.clear();
+    
+    // A coroutine GetNodes (or Generate) returns its sequence (or iterator) when done
+    PyObject *pyrv = await(call(mGenerateFunc));
+    
+    if (pyrv && PyProcIsNodeStream(pyrv))
+    {
+      // A single encoded node stream
+      PyProcApplyNodeStream(pyrv, mNodes);
+      
+      Py_DECREF(pyrv);
+      
+      return int(mNodes.size());
+    }
+    
+    PyObject *it = (pyrv ? PyObject_GetIter(pyrv) : 0);
+    
+    Py_XDECREF(pyrv);
+    
+    if (!it)
+    {
+      AiMsgError("[pyproc] \"%s\" function failed in module \"%s\"", mGenerateName, mScript.c_str());
+      PyErr_Print();
+      PyErr_Clear();
+      return 0;
+    }
+    
+    PyObject *item = PyIter_Next(it);
+    
+    while (item)
+    {
+      if (PyProcIsNodeStream(item))
+      {
+        PyProcApplyNodeStream(item, mNodes);
+      }
+      else if (!PyProcBatchNodes(item, mNodes))
+      {
+        AtNode *node = toNode(item, mGenerateName);
+        
+        if (node)
+        {
+          mNodes.push_back(node);
+        }
+      }
+      
+      Py_DECREF(item);
+      
+      item = PyIter_Next(it);
+    }
+    
+    if (PyErr_Occurred() != NULL)
+    {
+      AiMsgError("[pyproc] \"%s\" function failed in module \"%s\"", mGenerateName, mScript.c_str());
+      PyErr_Print();
+      PyErr_Clear();
+    }
+    
+    Py_DECREF(it);
+    
+    if (mVerbose)
+    {
+      AiMsgInfo("[pyproc] Generated %lu node(s)", (unsigned long) mNodes.size());
+    }
+    
+    return int(mNodes.size());
+  }
+  
+  // Convert a GetNode/Generate returned value to an arnold node
+  // Either a node name, a node address or a node specification (see nodes.h)
+  // GIL must be held
+  AtNode* toNode(PyObject *obj, const char *func)
+  {
+    AtNode *node = 0;
+    
+    if (PyProcIsNodeSpec(obj))
+    {
+      return PyProcCreateNode(obj);
+    }
+    
+    if (!PyString_Check(obj))
+    {
+      node = PyProcGetNode(obj);
+      
+      if (node == NULL)
+      {
+        AiMsgError("[pyproc] Invalid return value for \"%s\" function in module \"%s\"", func, mScript.c_str());
         PyErr_Print();
         PyErr_Clear();
       }
       
-      Py_DECREF(func);
+      return node;
     }
-    else
+    
+    const char *nodeName = PyString_AsString(obj);
+    
+    node = AiNodeLookUpByName(nodeName);
+    
+    if (node == NULL)
+    {
+      AiMsgError("[pyproc] Invalid node name \"%s\" return by \"%s\" function in modulde \"%s\"", nodeName, func, mScript.c_str());
+    }
+    
+    return node;
+  }
+  
+  // Look for a native function table exported by the procedural module (see pyproc.h)
+  // GIL must be held
+  bool bindNative()
+  {
+    PyObject *capsule = PyObject_GetAttrString(mModule, PYPROC_NATIVE_ATTR);
+    
+    if (capsule == NULL)
     {
-      AiMsgError("[pyproc] No \"Cleanup\" function in module \"%s\"", mScript.c_str());
       PyErr_Clear();
+      return true;
     }
     
-    Py_DECREF(mUserData);
-    Py_DECREF(mModule);
+    bool rv = false;
     
-    mUserData = 0;
-    mModule = 0;
+    const PyProcNativeFuncs *funcs = (const PyProcNativeFuncs*) PyCapsule_GetPointer(capsule, PYPROC_NATIVE_CAPSULE);
     
-    PyGILState_Release(gil);
+    if (funcs == NULL)
+    {
+      AiMsgError("[pyproc] Invalid \"%s\" capsule in module \"%s\"", PYPROC_NATIVE_ATTR, mScript.c_str());
+      PyErr_Print();
+      PyErr_Clear();
+    }
+    else if (funcs->version != PYPROC_NATIVE_VERSION)
+    {
+      AiMsgError("[pyproc] Unsupported native procedural version %d in module \"%s\" (expected %d)", funcs->version, mScript.c_str(), PYPROC_NATIVE_VERSION);
+    }
+    else if (!funcs->bind || !funcs->numNodes || !funcs->getNode)
+    {
+      AiMsgError("[pyproc] Incomplete native procedural function table in module \"%s\"", mScript.c_str());
+    }
+    else
+    {
+      void *data = funcs->bind(mUserData);
+      
+      if (data == NULL && PyErr_Occurred() != NULL)
+      {
+        AiMsgError("[pyproc] Native procedural bind failed in module \"%s\"", mScript.c_str());
+        PyErr_Print();
+        PyErr_Clear();
+      }
+      else
+      {
+        if (mVerbose)
+        {
+          AiMsgInfo("[pyproc] Using native procedural functions from module \"%s\"", mScript.c_str());
+        }
+        
+        mNative = funcs;
+        mNativeData = data;
+        
+        rv = true;
+      }
+    }
+    
+    Py_DECREF(capsule);
     
     return rv;
   }
   
-private:
+  // Returns a new reference, GIL must be held
+  PyObject* loadFileModule()
+  {
+    PyObject *mod = NULL;
+    
+    std::string basename = mScript;
+    std::string ext = "";
+    
+    size_t p0 = basename.find_last_of("\\/");
+    
+    if (p0 != std::string::npos)
+    {
+      basename = basename.substr(p0+1);
+    }
+    
+    p0 = basename.find('.');
+    
+    if (p0 != std::string::npos)
+    {
+      ext = basename.substr(basename.rfind('.'));
+      basename = basename.substr(0, p0);
+    }
+    
+    // Module names are keyed on the full script path so that same named scripts from
+    //   different directories get distinct sys.modules entries
+    // Compiled extension modules must end with their own name so that the interpreter
+    //   can find their init function, python uses the part after the last dot
+    char key[32];
+    
+    sprintf(key, "%016llx", CodeCache::Hash(mScript));
+    
+    const char *loader = "load_source";
+    std::string modname = "pyproc_" + basename + "_" + key;
+    
+    if (ext == ".so" || ext == ".pyd")
+    {
+      loader = "load_dynamic";
+      modname = std::string("pyproc_") + key + "." + basename;
+    }
+    else if (ext == ".pyc")
+    {
+      loader = "load_compiled";
+    }
+    
+    PyObject *pyimp = PyImport_ImportModule("imp");
+    
+    if (pyimp == NULL)
+    {
+      AiMsgError("[pyproc] Could not import imp module");
+      PyErr_Print();
+      PyErr_Clear();
+    }
+    else
+    {
+      PyObject *pyload = PyObject_GetAttrString(pyimp, loader);
+      
+      if (pyload == NULL)
+      {
+        AiMsgError("[pyproc] No \"%s\" function in imp module", loader);
+        PyErr_Print();
+        PyErr_Clear();
+      }
+      else
+      {
+        if (mVerbose)
+        {
+          AiMsgInfo("[pyproc] Import \"%s\" using imp.%s", modname.c_str(), loader);
+        }
+        
+        mod = PyObject_CallFunction(pyload, (char*)"ss", modname.c_str(), mScript.c_str());
+        
+        Py_DECREF(pyload);
+      }
+      
+      Py_DECREF(pyimp);
+    }
+    
+    return mod;
+  }
+  
+  // Returns a new reference, GIL must be held
+  // Each procedural gets its own module namespace, only the compilation is shared
+  PyObject* loadInlineModule()
+  {
+    PyObject *code = CodeCache::Get(mSource, mScript, mVerbose);
+    
+    if (code == NULL)
+    {
+      return NULL;
+    }
+    
+    char modname[64];
+    
+    sprintf(modname, "pyproc_inline_%016llx", CodeCache::Hash(mSource));
+    
+    PyObject *mod = PyModule_New(modname);
+    
+    if (mod != NULL)
+    {
+      PyObject *dict = PyModule_GetDict(mod);
+      
+      PyObject *filename = PyString_FromString(mScript.c_str());
+      
+      PyDict_SetItemString(dict, "__builtins__", PyEval_GetBuiltins());
+      PyDict_SetItemString(dict, "__file__", filename);
+      
+      Py_DECREF(filename);
+      
+      PyObject *pyrv = PyEval_EvalCode((PyCodeObject*)code, dict, dict);
+      
+      if (pyrv == NULL)
+      {
+        Py_DECREF(mod);
+        mod = NULL;
+      }
+      else
+      {
+        Py_DECREF(pyrv);
+      }
+    }
+    
+    Py_DECREF(code);
+    
+    return mod;
+  }
   
   bool findInPath(const std::string &procpath, const std::string &script, std::string &path)
   {
@@ -661,10 +1856,32 @@ private:
 
 private:
   
+  AtNode *mNode;
   std::string mProcName;
   std::string mScript;
+  std::string mSource;
+  bool mInline;
   PyObject *mModule;
   PyObject *mUserData;
+  PyObject *mNumNodesFunc;
+  PyObject *mGetNodeFunc;
+  PyObject *mGenerateFunc;
+  const char *mGenerateName;
+  PyObject *mCleanupFunc;
+  bool mBound;
+  std::vector<AtNode*> mNodes;
+  const PyProcNativeFuncs *mNative;
+  void *mNativeData;
+  PyProcNames mNames;
+  PyProcLod mLod;
+  std::string mShareKey;
+  std::string mExpansionKey;
+  bool mShareInit;
+  bool mShareExpansion;
+  bool mShared;
+  bool mExpanded;
+  bool mDeferrable;
+  bool mDeferred;
   bool mVerbose;
 };
 
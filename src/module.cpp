@@ -0,0 +1,369 @@
+/*
+Copyright (c) 2016 Gaetan Guidet
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "module.h"
+#include "batch.h"
+#include "wire.h"
+#include "array.h"
+#include "geometry.h"
+#include "particles.h"
+#include "instance.h"
+#include "names.h"
+#include "dedupe.h"
+#include "kernels.h"
+#include "cull.h"
+#include "lod.h"
+#include <ai.h>
+
+// ---
+
+// Shared event loop service for generator based coroutine entry points
+// A single loop thread steps coroutines, blocking calls submitted with pyproc.run
+//   are executed on a small pool of worker threads (PYPROC_IO_THREADS, default 8)
+// Coroutines yield futures, other coroutines or lists of those, and return their
+//   value by raising pyproc.Return(value)
+// Entry points are only run on the loop when decorated with @pyproc.coroutine, other
+//   generators they return are left to the caller
+
+static const char *gsLoopSource =
+  "import sys\n"
+  "import threading\n"
+  "import collections\n"
+  "import types\n"
+  "\n"
+  "_coroutine_codes = set()\n"
+  "\n"
+  "def coroutine(func):\n"
+  "  _coroutine_codes.add(getattr(func, \"__func__\", func).func_code)\n"
+  "  return func\n"
+  "\n"
+  "def iscoroutine(obj):\n"
+  "  return isinstance(obj, types.GeneratorType) and obj.gi_code in _coroutine_codes\n"
+  "\n"
+  "class Return(Exception):\n"
+  "  def __init__(self, value=None):\n"
+  "    super(Return, self).__init__()\n"
+  "    self.value = value\n"
+  "\n"
+  "class Future(object):\n"
+  "  def __init__(self):\n"
+  "    super(Future, self).__init__()\n"
+  "    self._lock = threading.Lock()\n"
+  "    self._event = threading.Event()\n"
+  "    self._value = None\n"
+  "    self._exc_info = None\n"
+  "    self._callbacks = []\n"
+  "\n"
+  "  def done(self):\n"
+  "    return self._event.is_set()\n"
+  "\n"
+  "  def _finish(self, value, exc_info):\n"
+  "    with self._lock:\n"
+  "      if self._event.is_set():\n"
+  "        return\n"
+  "      self._value = value\n"
+  "      self._exc_info = exc_info\n"
+  "      self._event.set()\n"
+  "      callbacks, self._callbacks = self._callbacks, []\n"
+  "    for cb in callbacks:\n"
+  "      cb(self)\n"
+  "\n"
+  "  def set_result(self, value):\n"
+  "    self._finish(value, None)\n"
+  "\n"
+  "  def set_exc_info(self, exc_info):\n"
+  "    self._finish(None, exc_info)\n"
+  "\n"
+  "  def add_done_callback(self, cb):\n"
+  "    with self._lock:\n"
+  "      if not self._event.is_set():\n"
+  "        self._callbacks.append(cb)\n"
+  "        return\n"
+  "    cb(self)\n"
+  "\n"
+  "  def result(self, timeout=None):\n"
+  "    # Untimed waits block on a lock with the GIL released, timed ones poll\n"
+  "    if timeout is None:\n"
+  "      self._event.wait()\n"
+  "    elif not self._event.wait(timeout):\n"
+  "      raise RuntimeError(\"Future timed out\")\n"
+  "    if self._exc_info is not None:\n"
+  "      raise self._exc_info[0], self._exc_info[1], self._exc_info[2]\n"
+  "    return self._value\n"
+  "\n"
+  "class EventLoop(object):\n"
+  "  def __init__(self, nworkers):\n"
+  "    super(EventLoop, self).__init__()\n"
+  "    self._ready_cond = threading.Condition()\n"
+  "    self._jobs_cond = threading.Condition()\n"
+  "    self._ready = collections.deque()\n"
+  "    self._jobs = collections.deque()\n"
+  "    self._stopped = False\n"
+  "    self._thread = threading.Thread(target=self._run, name=\"pyproc-loop\")\n"
+  "    self._threads = [self._thread]\n"
+  "    for i in xrange(max(1, nworkers)):\n"
+  "      self._threads.append(threading.Thread(target=self._work, name=\"pyproc-io-%d\" % i))\n"
+  "    for t in self._threads:\n"
+  "      t.daemon = True\n"
+  "      t.start()\n"
+  "\n"
+  "  def call_soon(self, cb, *args):\n"
+  "    with self._ready_cond:\n"
+  "      self._ready.append((cb, args))\n"
+  "      self._ready_cond.notify()\n"
+  "\n"
+  "  def run_in_executor(self, func, *args, **kwargs):\n"
+  "    f = Future()\n"
+  "    with self._jobs_cond:\n"
+  "      self._jobs.append((f, func, args, kwargs))\n"
+  "      self._jobs_cond.notify()\n"
+  "    return f\n"
+  "\n"
+  "  def submit(self, coro):\n"
+  "    f = Future()\n"
+  "    self.call_soon(self._step, coro, f, None, None)\n"
+  "    return f\n"
+  "\n"
+  "  def stop(self):\n"
+  "    self._stopped = True\n"
+  "    for cond in (self._ready_cond, self._jobs_cond):\n"
+  "      with cond:\n"
+  "        cond.notify_all()\n"
+  "    for t in self._threads:\n"
+  "      t.join(1.0)\n"
+  "\n"
+  "  def _wait(self, queue, cond):\n"
+  "    with cond:\n"
+  "      while not queue and not self._stopped:\n"
+  "        cond.wait()\n"
+  "      if not queue:\n"
+  "        return None\n"
+  "      return queue.popleft()\n"
+  "\n"
+  "  def _run(self):\n"
+  "    while True:\n"
+  "      item = self._wait(self._ready, self._ready_cond)\n"
+  "      if item is None:\n"
+  "        break\n"
+  "      cb, args = item\n"
+  "      try:\n"
+  "        cb(*args)\n"
+  "      except:\n"
+  "        sys.excepthook(*sys.exc_info())\n"
+  "\n"
+  "  def _work(self):\n"
+  "    while True:\n"
+  "      item = self._wait(self._jobs, self._jobs_cond)\n"
+  "      if item is None:\n"
+  "        break\n"
+  "      f, func, args, kwargs = item\n"
+  "      try:\n"
+  "        f.set_result(func(*args, **kwargs))\n"
+  "      except:\n"
+  "        f.set_exc_info(sys.exc_info())\n"
+  "\n"
+  "  def _step(self, coro, f, value, exc_info):\n"
+  "    try:\n"
+  "      if exc_info is not None:\n"
+  "        y = coro.throw(*exc_info)\n"
+  "      else:\n"
+  "        y = coro.send(value)\n"
+  "    except StopIteration:\n"
+  "      f.set_result(None)\n"
+  "      return\n"
+  "    except Return, e:\n"
+  "      f.set_result(e.value)\n"
+  "      return\n"
+  "    except:\n"
+  "      f.set_exc_info(sys.exc_info())\n"
+  "      return\n"
+  "    if isinstance(y, types.GeneratorType):\n"
+  "      y = self.submit(y)\n"
+  "    elif isinstance(y, (list, tuple)):\n"
+  "      y = gather(*y)\n"
+  "    if isinstance(y, Future):\n"
+  "      y.add_done_callback(lambda d: self.call_soon(self._resume, coro, f, d))\n"
+  "    else:\n"
+  "      self.call_soon(self._step, coro, f, y, None)\n"
+  "\n"
+  "  def _resume(self, coro, f, d):\n"
+  "    if d._exc_info is not None:\n"
+  "      self._step(coro, f, None, d._exc_info)\n"
+  "    else:\n"
+  "      self._step(coro, f, d._value, None)\n"
+  "\n"
+  "_loop = None\n"
+  "_loop_lock = threading.Lock()\n"
+  "\n"
+  "def get_event_loop():\n"
+  "  global _loop\n"
+  "  with _loop_lock:\n"
+  "    if _loop is None:\n"
+  "      import os\n"
+  "      try:\n"
+  "        n = int(os.environ.get(\"PYPROC_IO_THREADS\", \"8\"))\n"
+  "      except ValueError:\n"
+  "        n = 8\n"
+  "      _loop = EventLoop(n)\n"
+  "    return _loop\n"
+  "\n"
+  "def run(func, *args, **kwargs):\n"
+  "  return get_event_loop().run_in_executor(func, *args, **kwargs)\n"
+  "\n"
+  "def gather(*futures):\n"
+  "  loop = get_event_loop()\n"
+  "  futures = [loop.submit(x) if isinstance(x, types.GeneratorType) else x for x in futures]\n"
+  "  rv = Future()\n"
+  "  results = [None] * len(futures)\n"
+  "  state = {\"count\": len(futures)}\n"
+  "  lock = threading.Lock()\n"
+  "  if not futures:\n"
+  "    rv.set_result([])\n"
+  "    return rv\n"
+  "  def _done(i, d):\n"
+  "    if d._exc_info is not None:\n"
+  "      rv.set_exc_info(d._exc_info)\n"
+  "      return\n"
+  "    results[i] = d._value\n"
+  "    with lock:\n"
+  "      state[\"count\"] -= 1\n"
+  "      last = (state[\"count\"] == 0)\n"
+  "    if last:\n"
+  "      rv.set_result(results)\n"
+  "  for i, fut in enumerate(futures):\n"
+  "    fut.add_done_callback(lambda d, i=i: _done(i, d))\n"
+  "  return rv\n"
+  "\n"
+  "def wait(coro):\n"
+  "  loop = get_event_loop()\n"
+  "  if threading.current_thread() is loop._thread:\n"
+  "    raise RuntimeError(\"pyproc.wait would block the event loop thread, yield the coroutine instead\")\n"
+  "  return loop.submit(coro).result()\n"
+  "\n"
+  "def _shutdown():\n"
+  "  global _loop\n"
+  "  with _loop_lock:\n"
+  "    if _loop is not None:\n"
+  "      _loop.stop()\n"
+  "      _loop = None\n";
+
+// ---
+
+static PyMethodDef gsMethods[] =
+{
+  {NULL, NULL, 0, NULL}
+};
+
+bool PyProcModuleInit()
+{
+  PyObject *mod = Py_InitModule("pyproc", gsMethods);
+  
+  if (mod == NULL)
+  {
+    AiMsgError("[pyproc] Failed to create pyproc module");
+    PyErr_Print();
+    PyErr_Clear();
+    return false;
+  }
+  
+  PyObject *dict = PyModule_GetDict(mod);
+  
+  PyDict_SetItemString(dict, "__builtins__", PyEval_GetBuiltins());
+  
+  PyObject *pyrv = PyRun_String(gsLoopSource, Py_file_input, dict, dict);
+  
+  if (pyrv == NULL)
+  {
+    AiMsgError("[pyproc] Failed to initialize pyproc module");
+    PyErr_Print();
+    PyErr_Clear();
+    return false;
+  }
+  
+  Py_DECREF(pyrv);
+  
+  if (!PyProcBatchInit(mod) || !PyProcWireInit(mod) || !PyProcArrayInit(mod) ||
+      !PyProcGeometryInit(mod) || !PyProcParticlesInit(mod) || !PyProcInstanceInit(mod) ||
+      !PyProcNamesInit(mod) || !PyProcDedupeInit(mod) || !PyProcKernelsInit(mod) ||
+      !PyProcCullInit(mod) || !PyProcLodInit(mod))
+  {
+    AiMsgError("[pyproc] Failed to initialize pyproc module");
+    PyErr_Print();
+    PyErr_Clear();
+    return false;
+  }
+  
+  return true;
+}
+
+void PyProcModuleCleanup()
+{
+  PyObject *mod = PyImport_AddModule("pyproc");
+  
+  if (mod != NULL)
+  {
+    PyObject *pyrv = PyObject_CallMethod(mod, (char*)"_shutdown", NULL);
+    
+    Py_XDECREF(pyrv);
+  }
+  
+  PyErr_Clear();
+  
+  PyProcDedupeCleanup();
+}
+
+bool PyProcIsCoroutine(PyObject *obj)
+{
+  if (!PyGen_Check(obj))
+  {
+    return false;
+  }
+  
+  PyObject *mod = PyImport_AddModule("pyproc");
+  
+  if (mod == NULL)
+  {
+    PyErr_Clear();
+    return false;
+  }
+  
+  PyObject *pyrv = PyObject_CallMethod(mod, (char*)"iscoroutine", (char*)"O", obj);
+  
+  bool rv = (pyrv && PyObject_IsTrue(pyrv) == 1);
+  
+  Py_XDECREF(pyrv);
+  PyErr_Clear();
+  
+  return rv;
+}
+
+PyObject* PyProcAwait(PyObject *coro)
+{
+  PyObject *mod = PyImport_AddModule("pyproc");
+  
+  if (mod == NULL)
+  {
+    return NULL;
+  }
+  
+  return PyObject_CallMethod(mod, (char*)"wait", (char*)"O", coro);
+}
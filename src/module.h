@@ -0,0 +1,43 @@
+/*
+Copyright (c) 2016 Gaetan Guidet
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef __pyproc_module_h__
+#define __pyproc_module_h__
+
+#include <Python.h>
+
+// All functions must be called with the GIL held
+
+// Create the builtin 'pyproc' module available to procedural scripts
+bool PyProcModuleInit();
+
+// Stop the event loop service threads, if running, and report native builder stats
+void PyProcModuleCleanup();
+
+// Check if an object is a generator created by a @pyproc.coroutine function
+bool PyProcIsCoroutine(PyObject *obj);
+
+// Run a generator based coroutine on the shared event loop and wait for its result
+// Returns a new reference
+PyObject* PyProcAwait(PyObject *coro);
+
+#endif
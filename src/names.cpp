@@ -0,0 +1,152 @@
+/*
+Copyright (c) 2016 Gaetan Guidet
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "names.h"
+#include "threads.h"
+
+// ---
+
+static PYPROC_THREAD_LOCAL PyProcNames *gsCurrentNames = 0;
+
+PyProcNames::PyProcNames(const std::string &prefix)
+  : mPrefix(prefix), mCounter(0)
+{
+  AiCritSecInit(&mLock);
+}
+
+PyProcNames::~PyProcNames()
+{
+  AiCritSecClose(&mLock);
+}
+
+void PyProcNames::setPrefix(const std::string &prefix)
+{
+  mPrefix = prefix;
+}
+
+unsigned long PyProcNames::reserve(unsigned long count)
+{
+  AiCritSecEnter(&mLock);
+  
+  unsigned long first = mCounter;
+  mCounter += count;
+  
+  AiCritSecLeave(&mLock);
+  
+  return first;
+}
+
+void PyProcNames::format(unsigned long index, const char *hint, std::string &out) const
+{
+  static const char sDigits[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+  
+  char buf[32];
+  char *p = buf + sizeof(buf);
+  
+  *(--p) = '\0';
+  
+  do
+  {
+    *(--p) = sDigits[index % 36];
+    index /= 36;
+  } while (index > 0);
+  
+  out = mPrefix;
+  out += '|';
+  
+  if (hint && hint[0] != '\0')
+  {
+    out += hint;
+    out += '_';
+  }
+  
+  out += p;
+}
+
+std::string PyProcNames::next(const char *hint)
+{
+  std::string name;
+  
+  format(reserve(1), hint, name);
+  
+  return name;
+}
+
+PyProcNames* PyProcNames::Current()
+{
+  // Leaked on purpose, may be used until the library is unloaded
+  static PyProcNames *sDefault = new PyProcNames("pyproc");
+  
+  return (gsCurrentNames ? gsCurrentNames : sDefault);
+}
+
+// ---
+
+PyProcNamesScope::PyProcNamesScope(PyProcNames &names)
+  : mPrevious(gsCurrentNames)
+{
+  gsCurrentNames = &names;
+}
+
+PyProcNamesScope::~PyProcNamesScope()
+{
+  gsCurrentNames = mPrevious;
+}
+
+// ---
+
+static PyObject* PyProc_UniqueName(PyObject *, PyObject *args, PyObject *kwargs)
+{
+  static char *kwlist[] = {(char*)"hint", NULL};
+  
+  const char *hint = 0;
+  
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|z", kwlist, &hint))
+  {
+    return NULL;
+  }
+  
+  std::string name = PyProcNames::Current()->next(hint);
+  
+  return PyString_FromStringAndSize(name.c_str(), Py_ssize_t(name.length()));
+}
+
+static PyMethodDef gsNamesMethods[] =
+{
+  {"uniquename", (PyCFunction)PyProc_UniqueName, METH_VARARGS | METH_KEYWORDS, "uniquename(hint=None)"},
+  {NULL, NULL, 0, NULL}
+};
+
+bool PyProcNamesInit(PyObject *mod)
+{
+  for (PyMethodDef *def = gsNamesMethods; def->ml_name; ++def)
+  {
+    PyObject *func = PyCFunction_New(def, NULL);
+    
+    if (!func || PyModule_AddObject(mod, def->ml_name, func) != 0)
+    {
+      return false;
+    }
+  }
+  
+  return true;
+}
@@ -0,0 +1,98 @@
+/*
+Copyright (c) 2016 Gaetan Guidet
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef __pyproc_names_h__
+#define __pyproc_names_h__
+
+#include <Python.h>
+#include <ai.h>
+#include <string>
+
+// Unique node names
+//
+// Each procedural owns a name generator prefixed with the procedural node name
+// Generated names look like 'prefix|hint_index' ('prefix|index' without hint),
+//   the index being a base 36 counter, so names never collide across procedurals
+// The generator of the procedural being expanded is current on the calling thread
+//   while its python functions run, outside of any procedural 'pyproc' is used
+//
+// pyproc.uniquename(hint=None)
+//   Next unique name of the current procedural
+//
+// Native builders use it for nodes created with no explicit name
+
+class PyProcNames
+{
+public:
+  
+  PyProcNames(const std::string &prefix="pyproc");
+  ~PyProcNames();
+  
+  void setPrefix(const std::string &prefix);
+  
+  // Reserve 'count' consecutive indices, returns the first one, thread safe
+  unsigned long reserve(unsigned long count=1);
+  
+  // Name for a reserved index, hint may be null, doesn't need the GIL
+  void format(unsigned long index, const char *hint, std::string &out) const;
+  
+  // Reserve and format a single name
+  std::string next(const char *hint=0);
+  
+  // Generator current on the calling thread, never null
+  static PyProcNames* Current();
+  
+private:
+  
+  friend class PyProcNamesScope;
+  
+  PyProcNames(const PyProcNames&);
+  PyProcNames& operator=(const PyProcNames&);
+  
+private:
+  
+  std::string mPrefix;
+  unsigned long mCounter;
+  AtCritSec mLock;
+};
+
+// Make a generator current on the calling thread for the scope lifetime
+class PyProcNamesScope
+{
+public:
+  
+  PyProcNamesScope(PyProcNames &names);
+  ~PyProcNamesScope();
+  
+private:
+  
+  PyProcNamesScope(const PyProcNamesScope&);
+  PyProcNamesScope& operator=(const PyProcNamesScope&);
+  
+private:
+  
+  PyProcNames *mPrevious;
+};
+
+bool PyProcNamesInit(PyObject *mod);
+
+#endif
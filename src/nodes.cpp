@@ -0,0 +1,767 @@
+/*
+Copyright (c) 2016 Gaetan Guidet
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "nodes.h"
+#include "array.h"
+#include "buffer.h"
+#include "names.h"
+#include <string>
+#include <map>
+#include <cstring>
+
+// ---
+
+// Parameter types per node entry, built on first use of an entry
+// Keyed by node entry name so that a stale entry pointer is never dereferenced
+
+struct ParamInfo
+{
+  int type;
+  int elemType;
+};
+
+typedef std::map<std::string, ParamInfo> ParamTable;
+
+static std::map<std::string, ParamTable> gsParamTables;
+
+static const ParamTable& GetParamTable(const AtNodeEntry *nentry)
+{
+  std::string ename = AiNodeEntryGetName(nentry);
+  
+  std::map<std::string, ParamTable>::iterator it = gsParamTables.find(ename);
+  
+  if (it != gsParamTables.end())
+  {
+    return it->second;
+  }
+  
+  ParamTable &table = gsParamTables[ename];
+  
+  int n = AiNodeEntryGetNumParams(nentry);
+  
+  for (int i=0; i<n; ++i)
+  {
+    const AtParamEntry *pentry = AiNodeEntryGetParameter(nentry, i);
+    
+    ParamInfo info;
+    
+    info.type = AiParamGetType(pentry);
+    info.elemType = AI_TYPE_UNDEFINED;
+    
+    if (info.type == AI_TYPE_ARRAY)
+    {
+      const AtParamValue *defval = AiParamGetDefault(pentry);
+      
+      if (defval && defval->ARRAY)
+      {
+        info.elemType = defval->ARRAY->type;
+      }
+    }
+    
+    table[AiParamGetName(pentry)] = info;
+  }
+  
+  return table;
+}
+
+int PyProcEntryParamType(const AtNodeEntry *nentry, const char *param, int *elemType)
+{
+  const ParamTable &table = GetParamTable(nentry);
+  
+  ParamTable::const_iterator it = table.find(param);
+  
+  if (it != table.end())
+  {
+    if (elemType)
+    {
+      *elemType = it->second.elemType;
+    }
+    return it->second.type;
+  }
+  
+  return AI_TYPE_UNDEFINED;
+}
+
+int PyProcParamType(AtNode *node, const char *param, int *elemType)
+{
+  int type = PyProcEntryParamType(AiNodeGetNodeEntry(node), param, elemType);
+  
+  if (type != AI_TYPE_UNDEFINED)
+  {
+    return type;
+  }
+  
+  const AtUserParamEntry *upentry = AiNodeLookUpUserParameter(node, param);
+  
+  if (upentry)
+  {
+    if (elemType)
+    {
+      *elemType = AiUserParamGetArrayType(upentry);
+    }
+    return AiUserParamGetType(upentry);
+  }
+  
+  return AI_TYPE_UNDEFINED;
+}
+
+// ---
+
+size_t PyProcNumComponents(int type)
+{
+  switch (type)
+  {
+  case AI_TYPE_RGB:
+  case AI_TYPE_VECTOR:
+  case AI_TYPE_POINT:
+    return 3;
+  case AI_TYPE_RGBA:
+    return 4;
+  case AI_TYPE_POINT2:
+    return 2;
+  case AI_TYPE_MATRIX:
+    return 16;
+  default:
+    return 1;
+  }
+}
+
+AtNode* PyProcGetNode(PyObject *obj)
+{
+  AtNode *node = 0;
+  
+  if (PyString_Check(obj))
+  {
+    node = AiNodeLookUpByName(PyString_AsString(obj));
+    
+    if (!node)
+    {
+      PyErr_Format(PyExc_ValueError, "No node named \"%s\"", PyString_AsString(obj));
+    }
+    
+    return node;
+  }
+  else if (PyInt_Check(obj) || PyLong_Check(obj))
+  {
+    node = (AtNode*) PyLong_AsVoidPtr(obj);
+  }
+  else if (PyObject_HasAttrString(obj, "contents"))
+  {
+    // ctypes pointer as used by the arnold python bindings
+    PyObject *ctypes = PyImport_ImportModule("ctypes");
+    PyObject *contents = PyObject_GetAttrString(obj, "contents");
+    PyObject *addr = (ctypes && contents ? PyObject_CallMethod(ctypes, (char*)"addressof", (char*)"O", contents) : 0);
+    
+    if (addr)
+    {
+      node = (AtNode*) PyLong_AsVoidPtr(addr);
+    }
+    
+    Py_XDECREF(addr);
+    Py_XDECREF(contents);
+    Py_XDECREF(ctypes);
+  }
+  else
+  {
+    PyErr_SetString(PyExc_TypeError, "Expected a node name, address or arnold node pointer");
+    return 0;
+  }
+  
+  if (!node && !PyErr_Occurred())
+  {
+    PyErr_SetString(PyExc_ValueError, "Invalid null node");
+  }
+  
+  return node;
+}
+
+// ---
+
+static bool GetFloat(PyObject *value, float &out)
+{
+  double d = PyFloat_AsDouble(value);
+  
+  if (d == -1.0 && PyErr_Occurred() != NULL)
+  {
+    return false;
+  }
+  
+  out = float(d);
+  
+  return true;
+}
+
+// Read n floats from a sequence, or from the attributes named by the characters of attrs
+static bool GetFloats(PyObject *value, float *out, int n, const char *attrs)
+{
+  if (PySequence_Check(value) && !PyString_Check(value))
+  {
+    if (PySequence_Size(value) != n)
+    {
+      return false;
+    }
+    
+    for (int i=0; i<n; ++i)
+    {
+      PyObject *item = PySequence_GetItem(value, i);
+      
+      bool rv = (item != NULL && GetFloat(item, out[i]));
+      
+      Py_XDECREF(item);
+      
+      if (!rv)
+      {
+        return false;
+      }
+    }
+    
+    return true;
+  }
+  else if (attrs)
+  {
+    char attr[2] = {0, 0};
+    
+    for (int i=0; i<n; ++i)
+    {
+      attr[0] = attrs[i];
+      
+      PyObject *item = PyObject_GetAttrString(value, attr);
+      
+      bool rv = (item != NULL && GetFloat(item, out[i]));
+      
+      Py_XDECREF(item);
+      
+      if (!rv)
+      {
+        return false;
+      }
+    }
+    
+    return true;
+  }
+  else
+  {
+    return false;
+  }
+}
+
+static bool GetMatrix(PyObject *value, float *out)
+{
+  if (!PySequence_Check(value))
+  {
+    return false;
+  }
+  
+  Py_ssize_t n = PySequence_Size(value);
+  
+  if (n == 16)
+  {
+    return GetFloats(value, out, 16, 0);
+  }
+  else if (n == 4)
+  {
+    for (int i=0; i<4; ++i)
+    {
+      PyObject *row = PySequence_GetItem(value, i);
+      
+      bool rv = (row != NULL && GetFloats(row, out + 4 * i, 4, 0));
+      
+      Py_XDECREF(row);
+      
+      if (!rv)
+      {
+        return false;
+      }
+    }
+    
+    return true;
+  }
+  else
+  {
+    return false;
+  }
+}
+
+static bool GetNode(PyObject *value, AtNode *&out)
+{
+  if (value == Py_None)
+  {
+    out = 0;
+    return true;
+  }
+  else
+  {
+    out = PyProcGetNode(value);
+    return (out != 0);
+  }
+}
+
+bool PyProcConvertValue(int type, PyObject *value, void *out)
+{
+  long l;
+  
+  switch (type)
+  {
+  case AI_TYPE_BYTE:
+    l = PyInt_AsLong(value);
+    *((AtByte*)out) = AtByte(l);
+    return (l != -1 || PyErr_Occurred() == NULL);
+  case AI_TYPE_INT:
+  case AI_TYPE_ENUM:
+    l = PyInt_AsLong(value);
+    *((int*)out) = int(l);
+    return (l != -1 || PyErr_Occurred() == NULL);
+  case AI_TYPE_UINT:
+    *((unsigned int*)out) = (unsigned int) PyInt_AsUnsignedLongMask(value);
+    return (PyErr_Occurred() == NULL);
+  case AI_TYPE_BOOLEAN:
+    l = PyObject_IsTrue(value);
+    *((bool*)out) = (l == 1);
+    return (l != -1);
+  case AI_TYPE_FLOAT:
+    return GetFloat(value, *((float*)out));
+  case AI_TYPE_RGB:
+    return GetFloats(value, (float*)out, 3, "rgb");
+  case AI_TYPE_RGBA:
+    return GetFloats(value, (float*)out, 4, "rgba");
+  case AI_TYPE_VECTOR:
+  case AI_TYPE_POINT:
+    return GetFloats(value, (float*)out, 3, "xyz");
+  case AI_TYPE_POINT2:
+    return GetFloats(value, (float*)out, 2, "xy");
+  case AI_TYPE_MATRIX:
+    return GetMatrix(value, (float*)out);
+  case AI_TYPE_NODE:
+    return GetNode(value, *((AtNode**)out));
+  default:
+    return false;
+  }
+}
+
+static bool SetArray(AtNode *node, const char *param, int elemType, PyObject *value)
+{
+  if (elemType != AI_TYPE_UNDEFINED && !PyString_Check(value) && PyProcBuffer::Supported(value))
+  {
+    AtArray *ary = PyProcArrayFromBuffer(value, elemType, 1);
+    
+    if (ary)
+    {
+      AiNodeSetArray(node, param, ary);
+    }
+    
+    return (ary != 0);
+  }
+  
+  if (elemType == AI_TYPE_UNDEFINED || !PySequence_Check(value) || PyString_Check(value))
+  {
+    return false;
+  }
+  
+  PyObject *seq = PySequence_Fast(value, "");
+  
+  if (seq == NULL)
+  {
+    return false;
+  }
+  
+  Py_ssize_t n = PySequence_Fast_GET_SIZE(seq);
+  
+  AtArray *ary = AiArrayAllocate(AtUInt32(n), 1, AtByte(elemType));
+  
+  bool rv = true;
+  
+  if (elemType == AI_TYPE_STRING)
+  {
+    for (Py_ssize_t i=0; rv && i<n; ++i)
+    {
+      PyObject *item = PySequence_Fast_GET_ITEM(seq, i);
+      
+      rv = (PyString_Check(item) != 0);
+      
+      if (rv)
+      {
+        AiArraySetStr(ary, AtUInt32(i), PyString_AsString(item));
+      }
+    }
+  }
+  else
+  {
+    size_t size = size_t(AiParamGetTypeSize(elemType));
+    
+    char *data = (char*) ary->data;
+    
+    for (Py_ssize_t i=0; rv && i<n; ++i)
+    {
+      rv = PyProcConvertValue(elemType, PySequence_Fast_GET_ITEM(seq, i), data + i * size);
+    }
+  }
+  
+  Py_DECREF(seq);
+  
+  if (rv)
+  {
+    AiNodeSetArray(node, param, ary);
+  }
+  else
+  {
+    AiArrayDestroy(ary);
+  }
+  
+  return rv;
+}
+
+bool PyProcSetValue(AtNode *node, const char *param, int type, const void *value)
+{
+  const float *f = (const float*) value;
+  
+  switch (type)
+  {
+  case AI_TYPE_BYTE:
+    AiNodeSetByte(node, param, *((const AtByte*)value));
+    break;
+  case AI_TYPE_INT:
+  case AI_TYPE_ENUM:
+    AiNodeSetInt(node, param, *((const int*)value));
+    break;
+  case AI_TYPE_UINT:
+    AiNodeSetUInt(node, param, *((const unsigned int*)value));
+    break;
+  case AI_TYPE_BOOLEAN:
+    AiNodeSetBool(node, param, *((const bool*)value));
+    break;
+  case AI_TYPE_FLOAT:
+    AiNodeSetFlt(node, param, f[0]);
+    break;
+  case AI_TYPE_RGB:
+    AiNodeSetRGB(node, param, f[0], f[1], f[2]);
+    break;
+  case AI_TYPE_RGBA:
+    AiNodeSetRGBA(node, param, f[0], f[1], f[2], f[3]);
+    break;
+  case AI_TYPE_VECTOR:
+    AiNodeSetVec(node, param, f[0], f[1], f[2]);
+    break;
+  case AI_TYPE_POINT:
+    AiNodeSetPnt(node, param, f[0], f[1], f[2]);
+    break;
+  case AI_TYPE_POINT2:
+    AiNodeSetPnt2(node, param, f[0], f[1]);
+    break;
+  case AI_TYPE_MATRIX:
+    {
+      AtMatrix mtx;
+      memcpy(mtx, f, sizeof(AtMatrix));
+      AiNodeSetMatrix(node, param, mtx);
+    }
+    break;
+  case AI_TYPE_NODE:
+  case AI_TYPE_POINTER:
+    AiNodeSetPtr(node, param, *((void* const*)value));
+    break;
+  case AI_TYPE_STRING:
+    AiNodeSetStr(node, param, *((const char* const*)value));
+    break;
+  default:
+    return false;
+  }
+  
+  return true;
+}
+
+bool PyProcSetParam(AtNode *node, const char *param, PyObject *value)
+{
+  int elemType = AI_TYPE_UNDEFINED;
+  int type = PyProcParamType(node, param, &elemType);
+  
+  bool rv = false;
+  
+  PyProcValue v;
+  
+  if (type == AI_TYPE_UNDEFINED)
+  {
+    AiMsgWarning("[pyproc] %s node has no parameter \"%s\"", AiNodeEntryGetName(AiNodeGetNodeEntry(node)), param);
+    return false;
+  }
+  else if (PyProcArrayCheck(value))
+  {
+    // Also used for motion keys on non array parameters (matrix...)
+    // Adopted when it matches the parameter element type, converted otherwise
+    AtArray *ary = PyProcArrayTakeAs(value, (type == AI_TYPE_ARRAY ? elemType : type), 0);
+    
+    if (ary)
+    {
+      AiNodeSetArray(node, param, ary);
+      rv = true;
+    }
+  }
+  else if (type == AI_TYPE_STRING || (type == AI_TYPE_ENUM && PyString_Check(value)))
+  {
+    if (PyString_Check(value))
+    {
+      AiNodeSetStr(node, param, PyString_AsString(value));
+      rv = true;
+    }
+  }
+  else if (type == AI_TYPE_ARRAY)
+  {
+    rv = SetArray(node, param, elemType, value);
+  }
+  else if (PyProcConvertValue(type, value, &v))
+  {
+    rv = PyProcSetValue(node, param, type, &v);
+  }
+  
+  if (!rv)
+  {
+    AiMsgWarning("[pyproc] Invalid value for %s parameter \"%s\"", AiParamGetTypeName(type), param);
+    PyErr_Clear();
+  }
+  
+  return rv;
+}
+
+// ---
+
+bool PyProcIsNodeSpec(PyObject *obj)
+{
+  return (PyTuple_Check(obj) &&
+          (PyTuple_GET_SIZE(obj) == 2 || PyTuple_GET_SIZE(obj) == 3) &&
+          PyString_Check(PyTuple_GET_ITEM(obj, 0)));
+}
+
+AtNode* PyProcCreateNode(PyObject *spec)
+{
+  if (!PyProcIsNodeSpec(spec))
+  {
+    AiMsgError("[pyproc] Invalid node specification, expected (node_type, name[, {param: value}])");
+    return 0;
+  }
+  
+  const char *type = PyString_AsString(PyTuple_GET_ITEM(spec, 0));
+  PyObject *name = PyTuple_GET_ITEM(spec, 1);
+  PyObject *params = (PyTuple_GET_SIZE(spec) == 3 ? PyTuple_GET_ITEM(spec, 2) : Py_None);
+  
+  if ((name != Py_None && !PyString_Check(name)) || (params != Py_None && !PyDict_Check(params)))
+  {
+    AiMsgError("[pyproc] Invalid \"%s\" node specification, expected (node_type, name[, {param: value}])", type);
+    return 0;
+  }
+  
+  AtNode *node = AiNode(type);
+  
+  if (node == NULL)
+  {
+    AiMsgError("[pyproc] Failed to create \"%s\" node", type);
+    return 0;
+  }
+  
+  if (name != Py_None)
+  {
+    AiNodeSetStr(node, "name", PyString_AsString(name));
+  }
+  else
+  {
+    AiNodeSetStr(node, "name", PyProcNames::Current()->next().c_str());
+  }
+  
+  if (params != Py_None)
+  {
+    PyObject *key = 0;
+    PyObject *value = 0;
+    Py_ssize_t pos = 0;
+    
+    while (PyDict_Next(params, &pos, &key, &value))
+    {
+      if (!PyString_Check(key))
+      {
+        AiMsgWarning("[pyproc] Ignore non string parameter name in \"%s\" node specification", type);
+        continue;
+      }
+      
+      PyProcSetParam(node, PyString_AsString(key), value);
+    }
+  }
+  
+  return node;
+}
+
+// ---
+
+static void AppendBytes(std::string &key, const void *data, size_t n)
+{
+  key.append((const char*) data, n);
+}
+
+void PyProcUserParamsKey(const AtNode *node, std::string &key, const char * const *skip)
+{
+  std::map<std::string, std::string> values;
+  
+  AtUserParamIterator *it = AiNodeGetUserParamIterator(node);
+  
+  while (!AiUserParamIteratorFinished(it))
+  {
+    const AtUserParamEntry *upe = AiUserParamIteratorGetNext(it);
+    
+    if (!upe)
+    {
+      break;
+    }
+    
+    const char *name = AiUserParamGetName(upe);
+    
+    bool ignore = false;
+    
+    for (const char * const *s = skip; !ignore && s && *s; ++s)
+    {
+      ignore = (strcmp(*s, name) == 0);
+    }
+    
+    if (ignore)
+    {
+      continue;
+    }
+    
+    int type = AiUserParamGetType(upe);
+    
+    std::string &v = values[name];
+    
+    v.push_back(char(type));
+    v.push_back(char(AiUserParamGetCategory(upe)));
+    
+    switch (type)
+    {
+    case AI_TYPE_BYTE:
+      {
+        AtByte b = AiNodeGetByte(node, name);
+        AppendBytes(v, &b, sizeof(b));
+      }
+      break;
+    case AI_TYPE_INT:
+    case AI_TYPE_ENUM:
+      {
+        int i = AiNodeGetInt(node, name);
+        AppendBytes(v, &i, sizeof(i));
+      }
+      break;
+    case AI_TYPE_UINT:
+      {
+        unsigned int u = AiNodeGetUInt(node, name);
+        AppendBytes(v, &u, sizeof(u));
+      }
+      break;
+    case AI_TYPE_BOOLEAN:
+      v.push_back(AiNodeGetBool(node, name) ? '1' : '0');
+      break;
+    case AI_TYPE_FLOAT:
+      {
+        float f = AiNodeGetFlt(node, name);
+        AppendBytes(v, &f, sizeof(f));
+      }
+      break;
+    case AI_TYPE_RGB:
+      {
+        AtRGB c = AiNodeGetRGB(node, name);
+        AppendBytes(v, &c, sizeof(c));
+      }
+      break;
+    case AI_TYPE_RGBA:
+      {
+        AtRGBA c = AiNodeGetRGBA(node, name);
+        AppendBytes(v, &c, sizeof(c));
+      }
+      break;
+    case AI_TYPE_VECTOR:
+      {
+        AtVector p = AiNodeGetVec(node, name);
+        AppendBytes(v, &p, sizeof(p));
+      }
+      break;
+    case AI_TYPE_POINT:
+      {
+        AtPoint p = AiNodeGetPnt(node, name);
+        AppendBytes(v, &p, sizeof(p));
+      }
+      break;
+    case AI_TYPE_POINT2:
+      {
+        AtPoint2 p = AiNodeGetPnt2(node, name);
+        AppendBytes(v, &p, sizeof(p));
+      }
+      break;
+    case AI_TYPE_MATRIX:
+      {
+        AtMatrix m;
+        AiNodeGetMatrix(node, name, m);
+        AppendBytes(v, m, sizeof(AtMatrix));
+      }
+      break;
+    case AI_TYPE_STRING:
+      v += AiNodeGetStr(node, name);
+      break;
+    case AI_TYPE_NODE:
+    case AI_TYPE_POINTER:
+      {
+        void *p = AiNodeGetPtr(node, name);
+        AppendBytes(v, &p, sizeof(p));
+      }
+      break;
+    case AI_TYPE_ARRAY:
+      {
+        const AtArray *ary = AiNodeGetArray(node, name);
+        
+        if (ary)
+        {
+          unsigned int header[3] = {ary->nelements, ary->nkeys, ary->type};
+          
+          AppendBytes(v, header, sizeof(header));
+          
+          if (ary->type == AI_TYPE_STRING)
+          {
+            for (unsigned int i=0; i<ary->nelements; ++i)
+            {
+              v += AiArrayGetStr(ary, i);
+              v.push_back('\0');
+            }
+          }
+          else
+          {
+            AppendBytes(v, ary->data, size_t(ary->nelements) * ary->nkeys * AiParamGetTypeSize(ary->type));
+          }
+        }
+      }
+      break;
+    default:
+      break;
+    }
+  }
+  
+  AiUserParamIteratorDestroy(it);
+  
+  for (std::map<std::string, std::string>::const_iterator vit=values.begin(); vit!=values.end(); ++vit)
+  {
+    unsigned int len[2] = {(unsigned int) vit->first.length(), (unsigned int) vit->second.length()};
+    
+    AppendBytes(key, len, sizeof(len));
+    key += vit->first;
+    key += vit->second;
+  }
+}
@@ -0,0 +1,85 @@
+/*
+Copyright (c) 2016 Gaetan Guidet
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef __pyproc_nodes_h__
+#define __pyproc_nodes_h__
+
+#include <Python.h>
+#include <ai.h>
+#include <string>
+
+// Storage large enough for any non array parameter value in its raw arnold layout
+union PyProcValue
+{
+  AtByte b;
+  int i;
+  unsigned int u;
+  bool bo;
+  float f[16];
+  void *p;
+  const char *s;
+};
+
+// Lookup a node entry parameter type using a per node entry cache (GIL must be held)
+int PyProcEntryParamType(const AtNodeEntry *nentry, const char *param, int *elemType=0);
+
+// Set a non array parameter from its raw arnold layout (a PyProcValue or an array element)
+// Doesn't require the GIL
+bool PyProcSetValue(AtNode *node, const char *param, int type, const void *value);
+
+// Number of scalars in a value of the given type (3 floats for a point, 16 for a matrix...)
+size_t PyProcNumComponents(int type);
+
+// All functions below must be called with the GIL held
+
+// Get a node from its name, its address or an arnold python binding node pointer
+// Returns NULL with a python exception set on failure
+AtNode* PyProcGetNode(PyObject *obj);
+
+// Convert a python value to the raw memory layout of an arnold type
+// Strings (and enums set by name) are not handled
+bool PyProcConvertValue(int type, PyObject *value, void *out);
+
+// Lookup a node parameter type (built-in or user declared) using a per node entry cache
+// For array parameters, elemType (if not NULL) receives the array element type
+// Returns AI_TYPE_UNDEFINED if the node has no such parameter
+int PyProcParamType(AtNode *node, const char *param, int *elemType=0);
+
+// Set a node parameter from a python value, converted according to the parameter type
+// Vector like values are sequences or objects with x/y/z (r/g/b/a) attributes,
+//   matrices are 16 floats or 4 rows of 4 floats, node values are names or addresses
+bool PyProcSetParam(AtNode *node, const char *param, PyObject *value);
+
+// Create a node from a (node_type, name[, {param: value}]) specification
+// A None name gives the node a unique name (see names.h)
+// Returns NULL and logs an error on failure
+AtNode* PyProcCreateNode(PyObject *spec);
+
+// Check if a python object looks like a node specification
+bool PyProcIsNodeSpec(PyObject *obj);
+
+// Serialize the node user parameter names, types and values into 'key', sorted by
+//   name so that equally parameterized nodes give the same bytes
+// 'skip' is an optional null terminated list of parameter names to ignore
+void PyProcUserParamsKey(const AtNode *node, std::string &key, const char * const *skip=0);
+
+#endif
@@ -0,0 +1,833 @@
+/*
+Copyright (c) 2016 Gaetan Guidet
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "particles.h"
+#include "nodes.h"
+#include "names.h"
+#include "dedupe.h"
+#include "threads.h"
+#include <ai.h>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+
+#ifdef _WIN32
+#  define WIN32_LEAN_AND_MEAN
+#  include <windows.h>
+#else
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <fcntl.h>
+#  include <unistd.h>
+#endif
+
+// ---
+
+// Read only file mapping
+class MappedFile
+{
+public:
+  
+  MappedFile()
+    : mData(0), mSize(0)
+#ifdef _WIN32
+    , mFile(INVALID_HANDLE_VALUE), mMapping(NULL)
+#endif
+  {
+  }
+  
+  ~MappedFile()
+  {
+    close();
+  }
+  
+  bool open(const std::string &path)
+  {
+    close();
+    
+#ifdef _WIN32
+    mFile = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    
+    if (mFile == INVALID_HANDLE_VALUE)
+    {
+      return false;
+    }
+    
+    LARGE_INTEGER size;
+    
+    if (!GetFileSizeEx(mFile, &size) || size.QuadPart == 0)
+    {
+      close();
+      return false;
+    }
+    
+    mMapping = CreateFileMappingA(mFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    
+    if (mMapping == NULL)
+    {
+      close();
+      return false;
+    }
+    
+    mData = (const char*) MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0);
+    mSize = size_t(size.QuadPart);
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    
+    if (fd == -1)
+    {
+      return false;
+    }
+    
+    struct stat st;
+    
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+      ::close(fd);
+      return false;
+    }
+    
+    void *data = mmap(0, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    
+    // the mapping stays valid once the descriptor is closed
+    ::close(fd);
+    
+    if (data == MAP_FAILED)
+    {
+      return false;
+    }
+    
+    madvise(data, size_t(st.st_size), MADV_SEQUENTIAL);
+    
+    mData = (const char*) data;
+    mSize = size_t(st.st_size);
+#endif
+    
+    if (!mData)
+    {
+      close();
+      return false;
+    }
+    
+    return true;
+  }
+  
+  void close()
+  {
+#ifdef _WIN32
+    if (mData)
+    {
+      UnmapViewOfFile(mData);
+    }
+    if (mMapping != NULL)
+    {
+      CloseHandle(mMapping);
+      mMapping = NULL;
+    }
+    if (mFile != INVALID_HANDLE_VALUE)
+    {
+      CloseHandle(mFile);
+      mFile = INVALID_HANDLE_VALUE;
+    }
+#else
+    if (mData)
+    {
+      munmap((void*) mData, mSize);
+    }
+#endif
+    mData = 0;
+    mSize = 0;
+  }
+  
+  inline const char* data() const { return mData; }
+  inline size_t size() const { return mSize; }
+  
+private:
+  
+  MappedFile(const MappedFile&);
+  MappedFile& operator=(const MappedFile&);
+  
+private:
+  
+  const char *mData;
+  size_t mSize;
+#ifdef _WIN32
+  HANDLE mFile;
+  HANDLE mMapping;
+#endif
+};
+
+// ---
+
+// Values stored in a mapped file
+// format is the struct module character of the stored scalars
+struct Channel
+{
+  std::string name;
+  int type;
+  char format;
+  size_t itemSize;
+  size_t count;
+  const char *data;
+};
+
+struct CopyTask
+{
+  const Channel *channel;
+  AtArray *array;
+};
+
+template <typename S, typename D>
+static void Convert(const char *src, void *dst, size_t begin, size_t end)
+{
+  D *out = (D*) dst;
+  
+  for (size_t i=begin; i<end; ++i)
+  {
+    S v;
+    memcpy(&v, src + i * sizeof(S), sizeof(S));
+    out[i] = D(v);
+  }
+}
+
+template <typename D>
+static bool ConvertFrom(char format, const char *src, void *dst, size_t begin, size_t end)
+{
+  switch (format)
+  {
+  case 'f':
+    Convert<float, D>(src, dst, begin, end);
+    return true;
+  case 'd':
+    Convert<double, D>(src, dst, begin, end);
+    return true;
+  case 'i':
+    Convert<int, D>(src, dst, begin, end);
+    return true;
+  case 'I':
+    Convert<unsigned int, D>(src, dst, begin, end);
+    return true;
+  case 'q':
+    Convert<long long, D>(src, dst, begin, end);
+    return true;
+  case 'Q':
+    Convert<unsigned long long, D>(src, dst, begin, end);
+    return true;
+  case 'B':
+    Convert<unsigned char, D>(src, dst, begin, end);
+    return true;
+  default:
+    return false;
+  }
+}
+
+// Scalar struct format of an arnold array type
+static char ArrayFormat(int type)
+{
+  switch (type)
+  {
+  case AI_TYPE_BYTE:
+  case AI_TYPE_BOOLEAN:
+    return 'B';
+  case AI_TYPE_INT:
+  case AI_TYPE_ENUM:
+    return 'i';
+  case AI_TYPE_UINT:
+    return 'I';
+  default:
+    return 'f';
+  }
+}
+
+static void CopyRange(size_t begin, size_t end, void *data)
+{
+  CopyTask *task = (CopyTask*) data;
+  
+  const Channel &c = *(task->channel);
+  AtArray *ary = task->array;
+  
+  char format = ArrayFormat(ary->type);
+  
+  if (format == c.format)
+  {
+    // streaming copy, sub-ranges are split on scalar boundaries
+    memcpy((char*) ary->data + begin * c.itemSize, c.data + begin * c.itemSize, (end - begin) * c.itemSize);
+    return;
+  }
+  
+  switch (format)
+  {
+  case 'B':
+    ConvertFrom<unsigned char>(c.format, c.data, ary->data, begin, end);
+    break;
+  case 'i':
+    ConvertFrom<int>(c.format, c.data, ary->data, begin, end);
+    break;
+  case 'I':
+    ConvertFrom<unsigned int>(c.format, c.data, ary->data, begin, end);
+    break;
+  default:
+    ConvertFrom<float>(c.format, c.data, ary->data, begin, end);
+  }
+}
+
+static AtArray* CopyChannel(const Channel &c, int type)
+{
+  AtArray *ary = AiArrayAllocate(AtUInt32(c.count), 1, AtByte(type));
+  
+  if (ary)
+  {
+    CopyTask task = {&c, ary};
+    
+    PyProcParallelFor(c.count * PyProcNumComponents(type), 1 << 18, CopyRange, &task);
+  }
+  
+  return ary;
+}
+
+// ---
+
+static bool ReadCache(const MappedFile &file, std::vector<Channel> &channels, std::string &err)
+{
+  const char *data = file.data();
+  size_t size = file.size();
+  
+  unsigned int version = 0;
+  unsigned long long count = 0;
+  unsigned int nchannels = 0;
+  
+  if (size < 24 || memcmp(data, "PYPC", 4) != 0)
+  {
+    err = "Not a pyproc particle cache";
+    return false;
+  }
+  
+  memcpy(&version, data + 4, 4);
+  memcpy(&count, data + 8, 8);
+  memcpy(&nchannels, data + 16, 4);
+  
+  if (version != 1)
+  {
+    err = "Unsupported particle cache version";
+    return false;
+  }
+  
+  if (count > 0xFFFFFFFFULL || 24 + size_t(nchannels) * 48 > size)
+  {
+    err = "Truncated or invalid particle cache header";
+    return false;
+  }
+  
+  for (unsigned int i=0; i<nchannels; ++i)
+  {
+    const char *entry = data + 24 + i * 48;
+    
+    char name[33];
+    unsigned int type = 0;
+    unsigned long long offset = 0;
+    
+    memcpy(name, entry, 32);
+    name[32] = '\0';
+    memcpy(&type, entry + 32, 4);
+    memcpy(&offset, entry + 40, 8);
+    
+    Channel c;
+    
+    c.name = name;
+    c.type = int(type);
+    c.format = ArrayFormat(c.type);
+    c.itemSize = (c.format == 'B' ? 1 : 4);
+    c.count = size_t(count);
+    c.data = data + offset;
+    
+    if (c.type == AI_TYPE_STRING || c.type == AI_TYPE_NODE || c.type == AI_TYPE_POINTER ||
+        c.type == AI_TYPE_ARRAY || c.type > AI_TYPE_ENUM)
+    {
+      err = "Unsupported type for particle channel \"" + c.name + "\"";
+      return false;
+    }
+    
+    if (offset > size || (size - offset) / c.itemSize / PyProcNumComponents(c.type) < count)
+    {
+      err = "Truncated data for particle channel \"" + c.name + "\"";
+      return false;
+    }
+    
+    channels.push_back(c);
+  }
+  
+  return true;
+}
+
+// Read the header of a numpy .npy file, 'dims' receives the size of the second
+//   dimension (1 for 1d arrays)
+static bool ReadNpy(const MappedFile &file, Channel &c, size_t &dims, std::string &err)
+{
+  const char *data = file.data();
+  size_t size = file.size();
+  
+  if (size < 10 || memcmp(data, "\x93NUMPY", 6) != 0)
+  {
+    err = "Not a numpy .npy file";
+    return false;
+  }
+  
+  size_t hlen = 0;
+  size_t hstart = 0;
+  
+  if (data[6] == 1)
+  {
+    unsigned short l = 0;
+    memcpy(&l, data + 8, 2);
+    hlen = l;
+    hstart = 10;
+  }
+  else if (size >= 12)
+  {
+    unsigned int l = 0;
+    memcpy(&l, data + 8, 4);
+    hlen = l;
+    hstart = 12;
+  }
+  
+  if (hstart == 0 || hstart + hlen > size)
+  {
+    err = "Invalid .npy header";
+    return false;
+  }
+  
+  std::string header(data + hstart, hlen);
+  
+  size_t p = header.find("'descr'");
+  size_t q = (p != std::string::npos ? header.find('\'', header.find(':', p)) : p);
+  
+  if (q == std::string::npos || q + 4 > header.size())
+  {
+    err = "Invalid .npy header";
+    return false;
+  }
+  
+  // byte order, kind, item size i.e. '<f4'
+  char order = header[q + 1];
+  char kind = header[q + 2];
+  int itemSize = atoi(header.c_str() + q + 3);
+  
+  if (order == '>' && itemSize > 1)
+  {
+    err = "Big endian .npy data not supported";
+    return false;
+  }
+  
+  if (kind == 'f' && itemSize == 4)
+  {
+    c.format = 'f';
+  }
+  else if (kind == 'f' && itemSize == 8)
+  {
+    c.format = 'd';
+  }
+  else if (kind == 'i' && itemSize == 4)
+  {
+    c.format = 'i';
+  }
+  else if (kind == 'i' && itemSize == 8)
+  {
+    c.format = 'q';
+  }
+  else if (kind == 'u' && itemSize == 4)
+  {
+    c.format = 'I';
+  }
+  else if (kind == 'u' && itemSize == 8)
+  {
+    c.format = 'Q';
+  }
+  else if ((kind == 'u' || kind == 'b') && itemSize == 1)
+  {
+    c.format = 'B';
+  }
+  else
+  {
+    err = "Unsupported .npy data type";
+    return false;
+  }
+  
+  c.itemSize = size_t(itemSize);
+  
+  p = header.find("'fortran_order'");
+  
+  if (p == std::string::npos || header.find("True", p) == header.find(':', p) + 2)
+  {
+    err = "Fortran ordered .npy data not supported";
+    return false;
+  }
+  
+  p = header.find("'shape'");
+  p = (p != std::string::npos ? header.find('(', p) : p);
+  
+  if (p == std::string::npos)
+  {
+    err = "Invalid .npy header";
+    return false;
+  }
+  
+  // (count,) or (count, dims), python 2 may suffix longs with 'L'
+  const char *start = header.c_str() + p + 1;
+  char *end = 0;
+  unsigned long long count = strtoull(start, &end, 10);
+  
+  if (end == start)
+  {
+    err = "Unsupported .npy shape, expected (count,) or (count, dims)";
+    return false;
+  }
+  
+  dims = 1;
+  
+  while (*end == ',' || *end == ' ' || *end == 'L')
+  {
+    ++end;
+  }
+  
+  if (*end != ')')
+  {
+    start = end;
+    dims = size_t(strtoull(start, &end, 10));
+    
+    while (end != start && (*end == ',' || *end == ' ' || *end == 'L'))
+    {
+      ++end;
+    }
+    
+    if (end == start || *end != ')')
+    {
+      err = "Unsupported .npy shape, expected (count,) or (count, dims)";
+      return false;
+    }
+  }
+  
+  c.count = size_t(count);
+  c.data = data + hstart + hlen;
+  
+  if (count > 0xFFFFFFFFULL || size_t(c.data - data) + c.count * dims * c.itemSize > size)
+  {
+    err = "Truncated .npy data";
+    return false;
+  }
+  
+  return true;
+}
+
+// ---
+
+struct LoadPoints
+{
+  std::string name;
+  std::string path;
+  std::string radiusPath;
+  float radius;
+  std::string mode;
+  bool dedupe;
+  
+  AtNode *node;
+  std::string err;
+};
+
+static bool EndsWith(const std::string &s, const char *suffix)
+{
+  size_t n = strlen(suffix);
+  return (s.size() >= n && s.compare(s.size() - n, n, suffix) == 0);
+}
+
+static void Load(LoadPoints &args)
+{
+  MappedFile file;
+  MappedFile radiusFile;
+  
+  std::vector<Channel> channels;
+  
+  if (!file.open(args.path))
+  {
+    args.err = "Could not map \"" + args.path + "\"";
+    return;
+  }
+  
+  if (EndsWith(args.path, ".npy"))
+  {
+    Channel c;
+    size_t dims = 1;
+    
+    if (!ReadNpy(file, c, dims, args.err))
+    {
+      return;
+    }
+    
+    if (dims != 3)
+    {
+      args.err = "Positions .npy must be shaped (count, 3)";
+      return;
+    }
+    
+    c.name = "points";
+    c.type = AI_TYPE_POINT;
+    channels.push_back(c);
+    
+    if (!args.radiusPath.empty())
+    {
+      Channel r;
+      
+      if (!radiusFile.open(args.radiusPath))
+      {
+        args.err = "Could not map \"" + args.radiusPath + "\"";
+        return;
+      }
+      
+      if (!ReadNpy(radiusFile, r, dims, args.err))
+      {
+        return;
+      }
+      
+      if (dims != 1 || r.count != c.count)
+      {
+        args.err = "Radius .npy must hold one value per position";
+        return;
+      }
+      
+      r.name = "radius";
+      r.type = AI_TYPE_FLOAT;
+      channels.push_back(r);
+    }
+  }
+  else if (!ReadCache(file, channels, args.err))
+  {
+    return;
+  }
+  
+  const Channel *points = 0;
+  const Channel *radius = 0;
+  
+  for (size_t i=0; i<channels.size(); ++i)
+  {
+    if (channels[i].name == "points")
+    {
+      points = &channels[i];
+    }
+    else if (channels[i].name == "radius")
+    {
+      radius = &channels[i];
+    }
+  }
+  
+  if (!points || points->type != AI_TYPE_POINT)
+  {
+    args.err = "No 'points' channel of type point in \"" + args.path + "\"";
+    return;
+  }
+  
+  if (radius && radius->type != AI_TYPE_FLOAT)
+  {
+    args.err = "'radius' channel must be of type float";
+    return;
+  }
+  
+  std::vector<AtArray*> arrays(channels.size(), (AtArray*)0);
+  
+  for (size_t i=0; i<channels.size(); ++i)
+  {
+    arrays[i] = CopyChannel(channels[i], channels[i].type);
+  }
+  
+  AtArray *constRadius = 0;
+  
+  if (!radius && args.radius >= 0.0f)
+  {
+    constRadius = AiArrayAllocate(AtUInt32(points->count), 1, AI_TYPE_FLOAT);
+    
+    float *r = (float*) constRadius->data;
+    
+    for (size_t i=0; i<points->count; ++i)
+    {
+      r[i] = args.radius;
+    }
+  }
+  
+  PyProcDedupe content("points");
+  AtNode *source = 0;
+  
+  if (args.dedupe)
+  {
+    for (size_t i=0; i<channels.size(); ++i)
+    {
+      content.add(channels[i].name.c_str(), arrays[i]);
+    }
+    
+    content.add("radius", constRadius);
+    
+    if (!args.mode.empty())
+    {
+      content.add("mode", args.mode);
+    }
+    
+    source = content.find();
+  }
+  
+  AtNode *node = (source ? content.instance(source, args.name) : AiNode("points"));
+  
+  if (!node || source)
+  {
+    for (size_t i=0; i<arrays.size(); ++i)
+    {
+      AiArrayDestroy(arrays[i]);
+    }
+    
+    if (constRadius)
+    {
+      AiArrayDestroy(constRadius);
+    }
+    
+    if (!node)
+    {
+      args.err = "Failed to create points node";
+    }
+    
+    args.node = node;
+    return;
+  }
+  
+  AiNodeSetStr(node, "name", args.name.c_str());
+  
+  if (!args.mode.empty())
+  {
+    AiNodeSetStr(node, "mode", args.mode.c_str());
+  }
+  
+  for (size_t i=0; i<channels.size(); ++i)
+  {
+    const Channel &c = channels[i];
+    
+    if (&c != points && &c != radius)
+    {
+      AiNodeDeclare(node, c.name.c_str(), (std::string("uniform ") + AiParamGetTypeName(c.type)).c_str());
+    }
+    
+    AiNodeSetArray(node, c.name.c_str(), arrays[i]);
+  }
+  
+  if (constRadius)
+  {
+    AiNodeSetArray(node, "radius", constRadius);
+  }
+  
+  if (args.dedupe)
+  {
+    content.insert(node);
+  }
+  
+  args.node = node;
+}
+
+static PyObject* PyProc_LoadPoints(PyObject *, PyObject *args, PyObject *kwargs)
+{
+  static char *kwlist[] = {(char*)"name", (char*)"path", (char*)"radius", (char*)"mode", (char*)"dedupe", NULL};
+  
+  PyObject *pyname = 0;
+  const char *path = 0;
+  PyObject *pyradius = 0;
+  const char *mode = 0;
+  PyObject *pydedupe = 0;
+  
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "Os|OzO", kwlist, &pyname, &path, &pyradius, &mode, &pydedupe))
+  {
+    return NULL;
+  }
+  
+  if (pyname != Py_None && !PyString_Check(pyname))
+  {
+    PyErr_SetString(PyExc_TypeError, "'name' must be a string or None");
+    return NULL;
+  }
+  
+  LoadPoints load;
+  
+  load.name = (pyname != Py_None ? std::string(PyString_AsString(pyname)) : PyProcNames::Current()->next());
+  load.path = path;
+  load.radius = -1.0f;
+  load.mode = (mode ? mode : "");
+  load.dedupe = PyProcDedupe::Enabled(pydedupe);
+  load.node = 0;
+  
+  if (pyradius && pyradius != Py_None)
+  {
+    if (PyString_Check(pyradius))
+    {
+      load.radiusPath = PyString_AsString(pyradius);
+    }
+    else
+    {
+      load.radius = float(PyFloat_AsDouble(pyradius));
+      
+      if (PyErr_Occurred())
+      {
+        return NULL;
+      }
+    }
+  }
+  
+  Py_BEGIN_ALLOW_THREADS
+  
+  Load(load);
+  
+  Py_END_ALLOW_THREADS
+  
+  if (!load.node)
+  {
+    PyErr_SetString(PyExc_IOError, load.err.c_str());
+    return NULL;
+  }
+  
+  return PyLong_FromVoidPtr(load.node);
+}
+
+// ---
+
+static PyMethodDef gsParticlesMethods[] =
+{
+  {"loadpoints", (PyCFunction)PyProc_LoadPoints, METH_VARARGS | METH_KEYWORDS, "loadpoints(name, path, radius=None, mode=None, dedupe=None)"},
+  {NULL, NULL, 0, NULL}
+};
+
+bool PyProcParticlesInit(PyObject *mod)
+{
+  for (PyMethodDef *def = gsParticlesMethods; def->ml_name; ++def)
+  {
+    PyObject *func = PyCFunction_New(def, NULL);
+    
+    if (!func || PyModule_AddObject(mod, def->ml_name, func) != 0)
+    {
+      return false;
+    }
+  }
+  
+  return true;
+}
@@ -0,0 +1,64 @@
+/*
+Copyright (c) 2016 Gaetan Guidet
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef __pyproc_particles_h__
+#define __pyproc_particles_h__
+
+#include <Python.h>
+
+// pyproc.loadpoints(name, path, radius=None, mode=None, dedupe=None)
+//
+// Create a points node from a memory mapped particle file, the file data is
+//   copied straight into the node arrays with the GIL released
+// Returns the node address, a None name gives the node a unique name
+// Identical point sets are instanced when 'dedupe' is set (see dedupe.h)
+//
+// Supported files:
+//
+// - numpy .npy holding a C ordered (count, 3) array of positions, 'radius' is
+//   then either a number or the path of a .npy holding count values
+//
+// - pyproc particle cache (.ppc), all values little endian:
+//
+//   offset  size
+//   0       4         magic "PYPC"
+//   4       4         uint32 version (1)
+//   8       8         uint64 particle count
+//   16      4         uint32 channel count
+//   20      4         reserved
+//   24      48 * n    channel table
+//                       char[32] name, null padded
+//                       uint32   arnold type (AI_TYPE_POINT, AI_TYPE_FLOAT...)
+//                       uint32   reserved
+//                       uint64   data offset from the start of the file
+//
+//   Channel data holds count values, components interleaved, stored as 32 bits
+//   floats, ints or uints, and bytes for AI_TYPE_BYTE and AI_TYPE_BOOLEAN
+//   The 'points' channel is required, 'radius' is used for the node radius when
+//   present, other channels are declared as uniform user data
+//   Keep data offsets 4 bytes aligned
+
+// All functions must be called with the GIL held
+
+bool PyProcParticlesInit(PyObject *mod);
+
+#endif
@@ -0,0 +1,49 @@
+/*
+Copyright (c) 2016 Gaetan Guidet
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef __pyproc_random_h__
+#define __pyproc_random_h__
+
+// Counter based random numbers used by the native kernels
+// Values only depend on (seed, counter, dimension), never on the order or the thread
+//   they are drawn from, so results are reproducible across machines and thread counts
+
+// splitmix64 finalizer
+inline unsigned long long PyProcMix64(unsigned long long x)
+{
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  x ^= x >> 31;
+  return x;
+}
+
+// Uniform double in [0, 1) for dimension 'dim' (0 to 3) of sample 'counter'
+inline double PyProcRandom(unsigned long long seed, unsigned long long counter, unsigned int dim)
+{
+  unsigned long long h = PyProcMix64(PyProcMix64(seed + 0x9e3779b97f4a7c15ULL) ^ ((counter << 2) | dim));
+  
+  return double(h >> 11) * (1.0 / 9007199254740992.0);
+}
+
+#endif
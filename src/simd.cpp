@@ -0,0 +1,115 @@
+/*
+Copyright (c) 2016 Gaetan Guidet
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "simd.h"
+#include <cstdlib>
+#include <cstring>
+
+#if defined(PYPROC_AVX) && defined(_MSC_VER)
+#  include <intrin.h>
+#elif defined(PYPROC_AVX)
+#  include <cpuid.h>
+#endif
+
+static bool CPUSupportsAVX()
+{
+#ifdef PYPROC_AVX
+  unsigned int ecx = 0;
+  
+#  ifdef _MSC_VER
+  int info[4];
+  __cpuid(info, 1);
+  ecx = (unsigned int) info[2];
+#  else
+  unsigned int eax = 0, ebx = 0, edx = 0;
+  
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+  {
+    return false;
+  }
+#  endif
+  
+  // AVX and OSXSAVE
+  if ((ecx & (1u << 28)) == 0 || (ecx & (1u << 27)) == 0)
+  {
+    return false;
+  }
+  
+  // OS saves the XMM and YMM registers
+#  ifdef _MSC_VER
+  unsigned long long xcr0 = _xgetbv(0);
+#  else
+  unsigned int lo = 0, hi = 0;
+  __asm__ __volatile__ ("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+  unsigned long long xcr0 = ((unsigned long long) hi << 32) | lo;
+#  endif
+  
+  return ((xcr0 & 6) == 6);
+#else
+  return false;
+#endif
+}
+
+PyProcSimd PyProcSimdLevel()
+{
+  static int sLevel = -1;
+  
+  if (sLevel < 0)
+  {
+    int level = PyProcSimdScalar;
+    
+#ifdef PYPROC_SSE
+    level = (CPUSupportsAVX() ? PyProcSimdAVX : PyProcSimdSSE);
+#endif
+    
+    const char *env = getenv("PYPROC_SIMD");
+    
+    if (env)
+    {
+      if (!strcmp(env, "scalar"))
+      {
+        level = PyProcSimdScalar;
+      }
+      else if (!strcmp(env, "sse") && level > PyProcSimdSSE)
+      {
+        level = PyProcSimdSSE;
+      }
+    }
+    
+    sLevel = level;
+  }
+  
+  return PyProcSimd(sLevel);
+}
+
+const char* PyProcSimdName(PyProcSimd level)
+{
+  switch (level)
+  {
+  case PyProcSimdAVX:
+    return "avx";
+  case PyProcSimdSSE:
+    return "sse";
+  default:
+    return "scalar";
+  }
+}
@@ -0,0 +1,67 @@
+/*
+Copyright (c) 2016 Gaetan Guidet
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef __pyproc_simd_h__
+#define __pyproc_simd_h__
+
+// Instruction sets used by the native kernels, chosen at runtime
+//
+// PYPROC_SSE is defined when SSE2 intrinsics are available at compile time (always
+//   on x86-64), PYPROC_AVX when the compiler can build AVX functions without global
+//   flags, such functions must be tagged PYPROC_AVX_FUNC and only be called when
+//   PyProcSimdLevel() returns PyProcSimdAVX
+//
+// PYPROC_SIMD=scalar|sse|avx caps the level (for testing or problematic hardware)
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#  if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#    define PYPROC_SSE
+#    include <emmintrin.h>
+#  endif
+#endif
+
+#ifdef PYPROC_SSE
+#  if defined(_MSC_VER)
+#    define PYPROC_AVX
+#    define PYPROC_AVX_FUNC
+#  elif defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)))
+#    define PYPROC_AVX
+#    define PYPROC_AVX_FUNC __attribute__((target("avx")))
+#  endif
+#  ifdef PYPROC_AVX
+#    include <immintrin.h>
+#  endif
+#endif
+
+enum PyProcSimd
+{
+  PyProcSimdScalar = 0,
+  PyProcSimdSSE,
+  PyProcSimdAVX
+};
+
+// Best level supported by both the build and the CPU/OS, detected once
+PyProcSimd PyProcSimdLevel();
+
+const char* PyProcSimdName(PyProcSimd level);
+
+#endif
@@ -0,0 +1,140 @@
+/*
+Copyright (c) 2016 Gaetan Guidet
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "threads.h"
+#include <ai.h>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+
+#ifdef _WIN32
+#  define WIN32_LEAN_AND_MEAN
+#  include <windows.h>
+#else
+#  include <unistd.h>
+#endif
+
+size_t PyProcNumThreads()
+{
+  static size_t sNumThreads = 0;
+  
+  if (sNumThreads == 0)
+  {
+    int n = 0;
+    
+    char *env = getenv("PYPROC_THREADS");
+    
+    if (!env || sscanf(env, "%d", &n) != 1 || n <= 0)
+    {
+#ifdef _WIN32
+      SYSTEM_INFO si;
+      GetSystemInfo(&si);
+      n = int(si.dwNumberOfProcessors);
+#else
+      n = int(sysconf(_SC_NPROCESSORS_ONLN));
+#endif
+    }
+    
+    sNumThreads = size_t(n > 0 ? n : 1);
+  }
+  
+  return sNumThreads;
+}
+
+struct RangeTask
+{
+  PyProcRangeFunc fn;
+  void *data;
+  size_t begin;
+  size_t end;
+};
+
+static unsigned int RunRangeTask(void *data)
+{
+  RangeTask *task = (RangeTask*) data;
+  
+  task->fn(task->begin, task->end, task->data);
+  
+  return 0;
+}
+
+void PyProcParallelFor(size_t count, size_t grain, PyProcRangeFunc fn, void *data)
+{
+  if (count == 0)
+  {
+    return;
+  }
+  
+  if (grain == 0)
+  {
+    grain = 1;
+  }
+  
+  size_t ntasks = (count + grain - 1) / grain;
+  size_t nthreads = PyProcNumThreads();
+  
+  if (ntasks > nthreads)
+  {
+    ntasks = nthreads;
+  }
+  
+  if (ntasks <= 1)
+  {
+    fn(0, count, data);
+    return;
+  }
+  
+  size_t step = (count + ntasks - 1) / ntasks;
+  
+  std::vector<RangeTask> tasks(ntasks);
+  std::vector<void*> threads;
+  
+  for (size_t i=0, begin=0; i<ntasks; ++i, begin+=step)
+  {
+    tasks[i].fn = fn;
+    tasks[i].data = data;
+    tasks[i].begin = (begin < count ? begin : count);
+    tasks[i].end = (begin + step < count ? begin + step : count);
+  }
+  
+  for (size_t i=0; i+1<ntasks; ++i)
+  {
+    void *thread = AiThreadCreate(RunRangeTask, &tasks[i], AI_PRIORITY_NORMAL);
+    
+    if (thread)
+    {
+      threads.push_back(thread);
+    }
+    else
+    {
+      RunRangeTask(&tasks[i]);
+    }
+  }
+  
+  RunRangeTask(&tasks[ntasks-1]);
+  
+  for (size_t i=0; i<threads.size(); ++i)
+  {
+    AiThreadWait(threads[i]);
+    AiThreadClose(threads[i]);
+  }
+}
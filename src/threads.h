@@ -0,0 +1,46 @@
+/*
+Copyright (c) 2016 Gaetan Guidet
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef __pyproc_threads_h__
+#define __pyproc_threads_h__
+
+#include <cstddef>
+
+#ifdef _WIN32
+#  define PYPROC_THREAD_LOCAL __declspec(thread)
+#else
+#  define PYPROC_THREAD_LOCAL __thread
+#endif
+
+// Native work splitting used by the GIL free parts of pyproc
+// Thread count defaults to the number of processors, PYPROC_THREADS overrides it
+
+typedef void (*PyProcRangeFunc)(size_t begin, size_t end, void *data);
+
+size_t PyProcNumThreads();
+
+// Call fn over contiguous sub-ranges of [0, count) using arnold threads
+// No sub-range is smaller than 'grain' (except the last one), the calling thread
+//   processes the last sub-range and the function returns once all are done
+void PyProcParallelFor(size_t count, size_t grain, PyProcRangeFunc fn, void *data);
+
+#endif
@@ -0,0 +1,568 @@
+/*
+Copyright (c) 2016 Gaetan Guidet
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "wire.h"
+#include "buffer.h"
+#include "nodes.h"
+#include "threads.h"
+#include "names.h"
+#include <string>
+#include <cstring>
+
+// ---
+
+struct WireParam
+{
+  std::string name;
+  int type;
+  unsigned int nkeys;
+  unsigned int nelements;
+  // numeric values
+  const char *values;
+  // string or node values
+  std::vector<std::string> strings;
+};
+
+struct WireNode
+{
+  std::string type;
+  std::string name;
+  std::vector<WireParam> params;
+};
+
+class WireReader
+{
+public:
+  
+  WireReader(const char *data, size_t size)
+    : mCur(data)
+    , mEnd(data + size)
+  {
+  }
+  
+  inline bool eof() const
+  {
+    return (mCur >= mEnd);
+  }
+  
+  bool read(void *out, size_t n)
+  {
+    if (size_t(mEnd - mCur) < n)
+    {
+      return false;
+    }
+    memcpy(out, mCur, n);
+    mCur += n;
+    return true;
+  }
+  
+  bool skip(size_t n, const char *&ptr)
+  {
+    if (size_t(mEnd - mCur) < n)
+    {
+      return false;
+    }
+    ptr = mCur;
+    mCur += n;
+    return true;
+  }
+  
+  bool read(std::string &out)
+  {
+    unsigned int len = 0;
+    const char *ptr = 0;
+    
+    if (!read(&len, 4) || !skip(len, ptr))
+    {
+      return false;
+    }
+    
+    out.assign(ptr, len);
+    
+    return true;
+  }
+  
+private:
+  
+  const char *mCur;
+  const char *mEnd;
+};
+
+static size_t ValueSize(int type)
+{
+  switch (type)
+  {
+  case AI_TYPE_BYTE:
+  case AI_TYPE_BOOLEAN:
+    return 1;
+  case AI_TYPE_INT:
+  case AI_TYPE_UINT:
+  case AI_TYPE_ENUM:
+  case AI_TYPE_FLOAT:
+    return 4;
+  case AI_TYPE_RGB:
+  case AI_TYPE_VECTOR:
+  case AI_TYPE_POINT:
+    return 12;
+  case AI_TYPE_RGBA:
+    return 16;
+  case AI_TYPE_POINT2:
+    return 8;
+  case AI_TYPE_MATRIX:
+    return 64;
+  default:
+    return 0;
+  }
+}
+
+static bool Parse(const char *data, size_t size, std::vector<WireNode> &nodes, std::string &err)
+{
+  WireReader reader(data, size);
+  
+  char magic[4];
+  unsigned int version = 0;
+  
+  if (!reader.read(magic, 4) || !reader.read(&version, 4) || strncmp(magic, "PYPN", 4) != 0)
+  {
+    err = "invalid header";
+    return false;
+  }
+  
+  if (version != PYPROC_WIRE_VERSION)
+  {
+    err = "unsupported version";
+    return false;
+  }
+  
+  while (!reader.eof())
+  {
+    unsigned char op = 0;
+    
+    reader.read(&op, 1);
+    
+    if (op == 1)
+    {
+      nodes.push_back(WireNode());
+      
+      if (!reader.read(nodes.back().type) || !reader.read(nodes.back().name))
+      {
+        err = "truncated node record";
+        return false;
+      }
+    }
+    else if (op == 2)
+    {
+      if (nodes.size() == 0)
+      {
+        err = "param record before any node record";
+        return false;
+      }
+      
+      std::vector<WireParam> &params = nodes.back().params;
+      
+      params.push_back(WireParam());
+      
+      WireParam &param = params.back();
+      unsigned char type = 0;
+      unsigned char nkeys = 0;
+      
+      param.values = 0;
+      
+      if (!reader.read(param.name) || !reader.read(&type, 1) || !reader.read(&nkeys, 1) || !reader.read(&(param.nelements), 4))
+      {
+        err = "truncated param record";
+        return false;
+      }
+      
+      param.type = type;
+      param.nkeys = nkeys;
+      
+      if (nkeys == 0 && param.nelements != 1)
+      {
+        err = "invalid element count for single value \"" + param.name + "\"";
+        return false;
+      }
+      
+      size_t count = size_t(param.nelements) * (nkeys > 0 ? nkeys : 1);
+      
+      if (type == AI_TYPE_STRING || type == AI_TYPE_NODE)
+      {
+        param.strings.resize(count);
+        
+        for (size_t i=0; i<count; ++i)
+        {
+          if (!reader.read(param.strings[i]))
+          {
+            err = "truncated values for \"" + param.name + "\"";
+            return false;
+          }
+        }
+      }
+      else
+      {
+        size_t vsize = ValueSize(type);
+        
+        if (vsize == 0)
+        {
+          err = "unsupported value type for \"" + param.name + "\"";
+          return false;
+        }
+        
+        if (!reader.skip(count * vsize, param.values))
+        {
+          err = "truncated values for \"" + param.name + "\"";
+          return false;
+        }
+      }
+    }
+    else
+    {
+      err = "invalid opcode";
+      return false;
+    }
+  }
+  
+  return true;
+}
+
+// ---
+
+struct ApplyData
+{
+  std::vector<WireNode> *records;
+  std::vector<AtNode*> *nodes;
+  PyProcNames *names;
+  unsigned long firstName;
+};
+
+static void CreateNodes(size_t begin, size_t end, void *data)
+{
+  ApplyData *ad = (ApplyData*) data;
+  
+  std::string name;
+  
+  for (size_t i=begin; i<end; ++i)
+  {
+    const WireNode &rec = (*ad->records)[i];
+    
+    AtNode *node = AiNode(rec.type.c_str());
+    
+    if (!node)
+    {
+      AiMsgError("[pyproc] NodeStream: Failed to create \"%s\" node", rec.type.c_str());
+    }
+    else if (rec.name.length() > 0)
+    {
+      AiNodeSetStr(node, "name", rec.name.c_str());
+    }
+    else
+    {
+      // Unnamed nodes are named by the procedural, like specs and batches
+      ad->names->format(ad->firstName + i, 0, name);
+      AiNodeSetStr(node, "name", name.c_str());
+    }
+    
+    (*ad->nodes)[i] = node;
+  }
+}
+
+static void SetParams(size_t begin, size_t end, void *data)
+{
+  ApplyData *ad = (ApplyData*) data;
+  
+  PyProcValue v;
+  
+  for (size_t i=begin; i<end; ++i)
+  {
+    const WireNode &rec = (*ad->records)[i];
+    AtNode *node = (*ad->nodes)[i];
+    
+    if (!node)
+    {
+      continue;
+    }
+    
+    for (size_t j=0; j<rec.params.size(); ++j)
+    {
+      const WireParam &param = rec.params[j];
+      const char *pname = param.name.c_str();
+      
+      if (param.nkeys == 0)
+      {
+        if (param.type == AI_TYPE_STRING)
+        {
+          AiNodeSetStr(node, pname, param.strings[0].c_str());
+        }
+        else if (param.type == AI_TYPE_NODE)
+        {
+          AiNodeSetPtr(node, pname, (param.strings[0].length() > 0 ? AiNodeLookUpByName(param.strings[0].c_str()) : 0));
+        }
+        else
+        {
+          memcpy(&v, param.values, ValueSize(param.type));
+          PyProcSetValue(node, pname, param.type, &v);
+        }
+      }
+      else
+      {
+        AtArray *ary = AiArrayAllocate(param.nelements, AtByte(param.nkeys), AtByte(param.type));
+        
+        size_t count = size_t(param.nelements) * param.nkeys;
+        
+        if (param.type == AI_TYPE_STRING)
+        {
+          for (size_t k=0; k<count; ++k)
+          {
+            AiArraySetStr(ary, AtUInt32(k), param.strings[k].c_str());
+          }
+        }
+        else if (param.type == AI_TYPE_NODE)
+        {
+          for (size_t k=0; k<count; ++k)
+          {
+            AiArraySetPtr(ary, AtUInt32(k), (param.strings[k].length() > 0 ? AiNodeLookUpByName(param.strings[k].c_str()) : 0));
+          }
+        }
+        else if (count > 0)
+        {
+          memcpy(ary->data, param.values, count * ValueSize(param.type));
+        }
+        
+        AiNodeSetArray(node, pname, ary);
+      }
+    }
+  }
+}
+
+// ---
+
+static const char *gsEncoderSource =
+  "import struct as _struct\n"
+  "\n"
+  "class NodeStream(object):\n"
+  "  \"\"\"Binary node stream encoder, return it (or its tostring() result) from GetNodes/Generate.\n"
+  "  Types are arnold parameter types (arnold.AI_TYPE_*).\n"
+  "  Array values may be any buffer holding the raw element layout (numpy, array.array),\n"
+  "  or (nested) sequences of numbers.\"\"\"\n"
+  "\n"
+  "  _Formats = {0: \"B\", 1: \"i\", 2: \"I\", 3: \"B\", 4: \"f\", 5: \"3f\", 6: \"4f\",\n"
+  "              7: \"3f\", 8: \"3f\", 9: \"2f\", 14: \"16f\", 15: \"i\"}\n"
+  "\n"
+  "  def __init__(self):\n"
+  "    super(NodeStream, self).__init__()\n"
+  "    self._chunks = [\"PYPN\", _struct.pack(\"<I\", 1)]\n"
+  "    self._hasnode = False\n"
+  "\n"
+  "  def _string(self, s):\n"
+  "    self._chunks.append(_struct.pack(\"<I\", len(s)))\n"
+  "    self._chunks.append(s)\n"
+  "\n"
+  "  @staticmethod\n"
+  "  def _flatten(value, out):\n"
+  "    if isinstance(value, (list, tuple)):\n"
+  "      for v in value:\n"
+  "        NodeStream._flatten(v, out)\n"
+  "    else:\n"
+  "      out.append(value)\n"
+  "    return out\n"
+  "\n"
+  "  def node(self, node_type, name=None):\n"
+  "    self._chunks.append(\"\\x01\")\n"
+  "    self._string(node_type)\n"
+  "    self._string(name or \"\")\n"
+  "    self._hasnode = True\n"
+  "    return self\n"
+  "\n"
+  "  def set(self, param, ptype, value, array=False, keys=1):\n"
+  "    if not self._hasnode:\n"
+  "      raise RuntimeError(\"NodeStream.set called before NodeStream.node\")\n"
+  "    if not array:\n"
+  "      keys = 0\n"
+  "    elif keys < 1:\n"
+  "      raise ValueError(\"Invalid key count\")\n"
+  "    if ptype in (10, 12):\n"
+  "      strs = [value] if not array else list(value)\n"
+  "      if array and len(strs) % keys != 0:\n"
+  "        raise ValueError(\"Value count is not a multiple of the key count\")\n"
+  "      n = (1 if not array else len(strs) // keys)\n"
+  "      self._chunks.append(\"\\x02\")\n"
+  "      self._string(param)\n"
+  "      self._chunks.append(_struct.pack(\"<BBI\", ptype, keys, n))\n"
+  "      for s in strs:\n"
+  "        self._string(s or \"\")\n"
+  "      return self\n"
+  "    fmt = self._Formats.get(ptype)\n"
+  "    if fmt is None:\n"
+  "      raise ValueError(\"Unsupported parameter type %d\" % ptype)\n"
+  "    esize = _struct.calcsize(\"<\" + fmt)\n"
+  "    if array and not isinstance(value, (list, tuple)):\n"
+  "      data = str(buffer(value)) if not isinstance(value, memoryview) else value.tobytes()\n"
+  "    else:\n"
+  "      flat = self._flatten(value, [])\n"
+  "      ncomp = int(fmt[:-1] or \"1\")\n"
+  "      if len(flat) % ncomp != 0:\n"
+  "        raise ValueError(\"Invalid value for parameter \\\"%s\\\"\" % param)\n"
+  "      data = _struct.pack(\"<%d%s\" % (len(flat), fmt[-1]), *flat)\n"
+  "    if len(data) % (esize * max(1, keys)) != 0:\n"
+  "      raise ValueError(\"Invalid data size for parameter \\\"%s\\\"\" % param)\n"
+  "    n = len(data) // (esize * max(1, keys))\n"
+  "    if not array and n != 1:\n"
+  "      raise ValueError(\"Invalid value for parameter \\\"%s\\\"\" % param)\n"
+  "    self._chunks.append(\"\\x02\")\n"
+  "    self._string(param)\n"
+  "    self._chunks.append(_struct.pack(\"<BBI\", ptype, keys, n))\n"
+  "    self._chunks.append(data)\n"
+  "    return self\n"
+  "\n"
+  "  def tostring(self):\n"
+  "    return \"\".join(self._chunks)\n"
+  "\n"
+  "  __str__ = tostring\n";
+
+bool PyProcWireInit(PyObject *mod)
+{
+  PyObject *dict = PyModule_GetDict(mod);
+  
+  PyObject *pyrv = PyRun_String(gsEncoderSource, Py_file_input, dict, dict);
+  
+  if (pyrv == NULL)
+  {
+    return false;
+  }
+  
+  Py_DECREF(pyrv);
+  
+  return true;
+}
+
+static bool IsEncoder(PyObject *obj)
+{
+  PyObject *cls = PyObject_GetAttrString(PyImport_AddModule("pyproc"), "NodeStream");
+  
+  int rv = (cls != NULL ? PyObject_IsInstance(obj, cls) : 0);
+  
+  Py_XDECREF(cls);
+  PyErr_Clear();
+  
+  return (rv == 1);
+}
+
+// Returns a new reference to the encoded stream if obj is a pyproc.NodeStream
+static PyObject* EncodedStream(PyObject *obj)
+{
+  if (!IsEncoder(obj))
+  {
+    return NULL;
+  }
+  
+  return PyObject_CallMethod(obj, (char*)"tostring", NULL);
+}
+
+bool PyProcIsNodeStream(PyObject *obj)
+{
+  if (PyString_Check(obj))
+  {
+    return (PyString_GET_SIZE(obj) >= 8 && strncmp(PyString_AS_STRING(obj), "PYPN", 4) == 0);
+  }
+  else if (PyByteArray_Check(obj) || PyMemoryView_Check(obj) || PyBuffer_Check(obj))
+  {
+    PyProcBuffer buffer;
+    
+    if (!buffer.acquire(obj))
+    {
+      PyErr_Clear();
+      return false;
+    }
+    
+    return (buffer.bytes() >= 8 && strncmp((const char*)buffer.data(), "PYPN", 4) == 0);
+  }
+  else
+  {
+    return IsEncoder(obj);
+  }
+}
+
+bool PyProcApplyNodeStream(PyObject *obj, std::vector<AtNode*> &nodes)
+{
+  PyProcBuffer buffer;
+  
+  PyObject *encoded = EncodedStream(obj);
+  
+  if (encoded)
+  {
+    obj = encoded;
+  }
+  
+  bool acquired = buffer.acquire(obj);
+  
+  Py_XDECREF(encoded);
+  
+  if (!acquired)
+  {
+    PyErr_Clear();
+    AiMsgError("[pyproc] NodeStream: Object doesn't support the buffer protocol");
+    return false;
+  }
+  
+  bool rv = true;
+  
+  // Current on this thread only, the workers get it through ApplyData
+  PyProcNames *names = PyProcNames::Current();
+  
+  Py_BEGIN_ALLOW_THREADS
+  
+  std::vector<WireNode> records;
+  std::string err;
+  
+  if (!Parse((const char*) buffer.data(), buffer.bytes(), records, err))
+  {
+    AiMsgError("[pyproc] NodeStream: %s", err.c_str());
+    rv = false;
+  }
+  else
+  {
+    std::vector<AtNode*> created(records.size(), (AtNode*)0);
+    
+    ApplyData ad;
+    
+    ad.records = &records;
+    ad.nodes = &created;
+    ad.names = names;
+    ad.firstName = names->reserve((unsigned long) records.size());
+    
+    // All nodes must exist before parameters referencing them by name are set
+    PyProcParallelFor(records.size(), 256, CreateNodes, &ad);
+    PyProcParallelFor(records.size(), 256, SetParams, &ad);
+    
+    for (size_t i=0; i<created.size(); ++i)
+    {
+      if (created[i])
+      {
+        nodes.push_back(created[i]);
+      }
+    }
+  }
+  
+  Py_END_ALLOW_THREADS
+  
+  return rv;
+}
@@ -0,0 +1,66 @@
+/*
+Copyright (c) 2016 Gaetan Guidet
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef __pyproc_wire_h__
+#define __pyproc_wire_h__
+
+#include <Python.h>
+#include <ai.h>
+#include <vector>
+
+// Binary node stream, version 1
+//
+// All integers are little endian, there is no padding
+//
+//   header : "PYPN" uint32 version
+//   then records until the end of the buffer, each starting with a uint8 opcode
+//
+//   1 node  : string node_type, string name (empty for a name unique to the
+//             procedural, see names.h)
+//   2 param : string param, uint8 type, uint8 nkeys, uint32 nelements, values
+//             applies to the previous node record
+//             nkeys 0 is a single value (nelements must be 1), otherwise an array
+//             of nelements * nkeys values (key major)
+//
+//   string  : uint32 length, then length bytes (no terminating null)
+//   values  : BYTE, BOOLEAN 1 byte; INT, UINT, ENUM, FLOAT 4 bytes;
+//             RGB, VECTOR, POINT 3 floats; RGBA 4 floats; POINT2 2 floats;
+//             MATRIX 16 floats (row major); STRING a string; NODE a string
+//             holding the node name (empty for none)
+//
+// pyproc.NodeStream is the python side encoder
+
+#define PYPROC_WIRE_VERSION 1
+
+// Add the python encoder to the pyproc module
+bool PyProcWireInit(PyObject *mod);
+
+// Check for an encoded node stream buffer or a pyproc.NodeStream object
+// GIL must be held
+bool PyProcIsNodeStream(PyObject *obj);
+
+// Decode a node stream, create its nodes and append them to 'nodes'
+// The GIL must be held when calling, it is released while decoding
+// Node creation and parameter assignment are split across threads for large streams
+bool PyProcApplyNodeStream(PyObject *obj, std::vector<AtNode*> &nodes);
+
+#endif
@@ -19,6 +19,7 @@
 # SOFTWARE.
 
 import arnold
+import pyproc
 
 def Init(procName):
    proc = arnold.AiNodeLookUpByName(procName)
@@ -79,7 +80,8 @@ def GetNode(user_data, i):
    ptype, pval = user_data.get("type")
    n = arnold.AiNode(pval)
    if n:
-      name = "sample_%s" % pval
+      # Unique to this procedural, procedurals of the same type don't collide
+      name = pyproc.uniquename("sample_%s" % pval)
       arnold.AiNodeSetStr(n, "name", name)
       ne = arnold.AiNodeGetNodeEntry(n)
       for k, v in user_data.iteritems():
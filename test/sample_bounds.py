@@ -0,0 +1,41 @@
+# Copyright (c) 2016 Gaetan Guidet
+# 
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+# 
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+# 
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+
+# Same as sample.py with a Bounds function, procedurals loaded at init defer their
+# Init and expansion to a copy of themselves, loaded once a ray reaches the bounds
+
+import os
+import imp
+import arnold
+
+_sample = imp.load_source("sample", os.path.join(os.path.dirname(os.path.abspath(__file__)), "sample.py"))
+
+Init = _sample.Init
+NumNodes = _sample.NumNodes
+GetNode = _sample.GetNode
+Cleanup = _sample.Cleanup
+
+def Bounds(procName):
+   # Returning None expands the procedural right away
+   proc = arnold.AiNodeLookUpByName(procName)
+   if not proc or arnold.AiNodeGetStr(proc, "type") != "sphere":
+      return None
+   r = arnold.AiNodeGetFlt(proc, "radius")
+   return ((-r, -r, -r), (r, r, r))
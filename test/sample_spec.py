@@ -0,0 +1,42 @@
+# Copyright (c) 2016 Gaetan Guidet
+# 
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+# 
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+# 
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+
+# Same as sample.py but GetNode returns a node specification, pyproc creates the
+# node and sets its parameters natively
+
+import os
+import imp
+
+_sample = imp.load_source("sample", os.path.join(os.path.dirname(os.path.abspath(__file__)), "sample.py"))
+
+Init = _sample.Init
+NumNodes = _sample.NumNodes
+Cleanup = _sample.Cleanup
+
+def GetNode(user_data, i):
+   ptype, pval = user_data.get("type")
+   # (node_type, name, {param: value}), a None name lets pyproc generate a name
+   # unique to this procedural
+   params = {}
+   for k, v in user_data.iteritems():
+      if k in ("type", "verbose"):
+         continue
+      params[k] = v[1]
+   return (pval, None, params)
@@ -0,0 +1,47 @@
+# Copyright (c) 2016 Gaetan Guidet
+# 
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+# 
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+# 
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+
+# Same as sample.py but all nodes are returned at once by GetNodes as a binary node
+# stream, decoded natively
+
+import os
+import imp
+import arnold
+import pyproc
+
+_sample = imp.load_source("sample", os.path.join(os.path.dirname(os.path.abspath(__file__)), "sample.py"))
+
+Init = _sample.Init
+Cleanup = _sample.Cleanup
+
+def GetNodes(user_data):
+   ptype, pval = user_data.get("type", (arnold.AI_TYPE_UNDEFINED, ""))
+   if pval not in ["sphere", "box", "cylinder"]:
+      return []
+   stream = pyproc.NodeStream()
+   # Unnamed nodes get a name unique to this procedural
+   stream.node(pval)
+   for k, v in user_data.iteritems():
+      if k in ("type", "verbose"):
+         continue
+      ptype, pval = v
+      if ptype in (arnold.AI_TYPE_BOOLEAN, arnold.AI_TYPE_INT, arnold.AI_TYPE_UINT, arnold.AI_TYPE_FLOAT, arnold.AI_TYPE_STRING):
+         stream.set(k, ptype, pval)
+   return stream
@@ -0,0 +1,75 @@
+# Copyright (c) 2016 Gaetan Guidet
+# 
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+# 
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+# 
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+
+# Smoke test for the native geometry builders and their deduplication, see smoke.ass
+# Failed checks raise, making the procedural fail
+
+import os
+import imp
+import array
+import pyproc
+
+smoke_util = imp.load_source("smoke_util", os.path.join(os.path.dirname(os.path.abspath(__file__)), "smoke_util.py"))
+
+def Init(procName):
+   return (1, None)
+
+def GetNodes(user_data):
+   nodes = []
+   
+   P = array.array("f", [0, 0, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0])
+   F = array.array("I", [4])
+   I = array.array("I", [0, 1, 2, 3])
+   N = array.array("f", [0, 0, 1] * 4)
+   UV = array.array("f", [0, 0, 1, 0, 1, 1, 0, 1])
+   
+   nodes.append(pyproc.polymesh("smoke_quad", P, F, I, normals=N, uvs=UV))
+   
+   # points, face_counts and indices are required
+   smoke_util.expect(TypeError, pyproc.polymesh, "smoke_bad", None, F, I)
+   smoke_util.expect(TypeError, pyproc.polymesh, "smoke_bad", P, None, I)
+   smoke_util.expect(TypeError, pyproc.polymesh, "smoke_bad", P, F, None)
+   smoke_util.expect(ValueError, pyproc.polymesh, "smoke_bad", P, array.array("I", [5]), I)
+   smoke_util.expect(ValueError, pyproc.polymesh, "smoke_bad", P, F, I, normals=array.array("f", [0, 0, 1]))
+   
+   CN = array.array("I", [4])
+   CP = array.array("f", [0, 0, 0, 0, 1, 0, 1, 1, 0, 1, 2, 0])
+   
+   nodes.append(pyproc.curves("smoke_curve", CN, CP, 0.05))
+   nodes.append(pyproc.curves("smoke_curve_linear", array.array("I", [2]), CP[:6], array.array("f", [0.1, 0.05]), basis="linear"))
+   
+   # num_points and points are required, radius can't be negative
+   smoke_util.expect(TypeError, pyproc.curves, "smoke_bad", None, CP, 0.05)
+   smoke_util.expect(TypeError, pyproc.curves, "smoke_bad", CN, None, 0.05)
+   smoke_util.expect(ValueError, pyproc.curves, "smoke_bad", CN, CP, -0.05)
+   
+   # The second identical shape becomes a ginstance of the first one
+   hits = pyproc.dedupestats()["hits"]
+   nodes.append(pyproc.polymesh("smoke_dedupe0", P, F, I, dedupe=True))
+   nodes.append(pyproc.polymesh("smoke_dedupe1", P, F, I, dedupe=True))
+   assert pyproc.dedupestats()["hits"] > hits, "polymesh wasn't deduplicated"
+   
+   for node in nodes:
+      assert node, "Failed to create node"
+   
+   return nodes
+
+def Cleanup(user_data):
+   return 1
@@ -0,0 +1,68 @@
+# Copyright (c) 2016 Gaetan Guidet
+# 
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+# 
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+# 
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+
+# Smoke test for native scattering, camera culling and instancing, see smoke.ass
+# Failed checks raise, making the procedural fail
+
+import array
+import struct
+import pyproc
+
+def Init(procName):
+   return (1, None)
+
+def GetNodes(user_data):
+   # A 4x4 ground plane below the camera, its two triangles are also the prototype
+   P = array.array("f", [-2, -1, -1, 2, -1, -1, 2, -1, -5, -2, -1, -5])
+   F = array.array("I", [3, 3])
+   I = array.array("I", [0, 1, 2, 0, 2, 3])
+   
+   proto = pyproc.polymesh("smoke_proto", P, F, I)
+   assert proto, "Failed to create prototype"
+   
+   count = 1000
+   points, normals, faces = pyproc.scatter(P, I, count, face_counts=F, seed=1)
+   assert len(buffer(points)) == count * 12, "scatter returned %d byte(s)" % len(buffer(points))
+   assert len(buffer(normals)) == count * 12
+   assert len(buffer(faces)) == count * 4
+   
+   # Same seed, same points
+   again = pyproc.scatter(P, I, count, face_counts=F, seed=1)[0]
+   assert str(buffer(points)) == str(buffer(again)), "scatter isn't deterministic"
+   
+   centers = struct.unpack("%df" % (3 * count), buffer(points))
+   
+   matrices = array.array("f")
+   for i in xrange(count):
+      matrices.extend([0.01, 0, 0, 0, 0, 0.01, 0, 0, 0, 0, 0.01, 0, centers[3 * i], centers[3 * i + 1], centers[3 * i + 2], 1])
+   
+   kept = pyproc.cull(points, radius=0.02, padding=0.1)
+   assert len(buffer(kept)) // 4 <= count
+   
+   kept = pyproc.cull(matrices, radius=2.0, matrices=True, max_distance=1e6)
+   assert len(buffer(kept)) // 4 <= count
+   
+   instances = pyproc.instance(["smoke_proto"], matrices, cull={"padding": 0.1})
+   assert len(instances) <= count
+   
+   return [proto, instances]
+
+def Cleanup(user_data):
+   return 1
@@ -0,0 +1,75 @@
+# Copyright (c) 2016 Gaetan Guidet
+# 
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+# 
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+# 
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+
+# Smoke test for the native point cloud loader, see smoke.ass
+# Failed checks raise, making the procedural fail
+
+import os
+import imp
+import array
+import shutil
+import struct
+import tempfile
+import pyproc
+
+smoke_util = imp.load_source("smoke_util", os.path.join(os.path.dirname(os.path.abspath(__file__)), "smoke_util.py"))
+
+def _npy(path, shape, values):
+   header = "{'descr': '<f4', 'fortran_order': False, 'shape': %s, }" % shape
+   header += " " * (16 - (10 + len(header) + 1) % 16) + "\n"
+   f = open(path, "wb")
+   f.write("\x93NUMPY\x01\x00" + struct.pack("<H", len(header)) + header)
+   f.write(struct.pack("<%df" % len(values), *values))
+   f.close()
+
+def Init(procName):
+   return (1, None)
+
+def GetNodes(user_data):
+   nodes = []
+   
+   tmpdir = tempfile.mkdtemp()
+   
+   try:
+      pos = os.path.join(tmpdir, "pos.npy")
+      rad = os.path.join(tmpdir, "rad.npy")
+      bad = os.path.join(tmpdir, "bad.npy")
+      
+      _npy(pos, "(4, 3)", [0, 0, 0, 1, 0, 0, 0, 1, 0, 0, 0, 1])
+      _npy(rad, "(4,)", [0.1, 0.2, 0.3, 0.4])
+      _npy(bad, "(2, 2, 3)", range(12))
+      
+      nodes.append(pyproc.loadpoints("smoke_points", pos, 0.1, mode="sphere"))
+      nodes.append(pyproc.loadpoints("smoke_points_radii", pos, rad))
+      
+      # Only (count,) and (count, dims) shapes are supported
+      smoke_util.expect(IOError, pyproc.loadpoints, "smoke_bad", bad, 0.1)
+      smoke_util.expect(IOError, pyproc.loadpoints, "smoke_bad", os.path.join(tmpdir, "missing.npy"), 0.1)
+      
+   finally:
+      shutil.rmtree(tmpdir, True)
+   
+   for node in nodes:
+      assert node, "Failed to create node"
+   
+   return nodes
+
+def Cleanup(user_data):
+   return 1
@@ -0,0 +1,86 @@
+# Copyright (c) 2016 Gaetan Guidet
+# 
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+# 
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+# 
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+
+# Smoke test for the pyproc python helpers: buffers, arrays and coroutines, see smoke.ass
+# Failed checks raise, making the procedural fail
+
+import os
+import imp
+import sys
+import array
+import ctypes
+import arnold
+import pyproc
+
+smoke_util = imp.load_source("smoke_util", os.path.join(os.path.dirname(os.path.abspath(__file__)), "smoke_util.py"))
+
+@pyproc.coroutine
+def _double(value):
+   result = yield pyproc.run(lambda: value * 2)
+   raise pyproc.Return(result)
+
+@pyproc.coroutine
+def _nested():
+   yield pyproc.run(lambda: None)
+   # Blocking on the event loop thread would deadlock it
+   pyproc.wait(_double(1))
+
+def _generator():
+   yield None
+
+def Init(procName):
+   # Buffers not in the native byte order are refused
+   if sys.byteorder == "little":
+      foreign = ctypes.c_float.__ctype_be__
+   else:
+      foreign = ctypes.c_float.__ctype_le__
+   smoke_util.expect(ValueError, pyproc.bounds, (foreign * 3)(1, 2, 3))
+   assert pyproc.bounds(array.array("f", [1, 2, 3])), "bounds failed"
+   
+   # Coroutines
+   assert pyproc.wait(_double(21)) == 42, "Wrong coroutine result"
+   smoke_util.expect(RuntimeError, pyproc.wait, _nested())
+   assert pyproc.iscoroutine(_double(1)), "Decorated generator isn't a coroutine"
+   assert not pyproc.iscoroutine(_generator()), "Plain generator is a coroutine"
+   
+   return (1, None)
+
+def GetNodes(user_data):
+   P = array.array("f", [0, 0, 0, 1, 0, 0, 1, 1, 0])
+   
+   mesh = pyproc.polymesh("smoke_array_mesh", P, array.array("I", [3]), array.array("I", [0, 1, 2]))
+   assert mesh, "Failed to create node"
+   
+   # pyproc.Array of another type is converted, the original stays valid
+   floats = pyproc.array(P, arnold.AI_TYPE_FLOAT)
+   pyproc.setarray("smoke_array_mesh", "vlist", floats)
+   assert len(floats) == 9, "Converted pyproc.Array was adopted"
+   
+   # Or refused when it doesn't hold whole elements
+   smoke_util.expect(ValueError, pyproc.setarray, "smoke_array_mesh", "vlist", pyproc.array(P[:4], arnold.AI_TYPE_FLOAT))
+   
+   # Matching pyproc.Array are adopted
+   points = pyproc.array(P, arnold.AI_TYPE_POINT)
+   pyproc.setarray("smoke_array_mesh", "vlist", points)
+   
+   return [mesh]
+
+def Cleanup(user_data):
+   return 1
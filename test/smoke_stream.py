@@ -0,0 +1,59 @@
+# Copyright (c) 2016 Gaetan Guidet
+# 
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+# 
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+# 
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+
+# Smoke test for the native node stream decoder, see smoke.ass
+# Failed checks raise, making the procedural fail
+
+import os
+import imp
+import array
+import arnold
+import pyproc
+
+smoke_util = imp.load_source("smoke_util", os.path.join(os.path.dirname(os.path.abspath(__file__)), "smoke_util.py"))
+
+def Init(procName):
+   return (1, None)
+
+def Generate(user_data):
+   stream = pyproc.NodeStream()
+   
+   stream.node("sphere", "smoke_stream_sphere")
+   stream.set("radius", arnold.AI_TYPE_FLOAT, 0.5)
+   stream.set("center", arnold.AI_TYPE_POINT, (0, 0, -3))
+   
+   stream.node("polymesh", "smoke_stream_mesh")
+   stream.set("vlist", arnold.AI_TYPE_POINT, array.array("f", [0, 0, -3, 1, 0, -3, 1, 1, -3]), array=True)
+   stream.set("nsides", arnold.AI_TYPE_UINT, [3], array=True)
+   stream.set("vidxs", arnold.AI_TYPE_UINT, [0, 1, 2], array=True)
+   
+   # Encoded streams are accepted as well
+   yield stream.tostring()
+   
+   sphere = arnold.AiNodeLookUpByName("smoke_stream_sphere")
+   assert sphere, "Node stream sphere wasn't created"
+   assert arnold.AiNodeGetFlt(sphere, "radius") == 0.5, "Node stream sphere has the wrong radius"
+   assert arnold.AiNodeLookUpByName("smoke_stream_mesh"), "Node stream polymesh wasn't created"
+   
+   # Parameters before any node are refused by the encoder
+   smoke_util.expect(RuntimeError, pyproc.NodeStream().set, "radius", arnold.AI_TYPE_FLOAT, 1.0)
+
+def Cleanup(user_data):
+   return 1